@@ -0,0 +1,452 @@
+#pragma once
+
+#include "HitPartitioning.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief Fixed radius nearest neighbour edge building in a (low dimensional)
+ * embedding space.
+ *
+ * This is a self-contained replacement for the (CPU) edge building of the Acts
+ * GNN plugin (ActsPlugins::detail::buildEdges + postprocessEdgeTensor) and
+ * produces the same edges: all pairs of points with a distance of at most
+ * radius, without self loops and duplicates, ordered lexicographically with
+ * src < dst. Additionally the number of neighbours of each point can be
+ * limited to the knn closest ones (similar to what the CUDA implementation in
+ * Acts does). Edges are kept if either of the two points keeps the other one.
+ *
+ * @note The CPU path of the Acts plugin ignores its kVal, so it only produces
+ * the same edges as this builder with knn <= 0. With a knn limit dense regions
+ * get fewer edges than they did with the torch based edge building.
+ *
+ * Points are sorted into a uniform grid over the first (up to) three
+ * dimensions with a cell size of at least radius. The points in the cells are
+ * stored contiguously in structure-of-arrays form, such that the distances to
+ * all candidates in a row of neighbouring cells can be computed in a
+ * vectorizable loop. Queries can be split across several threads.
+ */
+class RadiusEdgeBuilder {
+public:
+  struct Config {
+    float radius{0.1f};
+    /// Maximum number of neighbours per point (<= 0: unlimited)
+    int knn{500};
+    /// Randomly flip the direction of (about) half of the edges
+    bool shuffleDirections{false};
+    /// Number of threads that are used for the neighbour queries
+    unsigned numThreads{1};
+    /// Seed for shuffling the edge directions
+    std::uint64_t seed{42};
+  };
+
+  RadiusEdgeBuilder() = default;
+  explicit RadiusEdgeBuilder(const Config& config) : m_config(config) {}
+
+  const Config& config() const { return m_config; }
+
+  /**
+   * @brief Build the edges between the points
+   *
+   * @param points   Row-major [numPoints, dim] coordinates
+   * @param dim      The dimension of the embedding space
+   * @param allocate Callable that is invoked once with the number of edges and
+   *                 that has to return a pointer to (at least) 2 * numEdges
+   *                 int64_t. These are filled in row-major [2, numEdges]
+   *                 layout, i.e. the source indices followed by the
+   *                 destination indices. This allows to fill the final tensor
+   *                 directly.
+   *
+   * @returns The number of edges
+   */
+  template <typename AllocFunc>
+  std::size_t build(std::span<const float> points, std::size_t dim, AllocFunc&& allocate) const;
+
+  /**
+   * @brief Build the edges separately in each sector of a partition
+   *
+   * Only points in the same sector are connected. The sectors are distributed
+   * over numThreads threads and the edges of overlapping sectors are merged.
+   * The edges are the same as for build(points, dim, allocate) if the
+   * sectors overlap sufficiently, otherwise some edges across sector
+   * boundaries are missed. The knn limit is applied in each sector.
+   */
+  template <typename AllocFunc>
+  std::size_t build(std::span<const float> points, std::size_t dim, const HitPartition& partition,
+                    AllocFunc&& allocate) const;
+
+  /// Convenience overload returning the [2, numEdges] edge index in a vector
+  std::vector<std::int64_t> build(std::span<const float> points, std::size_t dim) const {
+    std::vector<std::int64_t> edgeIndex{};
+    build(points, dim, [&edgeIndex](std::size_t nEdges) {
+      edgeIndex.resize(2 * nEdges);
+      return edgeIndex.data();
+    });
+    return edgeIndex;
+  }
+
+private:
+  static constexpr std::size_t MaxGridDims = 3;
+  static constexpr std::size_t ChunkSize = 64;
+
+  using EdgePair = std::pair<std::uint32_t, std::uint32_t>;
+
+  /// The points sorted into grid cells
+  struct Grid {
+    std::size_t dim{};
+    std::size_t gridDims{};
+    float cellSize{};
+    std::array<float, MaxGridDims> lower{};
+    std::array<std::int64_t, MaxGridDims> nCells{};
+    std::array<std::int64_t, MaxGridDims> strides{};
+    /// Start of each cell in the sorted points (size: nCells + 1)
+    std::vector<std::uint32_t> cellStart{};
+    /// Original indices of the sorted points
+    std::vector<std::uint32_t> order{};
+    /// Coordinates of the sorted points (dim-major)
+    std::vector<float> coords{};
+
+    std::int64_t cellCoord(float x, std::size_t iDim) const {
+      const auto c = static_cast<std::int64_t>((x - lower[iDim]) / cellSize);
+      return std::clamp<std::int64_t>(c, 0, nCells[iDim] - 1);
+    }
+  };
+
+  /// The result of the queries of one (contiguous) range of points
+  struct QueryResult {
+    /// Edges (i, j) with j > i that are kept by i
+    std::vector<EdgePair> forward{};
+    /// Pairs (j, i) with j < i that are kept by i, but where j might have
+    /// dropped i, because j has more than knn neighbours
+    std::vector<EdgePair> backward{};
+  };
+
+  Grid buildGrid(std::span<const float> points, std::size_t dim) const;
+  void query(const Grid& grid, std::span<const float> points, std::size_t begin, std::size_t end,
+             std::vector<char>& truncated, QueryResult& result) const;
+
+  /// Write the (sorted) edges of all parts into the output, optionally
+  /// flipping their direction
+  template <typename AllocFunc>
+  std::size_t writeEdges(std::span<const std::vector<EdgePair>> parts, AllocFunc&& allocate) const;
+
+  Config m_config{};
+};
+
+inline RadiusEdgeBuilder::Grid RadiusEdgeBuilder::buildGrid(std::span<const float> points, std::size_t dim) const {
+  Grid grid{};
+  grid.dim = dim;
+  grid.gridDims = std::min(dim, MaxGridDims);
+  const auto nPoints = points.size() / dim;
+
+  std::array<float, MaxGridDims> upper{};
+  grid.lower.fill(std::numeric_limits<float>::max());
+  upper.fill(std::numeric_limits<float>::lowest());
+  for (std::size_t i = 0; i < nPoints; ++i) {
+    for (std::size_t d = 0; d < grid.gridDims; ++d) {
+      grid.lower[d] = std::min(grid.lower[d], points[i * dim + d]);
+      upper[d] = std::max(upper[d], points[i * dim + d]);
+    }
+  }
+
+  // Any cell size >= radius works, since the neighbouring cells are always
+  // searched. Make the cells larger if the grid would otherwise become much
+  // larger than the number of points
+  const auto maxCells = static_cast<double>(std::max<std::size_t>(4 * nPoints, 1));
+  grid.cellSize = std::max(m_config.radius, std::numeric_limits<float>::min());
+  while (true) {
+    double totalCells = 1;
+    for (std::size_t d = 0; d < grid.gridDims; ++d) {
+      totalCells *= std::floor((upper[d] - grid.lower[d]) / grid.cellSize) + 1;
+    }
+    if (totalCells <= maxCells) {
+      break;
+    }
+    grid.cellSize *= static_cast<float>(std::max(1.1, std::pow(totalCells / maxCells, 1. / grid.gridDims)));
+  }
+
+  // Row-major cell indices, with the last grid dimension running fastest
+  std::int64_t totalCells = 1;
+  for (std::size_t d = grid.gridDims; d-- > 0;) {
+    grid.nCells[d] = static_cast<std::int64_t>((upper[d] - grid.lower[d]) / grid.cellSize) + 1;
+    grid.strides[d] = totalCells;
+    totalCells *= grid.nCells[d];
+  }
+
+  // Counting sort of the points into the cells
+  std::vector<std::uint32_t> cellIdcs(nPoints);
+  grid.cellStart.assign(totalCells + 1, 0);
+  for (std::size_t i = 0; i < nPoints; ++i) {
+    std::int64_t cell = 0;
+    for (std::size_t d = 0; d < grid.gridDims; ++d) {
+      cell += grid.cellCoord(points[i * dim + d], d) * grid.strides[d];
+    }
+    cellIdcs[i] = static_cast<std::uint32_t>(cell);
+    ++grid.cellStart[cell + 1];
+  }
+  for (std::int64_t c = 0; c < totalCells; ++c) {
+    grid.cellStart[c + 1] += grid.cellStart[c];
+  }
+
+  grid.order.resize(nPoints);
+  grid.coords.resize(nPoints * dim);
+  auto fillPos = std::vector<std::uint32_t>(grid.cellStart.begin(), grid.cellStart.end() - 1);
+  for (std::size_t i = 0; i < nPoints; ++i) {
+    const auto pos = fillPos[cellIdcs[i]]++;
+    grid.order[pos] = static_cast<std::uint32_t>(i);
+    for (std::size_t d = 0; d < dim; ++d) {
+      grid.coords[d * nPoints + pos] = points[i * dim + d];
+    }
+  }
+
+  return grid;
+}
+
+inline void RadiusEdgeBuilder::query(const Grid& grid, std::span<const float> points, std::size_t begin,
+                                     std::size_t end, std::vector<char>& truncated, QueryResult& result) const {
+  const auto dim = grid.dim;
+  const auto nPoints = grid.order.size();
+  const auto nGridDims = grid.gridDims;
+  const auto lastDim = nGridDims - 1;
+  const float r2 = m_config.radius * m_config.radius;
+  const auto knn = m_config.knn > 0 ? static_cast<std::size_t>(m_config.knn) : std::numeric_limits<std::size_t>::max();
+
+  // The neighbouring cells in the last grid dimension are contiguous, so only
+  // the combinations of the other dimensions have to be enumerated
+  std::size_t nCombinations = 1;
+  for (std::size_t d = 0; d < lastDim; ++d) {
+    nCombinations *= 3;
+  }
+
+  std::vector<std::pair<float, std::uint32_t>> neighbours{};
+  std::array<float, ChunkSize> dist2{};
+  std::array<std::int64_t, MaxGridDims> center{};
+
+  for (auto i = begin; i < end; ++i) {
+    const float* self = points.data() + i * dim;
+    for (std::size_t d = 0; d < nGridDims; ++d) {
+      center[d] = grid.cellCoord(self[d], d);
+    }
+
+    neighbours.clear();
+    for (std::size_t comb = 0; comb < nCombinations; ++comb) {
+      std::int64_t rowStart = 0;
+      bool valid = true;
+      auto rest = comb;
+      for (std::size_t d = 0; d < lastDim; ++d) {
+        const auto c = center[d] + static_cast<std::int64_t>(rest % 3) - 1;
+        rest /= 3;
+        if (c < 0 || c >= grid.nCells[d]) {
+          valid = false;
+          break;
+        }
+        rowStart += c * grid.strides[d];
+      }
+      if (!valid) {
+        continue;
+      }
+
+      const auto firstCell = rowStart + std::max<std::int64_t>(center[lastDim] - 1, 0);
+      const auto lastCell = rowStart + std::min<std::int64_t>(center[lastDim] + 1, grid.nCells[lastDim] - 1);
+      const std::size_t candBegin = grid.cellStart[firstCell];
+      const std::size_t candEnd = grid.cellStart[lastCell + 1];
+
+      for (auto chunk = candBegin; chunk < candEnd; chunk += ChunkSize) {
+        const auto n = std::min(ChunkSize, candEnd - chunk);
+        std::fill_n(dist2.begin(), n, 0.f);
+        for (std::size_t d = 0; d < dim; ++d) {
+          const float* coords = grid.coords.data() + d * nPoints + chunk;
+          const float x = self[d];
+          for (std::size_t j = 0; j < n; ++j) {
+            const float diff = coords[j] - x;
+            dist2[j] += diff * diff;
+          }
+        }
+        for (std::size_t j = 0; j < n; ++j) {
+          const auto other = grid.order[chunk + j];
+          if (dist2[j] <= r2 && other != i) {
+            neighbours.emplace_back(dist2[j], other);
+          }
+        }
+      }
+    }
+
+    if (neighbours.size() > knn) {
+      std::ranges::nth_element(neighbours, neighbours.begin() + knn);
+      neighbours.resize(knn);
+      truncated[i] = 1;
+    }
+    std::ranges::sort(neighbours, {}, [](const auto& n) { return n.second; });
+
+    const auto self32 = static_cast<std::uint32_t>(i);
+    for (const auto& [d2, other] : neighbours) {
+      if (other > self32) {
+        result.forward.emplace_back(self32, other);
+      } else {
+        result.backward.emplace_back(other, self32);
+      }
+    }
+  }
+}
+
+template <typename AllocFunc>
+std::size_t RadiusEdgeBuilder::build(std::span<const float> points, std::size_t dim, AllocFunc&& allocate) const {
+  assert(dim > 0 && points.size() % dim == 0);
+  const auto nPoints = points.size() / dim;
+  assert(nPoints < std::numeric_limits<std::uint32_t>::max());
+
+  std::vector<QueryResult> results(std::clamp<std::size_t>(m_config.numThreads, 1, std::max<std::size_t>(nPoints, 1)));
+  std::vector<char> truncated(nPoints, 0);
+  if (nPoints > 0) {
+    const auto grid = buildGrid(points, dim);
+    const auto nRanges = results.size();
+    const auto rangeSize = (nPoints + nRanges - 1) / nRanges;
+    auto runRange = [&](std::size_t iRange) {
+      const auto begin = std::min(iRange * rangeSize, nPoints);
+      const auto end = std::min(begin + rangeSize, nPoints);
+      query(grid, points, begin, end, truncated, results[iRange]);
+    };
+
+    if (nRanges == 1) {
+      runRange(0);
+    } else {
+      std::vector<std::jthread> threads{};
+      threads.reserve(nRanges - 1);
+      for (std::size_t iRange = 1; iRange < nRanges; ++iRange) {
+        threads.emplace_back(runRange, iRange);
+      }
+      runRange(0);
+    }
+  }
+
+  // Pairs that only the second point kept. In the (usual) case that no point
+  // has more than knn neighbours, there are none of these and the forward
+  // edges of all ranges are already sorted
+  std::vector<EdgePair> extraEdges{};
+  for (const auto& res : results) {
+    for (const auto& edge : res.backward) {
+      if (truncated[edge.first]) {
+        extraEdges.push_back(edge);
+      }
+    }
+  }
+  if (!extraEdges.empty()) {
+    for (auto& res : results) {
+      extraEdges.insert(extraEdges.end(), res.forward.begin(), res.forward.end());
+      res.forward.clear();
+    }
+    std::ranges::sort(extraEdges);
+    const auto [first, last] = std::ranges::unique(extraEdges);
+    extraEdges.erase(first, last);
+    results.front().forward = std::move(extraEdges);
+  }
+
+  std::vector<std::vector<EdgePair>> parts(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    parts[i] = std::move(results[i].forward);
+  }
+  return writeEdges(parts, std::forward<AllocFunc>(allocate));
+}
+
+template <typename AllocFunc>
+std::size_t RadiusEdgeBuilder::build(std::span<const float> points, std::size_t dim, const HitPartition& partition,
+                                     AllocFunc&& allocate) const {
+  assert(dim > 0 && points.size() % dim == 0);
+  const auto nSectors = partition.numSectors();
+  const auto nWorkers = std::clamp<std::size_t>(m_config.numThreads, 1, std::max<std::size_t>(nSectors, 1));
+
+  // Each sector is handled by one thread
+  auto sectorConfig = m_config;
+  sectorConfig.shuffleDirections = false;
+  sectorConfig.numThreads = 1;
+  const RadiusEdgeBuilder sectorBuilder{sectorConfig};
+
+  std::vector<std::vector<EdgePair>> workerEdges(nWorkers);
+  std::atomic<std::size_t> nextSector{0};
+  auto work = [&](std::size_t iWorker) {
+    std::vector<float> sectorPoints{};
+    std::vector<std::int64_t> sectorEdges{};
+    auto& edges = workerEdges[iWorker];
+    for (auto iSector = nextSector++; iSector < nSectors; iSector = nextSector++) {
+      const auto hits = partition.sector(iSector);
+      sectorPoints.resize(hits.size() * dim);
+      for (std::size_t i = 0; i < hits.size(); ++i) {
+        std::copy_n(points.data() + hits[i] * dim, dim, sectorPoints.data() + i * dim);
+      }
+      const auto nSectorEdges = sectorBuilder.build(sectorPoints, dim, [&sectorEdges](std::size_t n) {
+        sectorEdges.resize(2 * n);
+        return sectorEdges.data();
+      });
+      // The hits are sorted in each sector, so src < dst also holds for the
+      // global indices
+      for (std::size_t e = 0; e < nSectorEdges; ++e) {
+        edges.emplace_back(hits[sectorEdges[e]], hits[sectorEdges[nSectorEdges + e]]);
+      }
+    }
+  };
+
+  if (nWorkers == 1) {
+    work(0);
+  } else {
+    std::vector<std::jthread> threads{};
+    threads.reserve(nWorkers - 1);
+    for (std::size_t iWorker = 1; iWorker < nWorkers; ++iWorker) {
+      threads.emplace_back(work, iWorker);
+    }
+    work(0);
+  }
+
+  // Remove the edges that have been found in more than one sector
+  std::vector<EdgePair> merged = std::move(workerEdges.front());
+  for (std::size_t i = 1; i < workerEdges.size(); ++i) {
+    merged.insert(merged.end(), workerEdges[i].begin(), workerEdges[i].end());
+  }
+  std::ranges::sort(merged);
+  const auto [first, last] = std::ranges::unique(merged);
+  merged.erase(first, last);
+
+  return writeEdges(std::span(&merged, 1), std::forward<AllocFunc>(allocate));
+}
+
+template <typename AllocFunc>
+std::size_t RadiusEdgeBuilder::writeEdges(std::span<const std::vector<EdgePair>> parts, AllocFunc&& allocate) const {
+  std::size_t nEdges = 0;
+  for (const auto& part : parts) {
+    nEdges += part.size();
+  }
+
+  std::int64_t* src = allocate(nEdges);
+  std::int64_t* dst = src + nEdges;
+  std::mt19937_64 rng{m_config.seed};
+  std::size_t iEdge = 0;
+  for (const auto& part : parts) {
+    for (const auto& [from, to] : part) {
+      if (m_config.shuffleDirections && (rng() & 1)) {
+        src[iEdge] = to;
+        dst[iEdge] = from;
+      } else {
+        src[iEdge] = from;
+        dst[iEdge] = to;
+      }
+      ++iEdge;
+    }
+  }
+
+  return nEdges;
+}
+
+} // namespace mlutils
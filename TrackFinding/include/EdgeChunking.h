@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief Configuration for running the edge classification on chunks of the
+ * graph that fit into a memory budget
+ *
+ * The memory a chunk needs during the inference is estimated linearly from its
+ * number of nodes and edges. The costs per node and edge depend on the model
+ * (e.g. on the hidden dimension of the GNN) and have to be calibrated, e.g.
+ * with the peak RSS reported by gnn_replay_benchmark.
+ */
+struct EdgeChunkingConfig {
+  /// Estimated memory that a chunk may use (0: no chunking)
+  std::size_t memoryBudgetBytes{0};
+  std::size_t bytesPerNode{2048};
+  std::size_t bytesPerEdge{4096};
+  /// Number of hops by which the nodes of a chunk are extended with their
+  /// neighbours. The target of an edge is already one hop away from its
+  /// source, so the scores of the edges are identical to the ones for the
+  /// whole graph if this exceeds the number of message passing steps of the
+  /// GNN. With fewer hops the messages from further away are missing
+  unsigned haloHops{1};
+
+  bool enabled() const { return memoryBudgetBytes > 0; }
+
+  std::size_t estimateBytes(std::size_t numNodes, std::size_t numEdges) const {
+    return numNodes * bytesPerNode + numEdges * bytesPerEdge;
+  }
+
+  bool fits(std::size_t bytes) const { return !enabled() || bytes <= memoryBudgetBytes; }
+
+  /// @throws std::invalid_argument for an invalid configuration
+  void validate() const {
+    if (haloHops == 0) {
+      throw std::invalid_argument("At least one halo hop is necessary to keep all edges of the core nodes");
+    }
+    if (enabled() && bytesPerNode == 0 && bytesPerEdge == 0) {
+      throw std::invalid_argument("The memory per node and edge cannot both be zero");
+    }
+  }
+};
+
+/**
+ * @brief A connected part of a graph on which the edge classification runs
+ *
+ * The nodes consist of the core nodes, followed by the halo nodes. The chunk
+ * contains all edges between its nodes, but only the edges that start at a
+ * core node belong to the chunk. The other edges only provide context and
+ * belong to other chunks.
+ */
+struct EdgeChunk {
+  /// The (global) indices of the nodes, core nodes first
+  std::vector<std::uint32_t> nodes{};
+  std::size_t numCoreNodes{0};
+  /// The (global) indices of the edges
+  std::vector<std::uint32_t> edges{};
+  /// The edges with local node indices, as [2, numEdges]
+  std::vector<std::int64_t> edgeIndex{};
+  /// Estimated memory for the inference on this chunk
+  std::size_t estimatedBytes{0};
+
+  std::size_t numEdges() const { return edges.size(); }
+  bool isCoreNode(std::int64_t localNode) const { return static_cast<std::size_t>(localNode) < numCoreNodes; }
+
+  void clear() {
+    nodes.clear();
+    numCoreNodes = 0;
+    edges.clear();
+    edgeIndex.clear();
+    estimatedBytes = 0;
+  }
+};
+
+/**
+ * @brief Split a graph into chunks whose estimated inference memory fits into
+ * the budget of an EdgeChunkingConfig
+ *
+ * The core nodes of the chunks are consecutive ranges of a breadth first
+ * ordering of the nodes, such that they are close to each other in the graph
+ * and share most of their halo. Every node is the core node of exactly one
+ * chunk, i.e. every edge belongs to exactly one chunk. The number of core
+ * nodes adapts to the density of the graph: it is halved if a chunk does not
+ * fit and doubled again if a chunk uses less than half of the budget. A chunk
+ * with a single core node is accepted even if it does not fit.
+ *
+ * Without a memory budget the whole graph is a single chunk.
+ */
+class EdgeChunker {
+public:
+  /**
+   * @brief Prepare the chunking of a graph
+   *
+   * @param numNodes  The number of nodes of the graph
+   * @param edgeIndex The edges of the graph as [2, numEdges]
+   *
+   * @throws std::invalid_argument if an edge points to a non-existing node
+   */
+  EdgeChunker(std::size_t numNodes, std::span<const std::int64_t> edgeIndex, EdgeChunkingConfig config)
+      : m_config(config), m_numNodes(numNodes), m_numEdges(edgeIndex.size() / 2),
+        m_source(edgeIndex.first(m_numEdges)), m_target(edgeIndex.subspan(m_numEdges, m_numEdges)),
+        m_localIdx(numNodes, -1) {
+    if (m_numNodes > std::numeric_limits<std::uint32_t>::max() ||
+        m_numEdges > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::invalid_argument("Graphs with more than 2^32 nodes or edges cannot be chunked");
+    }
+    buildAdjacency();
+    buildNodeOrder();
+    if (!m_config.enabled()) {
+      m_coreSize = m_numNodes;
+      return;
+    }
+    // Start with the number of core nodes that would fit without a halo
+    const auto bytesPerCoreNode =
+        m_config.bytesPerNode + (m_numNodes ? m_numEdges * m_config.bytesPerEdge / m_numNodes : 0);
+    m_coreSize = std::max<std::size_t>(1, m_config.memoryBudgetBytes / std::max<std::size_t>(1, bytesPerCoreNode));
+  }
+
+  std::size_t numNodes() const { return m_numNodes; }
+  std::size_t numEdges() const { return m_numEdges; }
+
+  /// Fill the next chunk. Returns false once all nodes have been the core node
+  /// of a chunk
+  bool next(EdgeChunk& chunk) {
+    if (m_position >= m_numNodes) {
+      return false;
+    }
+    const auto remaining = m_numNodes - m_position;
+    auto coreSize = std::min(m_coreSize, remaining);
+    fill(chunk, coreSize);
+    while (!m_config.fits(chunk.estimatedBytes) && coreSize > 1) {
+      if (chunk.nodes.size() == m_numNodes) {
+        // The halo already covers the whole graph, so the remaining nodes can
+        // just as well be core nodes without needing more memory
+        coreSize = remaining;
+        fill(chunk, coreSize);
+        break;
+      }
+      coreSize = std::max<std::size_t>(1, coreSize / 2);
+      fill(chunk, coreSize);
+    }
+    m_position += coreSize;
+    m_coreSize = 2 * chunk.estimatedBytes < m_config.memoryBudgetBytes ? 2 * coreSize : coreSize;
+    return true;
+  }
+
+private:
+  /// Undirected adjacency of the nodes, storing the indices of the edges
+  void buildAdjacency() {
+    m_adjOffsets.assign(m_numNodes + 1, 0);
+    for (std::size_t e = 0; e < m_numEdges; ++e) {
+      checkNode(m_source[e]);
+      checkNode(m_target[e]);
+      ++m_adjOffsets[m_source[e] + 1];
+      if (m_target[e] != m_source[e]) {
+        ++m_adjOffsets[m_target[e] + 1];
+      }
+    }
+    for (std::size_t i = 0; i < m_numNodes; ++i) {
+      m_adjOffsets[i + 1] += m_adjOffsets[i];
+    }
+    m_adjEdges.resize(m_adjOffsets.back());
+    auto fillPos = m_adjOffsets;
+    for (std::size_t e = 0; e < m_numEdges; ++e) {
+      m_adjEdges[fillPos[m_source[e]]++] = static_cast<std::uint32_t>(e);
+      if (m_target[e] != m_source[e]) {
+        m_adjEdges[fillPos[m_target[e]]++] = static_cast<std::uint32_t>(e);
+      }
+    }
+  }
+
+  /// Breadth first ordering of the nodes, starting a new traversal at the
+  /// lowest unvisited node for every connected component
+  void buildNodeOrder() {
+    m_order.clear();
+    m_order.reserve(m_numNodes);
+    std::vector<bool> visited(m_numNodes, false);
+    for (std::size_t start = 0; start < m_numNodes; ++start) {
+      if (visited[start]) {
+        continue;
+      }
+      visited[start] = true;
+      // The order itself serves as queue
+      auto head = m_order.size();
+      m_order.push_back(static_cast<std::uint32_t>(start));
+      for (; head < m_order.size(); ++head) {
+        forEachNeighbour(m_order[head], [&](std::uint32_t neighbour, std::uint32_t) {
+          if (!visited[neighbour]) {
+            visited[neighbour] = true;
+            m_order.push_back(neighbour);
+          }
+        });
+      }
+    }
+  }
+
+  void checkNode(std::int64_t node) const {
+    if (node < 0 || static_cast<std::size_t>(node) >= m_numNodes) {
+      throw std::invalid_argument("Edge to node " + std::to_string(node) + " in a graph with " +
+                                  std::to_string(m_numNodes) + " nodes");
+    }
+  }
+
+  template <typename Func>
+  void forEachNeighbour(std::uint32_t node, Func&& func) const {
+    for (auto i = m_adjOffsets[node]; i < m_adjOffsets[node + 1]; ++i) {
+      const auto edge = m_adjEdges[i];
+      const auto other = m_source[edge] == node ? m_target[edge] : m_source[edge];
+      func(static_cast<std::uint32_t>(other), edge);
+    }
+  }
+
+  void addNode(EdgeChunk& chunk, std::uint32_t node) {
+    m_localIdx[node] = static_cast<std::int64_t>(chunk.nodes.size());
+    chunk.nodes.push_back(node);
+  }
+
+  /// Fill a chunk with the next coreSize nodes of the order, their halo and
+  /// all edges between them
+  void fill(EdgeChunk& chunk, std::size_t coreSize) {
+    chunk.clear();
+    for (std::size_t i = m_position; i < m_position + coreSize; ++i) {
+      addNode(chunk, m_order[i]);
+    }
+    chunk.numCoreNodes = coreSize;
+
+    std::size_t frontierBegin = 0;
+    for (unsigned hop = 0; hop < m_config.haloHops && frontierBegin < chunk.nodes.size(); ++hop) {
+      const auto frontierEnd = chunk.nodes.size();
+      for (auto i = frontierBegin; i < frontierEnd; ++i) {
+        forEachNeighbour(chunk.nodes[i], [&](std::uint32_t neighbour, std::uint32_t) {
+          if (m_localIdx[neighbour] < 0) {
+            addNode(chunk, neighbour);
+          }
+        });
+      }
+      frontierBegin = frontierEnd;
+    }
+
+    // Visit every edge only from its source node
+    for (const auto node : chunk.nodes) {
+      forEachNeighbour(node, [&](std::uint32_t neighbour, std::uint32_t edge) {
+        if (m_source[edge] == node && m_localIdx[neighbour] >= 0) {
+          chunk.edges.push_back(edge);
+        }
+      });
+    }
+    const auto numEdges = chunk.edges.size();
+    chunk.edgeIndex.resize(2 * numEdges);
+    for (std::size_t i = 0; i < numEdges; ++i) {
+      chunk.edgeIndex[i] = m_localIdx[m_source[chunk.edges[i]]];
+      chunk.edgeIndex[numEdges + i] = m_localIdx[m_target[chunk.edges[i]]];
+    }
+    chunk.estimatedBytes = m_config.estimateBytes(chunk.nodes.size(), numEdges);
+
+    for (const auto node : chunk.nodes) {
+      m_localIdx[node] = -1;
+    }
+  }
+
+  EdgeChunkingConfig m_config;
+  std::size_t m_numNodes;
+  std::size_t m_numEdges;
+  std::span<const std::int64_t> m_source;
+  std::span<const std::int64_t> m_target;
+  std::vector<std::size_t> m_adjOffsets{};
+  std::vector<std::uint32_t> m_adjEdges{};
+  std::vector<std::uint32_t> m_order{};
+  /// The index of each node in the current chunk (-1 if not in it)
+  std::vector<std::int64_t> m_localIdx;
+  /// The position of the next core node in the order
+  std::size_t m_position{0};
+  std::size_t m_coreSize{1};
+};
+
+} // namespace mlutils
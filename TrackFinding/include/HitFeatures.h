@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/// The per hit features that can be used as inputs for the models
+enum class HitFeature { X, Y, Z, R, Phi, Time };
+
+/**
+ * @brief Convert a string (x, y, z, r, phi, time) into a HitFeature
+ *
+ * @throws std::invalid_argument if the string is not a valid feature name
+ */
+inline HitFeature toHitFeature(std::string_view name) {
+  if (name == "x") {
+    return HitFeature::X;
+  }
+  if (name == "y") {
+    return HitFeature::Y;
+  }
+  if (name == "z") {
+    return HitFeature::Z;
+  }
+  if (name == "r") {
+    return HitFeature::R;
+  }
+  if (name == "phi") {
+    return HitFeature::Phi;
+  }
+  if (name == "time") {
+    return HitFeature::Time;
+  }
+  throw std::invalid_argument("Invalid hit feature '" + std::string(name) + "' (valid values: x, y, z, r, phi, time)");
+}
+
+/**
+ * @brief Structure-of-arrays storage for the raw hit information
+ *
+ * Keeping the coordinates in separate contiguous arrays allows the feature
+ * computations to be vectorized by the compiler.
+ */
+struct HitArrays {
+  std::vector<float> x{};
+  std::vector<float> y{};
+  std::vector<float> z{};
+  std::vector<float> time{};
+
+  std::size_t size() const { return x.size(); }
+
+  void reserve(std::size_t n) {
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+    time.reserve(n);
+  }
+
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    time.clear();
+  }
+
+  void push_back(float xVal, float yVal, float zVal, float tVal) {
+    x.push_back(xVal);
+    y.push_back(yVal);
+    z.push_back(zVal);
+    time.push_back(tVal);
+  }
+};
+
+/**
+ * @brief Generate the hits of straight tracks from the origin that cross a few
+ * barrel layers
+ *
+ * This is only meant to provide events with a realistic number of hits (e.g.
+ * for warming up or benchmarking) if no real event is at hand, the physics
+ * content is irrelevant.
+ */
+inline HitArrays generateSyntheticHits(std::size_t numHits, unsigned seed) {
+  constexpr std::array layerRadii = {39.f, 51.f, 74.f, 102.f, 127.f, 340.f, 554.f, 819.f, 1153.f, 1486.f};
+  std::mt19937 rng{seed};
+  std::uniform_real_distribution<float> phiDist{-std::numbers::pi_v<float>, std::numbers::pi_v<float>};
+  std::uniform_real_distribution<float> etaDist{-1.5f, 1.5f};
+  std::normal_distribution<float> smear{0.f, 0.05f};
+
+  HitArrays hits{};
+  hits.reserve(numHits);
+  while (hits.size() < numHits) {
+    const auto phi = phiDist(rng);
+    const auto eta = etaDist(rng);
+    for (const auto r : layerRadii) {
+      if (hits.size() == numHits) {
+        break;
+      }
+      // Time of flight of a massless particle (in ns)
+      hits.push_back(r * std::cos(phi) + smear(rng), r * std::sin(phi) + smear(rng), r * std::sinh(eta),
+                     r * std::cosh(eta) / 299.792458f);
+    }
+  }
+  return hits;
+}
+
+namespace detail {
+  /**
+   * @brief Branch-free approximation of std::atan2 for floats
+   *
+   * The argument is reduced to [0, 1] where a minimax polynomial is used. The
+   * octant is restored via selects of constants and copysign only, so that
+   * loops calling this can be auto-vectorized. The absolute error w.r.t.
+   * std::atan2 is below 4e-7 (i.e. roughly one ulp at pi) and the signed zero
+   * conventions of std::atan2 are respected.
+   */
+  inline float fastAtan2(float y, float x) {
+    constexpr float pi = 3.14159265f;
+    constexpr float halfPi = 1.57079633f;
+
+    const float ax = std::abs(x);
+    const float ay = std::abs(y);
+    // Avoid the division by zero without introducing a branch for x = y = 0
+    const float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+    const float a2 = a * a;
+
+    float p = -0.004054559f;
+    p = p * a2 + 0.02186293f;
+    p = p * a2 - 0.05591229f;
+    p = p * a2 + 0.09642195f;
+    p = p * a2 - 0.13908629f;
+    p = p * a2 + 0.19946566f;
+    p = p * a2 - 0.33329859f;
+    p = p * a2 + 0.99999934f;
+
+    float res = a * p;
+    res = (ay > ax ? halfPi : 0.f) + std::copysign(res, ax - ay);
+    res = (std::signbit(x) ? pi : 0.f) + std::copysign(res, x);
+    return std::copysign(res, y);
+  }
+} // namespace detail
+
+/**
+ * @brief Compute the transverse radius and the azimuthal angle for all points
+ *
+ * @note In order for this to vectorize the translation unit needs to be
+ * compiled with -fno-math-errno, as otherwise the compiler has to assume that
+ * std::sqrt sets errno.
+ */
+inline void computeRPhi(std::span<const float> x, std::span<const float> y, std::span<float> r,
+                        std::span<float> phi) {
+  assert(x.size() == y.size() && r.size() >= x.size() && phi.size() >= x.size());
+  const auto n = x.size();
+  const float* __restrict xPtr = x.data();
+  const float* __restrict yPtr = y.data();
+  float* __restrict rPtr = r.data();
+  float* __restrict phiPtr = phi.data();
+
+  for (std::size_t i = 0; i < n; ++i) {
+    rPtr[i] = std::sqrt(xPtr[i] * xPtr[i] + yPtr[i] * yPtr[i]);
+    phiPtr[i] = detail::fastAtan2(yPtr[i], xPtr[i]);
+  }
+}
+
+namespace detail {
+  /// The number of hits for which r and phi are computed at once
+  inline constexpr std::size_t FeatureBlockSize = 256;
+
+  /// The values of a feature for the hits of a block starting at start
+  template <HitFeature Feature>
+  const float* featureColumn(const HitArrays& hits, std::size_t start, const float* rBlock, const float* phiBlock) {
+    if constexpr (Feature == HitFeature::X) {
+      return hits.x.data() + start;
+    } else if constexpr (Feature == HitFeature::Y) {
+      return hits.y.data() + start;
+    } else if constexpr (Feature == HitFeature::Z) {
+      return hits.z.data() + start;
+    } else if constexpr (Feature == HitFeature::R) {
+      return rBlock;
+    } else if constexpr (Feature == HitFeature::Phi) {
+      return phiBlock;
+    } else {
+      return hits.time.data() + start;
+    }
+  }
+} // namespace detail
+
+/**
+ * @brief A layout of the node features that is fixed at compile time
+ *
+ * As the number of features and their order are known, all features of a hit
+ * are written with a fixed stride and without dispatching on the feature, so
+ * that the compiler can unroll and vectorize the loop over the hits.
+ */
+template <HitFeature... Features>
+struct HitFeatureLayout {
+  static constexpr std::size_t numFeatures = sizeof...(Features);
+  static constexpr std::array<HitFeature, numFeatures> features = {Features...};
+  static constexpr bool needsRPhi = ((Features == HitFeature::R || Features == HitFeature::Phi) || ...);
+
+  static bool matches(std::span<const HitFeature> other) { return std::ranges::equal(features, other); }
+
+  /**
+   * @brief Write the features of all hits into output
+   *
+   * @param invScales The inverse scale of each feature
+   * @param output    Row-major [hits.size(), numFeatures] buffer
+   */
+  static void extract(const HitArrays& hits, std::span<const float> invScales, std::span<float> output) {
+    assert(invScales.size() == numFeatures && output.size() == hits.size() * numFeatures);
+    extractBlocks(hits, invScales, output, std::make_index_sequence<numFeatures>{});
+  }
+
+private:
+  template <std::size_t... I>
+  static void extractBlocks(const HitArrays& hits, std::span<const float> invScales, std::span<float> output,
+                            std::index_sequence<I...>) {
+    constexpr auto BlockSize = detail::FeatureBlockSize;
+    const std::array<float, numFeatures> invScale = {invScales[I]...};
+    const auto nHits = hits.size();
+
+    std::array<float, BlockSize> rBlock;
+    std::array<float, BlockSize> phiBlock;
+    for (std::size_t start = 0; start < nHits; start += BlockSize) {
+      const auto n = std::min(BlockSize, nHits - start);
+      if constexpr (needsRPhi) {
+        computeRPhi(std::span(hits.x).subspan(start, n), std::span(hits.y).subspan(start, n), rBlock, phiBlock);
+      }
+
+      const std::array<const float*, numFeatures> src = {
+          detail::featureColumn<Features>(hits, start, rBlock.data(), phiBlock.data())...};
+      float* __restrict dst = output.data() + start * numFeatures;
+      for (std::size_t i = 0; i < n; ++i) {
+        ((dst[i * numFeatures + I] = src[I][i] * invScale[I]), ...);
+      }
+    }
+  }
+};
+
+/// The layouts for which HitFeatureExtractor uses a compiled kernel. All other
+/// layouts are extracted feature by feature
+using CompiledHitFeatureLayouts =
+    std::tuple<HitFeatureLayout<HitFeature::R, HitFeature::Phi, HitFeature::Z, HitFeature::Time>,
+               HitFeatureLayout<HitFeature::R, HitFeature::Phi, HitFeature::Z>,
+               HitFeatureLayout<HitFeature::X, HitFeature::Y, HitFeature::Z, HitFeature::Time>,
+               HitFeatureLayout<HitFeature::X, HitFeature::Y, HitFeature::Z>>;
+
+namespace detail {
+  using FeatureKernel = void (*)(const HitArrays&, std::span<const float>, std::span<float>);
+
+  /// The kernel of the compiled layout with the given features (nullptr if
+  /// there is none)
+  inline FeatureKernel compiledFeatureKernel(std::span<const HitFeature> features) {
+    FeatureKernel kernel = nullptr;
+    [&]<typename... Layouts>(std::type_identity<std::tuple<Layouts...>>) {
+      (void)((Layouts::matches(features) && (kernel = &Layouts::extract, true)) || ...);
+    }(std::type_identity<CompiledHitFeatureLayouts>{});
+    return kernel;
+  }
+} // namespace detail
+
+/// Configuration of the node features that are passed to the models
+struct HitFeatureConfig {
+  /// The features (and their order) for each hit
+  std::vector<HitFeature> features{HitFeature::R, HitFeature::Phi, HitFeature::Z, HitFeature::Time};
+  /// Factors by which the features are divided. Either empty (no scaling) or
+  /// one per feature
+  std::vector<float> scales{};
+};
+
+/**
+ * @brief Fill the row-major node feature matrix for the models from hits
+ *
+ * r and phi are computed in fixed size blocks on the stack via computeRPhi and
+ * then scattered into the output, so that no intermediate allocations are
+ * necessary and the extraction can run concurrently for several events. If
+ * the features match one of the CompiledHitFeatureLayouts its kernel is used,
+ * otherwise the features are written one column at a time.
+ */
+class HitFeatureExtractor {
+public:
+  HitFeatureExtractor() : HitFeatureExtractor(HitFeatureConfig{}) {}
+
+  /**
+   * @brief Create an extractor for the given configuration
+   *
+   * @throws std::invalid_argument if there are no features, or if the number
+   * of scales does not match the number of features
+   */
+  explicit HitFeatureExtractor(HitFeatureConfig config) : m_config(std::move(config)) {
+    if (m_config.features.empty()) {
+      throw std::invalid_argument("At least one hit feature is necessary");
+    }
+    if (!m_config.scales.empty() && m_config.scales.size() != m_config.features.size()) {
+      throw std::invalid_argument("Got " + std::to_string(m_config.scales.size()) + " hit feature scales for " +
+                                  std::to_string(m_config.features.size()) + " features");
+    }
+    if (m_config.scales.empty()) {
+      m_config.scales.assign(m_config.features.size(), 1.f);
+    }
+    m_invScales.reserve(m_config.scales.size());
+    for (const auto scale : m_config.scales) {
+      m_invScales.push_back(1.f / scale);
+    }
+    m_needsRPhi = std::ranges::any_of(m_config.features,
+                                      [](const auto f) { return f == HitFeature::R || f == HitFeature::Phi; });
+    m_kernel = detail::compiledFeatureKernel(m_config.features);
+  }
+
+  const HitFeatureConfig& config() const { return m_config; }
+
+  /// The number of features per hit, i.e. the number of columns of the output
+  std::size_t numFeatures() const { return m_config.features.size(); }
+
+  /// Whether the features are extracted by the kernel of a compiled layout
+  bool usesCompiledLayout() const { return m_kernel != nullptr; }
+
+  /**
+   * @brief Write the features of all hits into output
+   *
+   * @param hits   The raw hit information
+   * @param output Row-major [hits.size(), numFeatures()] buffer
+   */
+  void extract(const HitArrays& hits, std::span<float> output) const {
+    const auto nHits = hits.size();
+    const auto nFeatures = numFeatures();
+    assert(output.size() == nHits * nFeatures);
+    if (m_kernel) {
+      m_kernel(hits, m_invScales, output);
+      return;
+    }
+
+    std::array<float, BlockSize> rBlock;
+    std::array<float, BlockSize> phiBlock;
+    for (std::size_t start = 0; start < nHits; start += BlockSize) {
+      const auto n = std::min(BlockSize, nHits - start);
+      if (m_needsRPhi) {
+        computeRPhi(std::span(hits.x).subspan(start, n), std::span(hits.y).subspan(start, n), rBlock, phiBlock);
+      }
+
+      for (std::size_t iFeat = 0; iFeat < nFeatures; ++iFeat) {
+        const float* src = column(hits, m_config.features[iFeat], start, rBlock.data(), phiBlock.data());
+        const auto invScale = m_invScales[iFeat];
+        float* dst = output.data() + start * nFeatures + iFeat;
+        for (std::size_t i = 0; i < n; ++i) {
+          dst[i * nFeatures] = src[i] * invScale;
+        }
+      }
+    }
+  }
+
+  /// Convenience overload returning a new buffer of the appropriate size
+  std::vector<float> extract(const HitArrays& hits) const {
+    std::vector<float> output(hits.size() * numFeatures());
+    extract(hits, output);
+    return output;
+  }
+
+private:
+  static constexpr std::size_t BlockSize = detail::FeatureBlockSize;
+
+  static const float* column(const HitArrays& hits, HitFeature feature, std::size_t start, const float* rBlock,
+                             const float* phiBlock) {
+    switch (feature) {
+    case HitFeature::X:
+      return hits.x.data() + start;
+    case HitFeature::Y:
+      return hits.y.data() + start;
+    case HitFeature::Z:
+      return hits.z.data() + start;
+    case HitFeature::R:
+      return rBlock;
+    case HitFeature::Phi:
+      return phiBlock;
+    case HitFeature::Time:
+      return hits.time.data() + start;
+    }
+    return nullptr;
+  }
+
+  HitFeatureConfig m_config;
+  std::vector<float> m_invScales{};
+  bool m_needsRPhi{true};
+  detail::FeatureKernel m_kernel{nullptr};
+};
+
+} // namespace mlutils
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "HitFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/// Cuts on the time and the radial position of hits. The default cuts keep
+/// all hits
+struct HitCuts {
+  float timeMin{std::numeric_limits<float>::lowest()};
+  float timeMax{std::numeric_limits<float>::max()};
+  float rMin{0.f};
+  float rMax{std::numeric_limits<float>::max()};
+
+  bool operator==(const HitCuts&) const = default;
+
+  bool keepsAll() const { return *this == HitCuts{}; }
+
+  /// The cuts that only keep the hits that pass both
+  HitCuts intersect(const HitCuts& other) const {
+    return {std::max(timeMin, other.timeMin), std::min(timeMax, other.timeMax), std::max(rMin, other.rMin),
+            std::min(rMax, other.rMax)};
+  }
+
+  /// @throws std::invalid_argument for an invalid configuration
+  void validate() const {
+    if (!(timeMin <= timeMax) || !(rMin <= rMax) || rMin < 0.f) {
+      throw std::invalid_argument("Invalid hit cuts: the lower bounds must not exceed the upper ones and the radius "
+                                  "cannot be negative");
+    }
+  }
+};
+
+/**
+ * @brief Configuration for the selection of the hits that enter the graph
+ * construction
+ *
+ * Hits that fail the cuts are removed before the feature extraction. Hits that
+ * are closer than mergeDistance to a selected hit of the same collection are
+ * merged into it, e.g. the two hits that a track leaves on a double layer.
+ * They do not enter the graph either, but end up on the same track as the hit
+ * they have been merged into.
+ */
+struct HitFilterConfig {
+  HitCuts cuts{};
+  /// Additional cuts for the hits of each input collection (empty: none)
+  std::vector<HitCuts> collectionCuts{};
+  /// Maximum distance (in mm) of merged hits (0: no merging)
+  float mergeDistance{0.f};
+  /// The collections in which hits are merged (empty: all)
+  std::vector<std::size_t> mergeCollections{};
+
+  bool enabled() const {
+    return !cuts.keepsAll() || mergeDistance > 0.f ||
+           std::ranges::any_of(collectionCuts, [](const auto& coll) { return !coll.keepsAll(); });
+  }
+
+  bool merges(std::size_t collection) const {
+    return mergeDistance > 0.f && (mergeCollections.empty() || std::ranges::find(mergeCollections, collection) !=
+                                                                   mergeCollections.end());
+  }
+
+  /// @throws std::invalid_argument for an invalid configuration
+  void validate() const {
+    cuts.validate();
+    for (const auto& coll : collectionCuts) {
+      coll.validate();
+    }
+    if (mergeDistance < 0.f) {
+      throw std::invalid_argument("The merge distance cannot be negative");
+    }
+  }
+
+  /// Check that the per collection settings fit the number of input
+  /// collections
+  /// @throws std::invalid_argument if they do not
+  void validate(std::size_t numCollections) const {
+    validate();
+    if (!collectionCuts.empty() && collectionCuts.size() != numCollections) {
+      throw std::invalid_argument("Got hit cuts for " + std::to_string(collectionCuts.size()) + " collections, but " +
+                                  std::to_string(numCollections) + " input collections");
+    }
+    for (const auto collection : mergeCollections) {
+      if (collection >= numCollections) {
+        throw std::invalid_argument("Cannot merge the hits of collection " + std::to_string(collection) +
+                                    ", as there are only " + std::to_string(numCollections) + " input collections");
+      }
+    }
+  }
+};
+
+/**
+ * @brief The hits that pass a HitFilterConfig
+ *
+ * The storage is kept when selecting again, such that a selection can be
+ * re-used across events.
+ */
+struct HitSelection {
+  /// The indices of the selected hits in all hits, in ascending order
+  std::vector<std::uint32_t> hits{};
+  /// The positions and times of the selected hits
+  HitArrays hitArrays{};
+  /// The merged hits as (merged hit, selected hit it has been merged into),
+  /// sorted by the selected hit
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> merged{};
+
+  std::size_t size() const { return hits.size(); }
+
+  // Working memory
+  std::vector<std::uint8_t> pass{};
+  std::vector<std::uint32_t> order{};
+  std::vector<std::uint32_t> window{};
+};
+
+namespace detail {
+  /// Flag the hits in [begin, end) that pass the cuts. Written without
+  /// branches, such that the compiler can vectorize it
+  inline void applyCuts(const HitArrays& hits, std::size_t begin, std::size_t end, const HitCuts& cuts,
+                        std::span<std::uint8_t> pass) {
+    // Squaring the maximum float overflows to infinity, which still compares
+    // correctly
+    const float r2Min = cuts.rMin * cuts.rMin;
+    const float r2Max = cuts.rMax * cuts.rMax;
+    const float* x = hits.x.data();
+    const float* y = hits.y.data();
+    const float* time = hits.time.data();
+    for (std::size_t i = begin; i < end; ++i) {
+      const float r2 = x[i] * x[i] + y[i] * y[i];
+      pass[i] = (time[i] >= cuts.timeMin) & (time[i] <= cuts.timeMax) & (r2 >= r2Min) & (r2 <= r2Max);
+    }
+  }
+
+  /// Merge the passing hits in [begin, end) that are within the merge
+  /// distance of an earlier passing hit (in z) into that hit
+  inline void mergeHits(const HitArrays& hits, std::size_t begin, std::size_t end, float mergeDistance,
+                        HitSelection& selection) {
+    auto& order = selection.order;
+    order.clear();
+    for (auto i = begin; i < end; ++i) {
+      if (selection.pass[i]) {
+        order.push_back(static_cast<std::uint32_t>(i));
+      }
+    }
+    std::ranges::stable_sort(order, {}, [&](std::uint32_t i) { return hits.z[i]; });
+
+    // The kept hits that are close enough in z to the current hit
+    auto& window = selection.window;
+    window.clear();
+    std::size_t windowBegin = 0;
+    const auto maxDist2 = mergeDistance * mergeDistance;
+    for (const auto i : order) {
+      while (windowBegin < window.size() && hits.z[window[windowBegin]] < hits.z[i] - mergeDistance) {
+        ++windowBegin;
+      }
+      const auto it = std::find_if(window.begin() + windowBegin, window.end(), [&](std::uint32_t kept) {
+        const auto dx = hits.x[i] - hits.x[kept];
+        const auto dy = hits.y[i] - hits.y[kept];
+        const auto dz = hits.z[i] - hits.z[kept];
+        return dx * dx + dy * dy + dz * dz <= maxDist2;
+      });
+      if (it != window.end()) {
+        selection.pass[i] = 0;
+        selection.merged.emplace_back(i, *it);
+      } else {
+        window.push_back(i);
+      }
+    }
+  }
+} // namespace detail
+
+/**
+ * @brief Select the hits that enter the graph construction
+ *
+ * @param hits            The positions and times of all hits
+ * @param collectionSizes The number of hits of each input collection, in the
+ *                        order in which they are in hits
+ *
+ * @throws std::invalid_argument if the collection sizes do not add up to the
+ * number of hits or if there are per collection cuts for a different number of
+ * collections
+ */
+inline void selectHits(const HitArrays& hits, std::span<const std::size_t> collectionSizes,
+                       const HitFilterConfig& config, HitSelection& selection) {
+  const auto numHits = hits.size();
+  if (std::accumulate(collectionSizes.begin(), collectionSizes.end(), std::size_t{0}) != numHits) {
+    throw std::invalid_argument("The collection sizes do not match the number of hits");
+  }
+  if (!config.collectionCuts.empty() && config.collectionCuts.size() != collectionSizes.size()) {
+    throw std::invalid_argument("Got hit cuts for " + std::to_string(config.collectionCuts.size()) +
+                                " collections, but " + std::to_string(collectionSizes.size()) + " input collections");
+  }
+
+  selection.pass.resize(numHits);
+  selection.merged.clear();
+  std::size_t begin = 0;
+  for (std::size_t iColl = 0; iColl < collectionSizes.size(); ++iColl) {
+    const auto end = begin + collectionSizes[iColl];
+    const auto cuts = config.collectionCuts.empty() ? config.cuts : config.cuts.intersect(config.collectionCuts[iColl]);
+    detail::applyCuts(hits, begin, end, cuts, selection.pass);
+    if (config.merges(iColl)) {
+      detail::mergeHits(hits, begin, end, config.mergeDistance, selection);
+    }
+    begin = end;
+  }
+  std::ranges::sort(selection.merged, {}, [](const auto& merged) { return std::pair(merged.second, merged.first); });
+
+  selection.hits.clear();
+  selection.hitArrays.clear();
+  for (std::size_t i = 0; i < numHits; ++i) {
+    if (selection.pass[i]) {
+      selection.hits.push_back(static_cast<std::uint32_t>(i));
+      selection.hitArrays.push_back(hits.x[i], hits.y[i], hits.z[i], hits.time[i]);
+    }
+  }
+}
+
+/**
+ * @brief Add the merged hits to the track candidates that contain the hit they
+ * have been merged into
+ *
+ * The candidates have to be given in terms of the indices of all hits, i.e.
+ * the indices of the selected hits have to be used as space point ids in the
+ * track building.
+ */
+template <typename IdType>
+void addMergedHits(const HitSelection& selection, std::vector<std::vector<IdType>>& candidates) {
+  if (selection.merged.empty()) {
+    return;
+  }
+  for (auto& candidate : candidates) {
+    const auto numSelected = candidate.size();
+    for (std::size_t i = 0; i < numSelected; ++i) {
+      const auto hit = static_cast<std::uint32_t>(candidate[i]);
+      auto it = std::ranges::lower_bound(selection.merged, hit, {}, [](const auto& merged) { return merged.second; });
+      for (; it != selection.merged.end() && it->second == hit; ++it) {
+        candidate.push_back(static_cast<IdType>(it->first));
+      }
+    }
+  }
+}
+
+} // namespace mlutils
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "HitFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace mlutils {
+
+/// Configuration for splitting an event into overlapping phi sectors and eta
+/// regions
+struct SectorConfig {
+  unsigned phiSectors{1};
+  /// Hits within this distance (in phi) of a sector are also put into it
+  float phiOverlap{0.f};
+  /// The eta regions are evenly spaced between the smallest and largest eta
+  /// of the hits of an event
+  unsigned etaRegions{1};
+  /// Hits within this distance (in eta) of a region are also put into it
+  float etaOverlap{0.f};
+
+  unsigned numSectors() const { return phiSectors * etaRegions; }
+  bool enabled() const { return numSectors() > 1; }
+
+  /// @throws std::invalid_argument for an invalid configuration
+  void validate() const {
+    if (phiSectors == 0 || etaRegions == 0) {
+      throw std::invalid_argument("The number of phi sectors and eta regions has to be at least 1");
+    }
+    if (phiOverlap < 0.f || etaOverlap < 0.f) {
+      throw std::invalid_argument("The phi and eta overlaps cannot be negative");
+    }
+  }
+};
+
+/**
+ * @brief Assignment of hits to (possibly overlapping) sectors
+ *
+ * The hit indices are stored per sector in ascending order. Hits in the
+ * overlap regions appear in more than one sector.
+ */
+struct HitPartition {
+  /// Start of each sector in hits (size: numSectors + 1)
+  std::vector<std::uint32_t> offsets{0};
+  std::vector<std::uint32_t> hits{};
+
+  std::size_t numSectors() const { return offsets.size() - 1; }
+  std::span<const std::uint32_t> sector(std::size_t iSector) const {
+    return std::span(hits).subspan(offsets[iSector], offsets[iSector + 1] - offsets[iSector]);
+  }
+};
+
+/// Compute the pseudo-rapidity and the azimuthal angle of all hits
+inline void computeEtaPhi(const HitArrays& hits, std::vector<float>& eta, std::vector<float>& phi) {
+  eta.resize(hits.size());
+  phi.resize(hits.size());
+  // Use eta as temporary storage for r
+  computeRPhi(hits.x, hits.y, eta, phi);
+  for (std::size_t i = 0; i < hits.size(); ++i) {
+    eta[i] = std::asinh(hits.z[i] / eta[i]);
+  }
+}
+
+namespace detail {
+  /// Call func(bin) for all bins of a (possibly periodic) axis that the value
+  /// falls into, when the bins are extended by overlap on both sides
+  template <typename Func>
+  void forEachOverlappingBin(float value, float lower, float width, unsigned nBins, float overlap, bool periodic,
+                             Func&& func) {
+    if (nBins == 1 || !(width > 0.f)) {
+      func(0u);
+      return;
+    }
+    const auto n = static_cast<int>(nBins);
+    const auto home = std::clamp(static_cast<int>(std::floor((value - lower) / width)), 0, n - 1);
+    const auto reach = static_cast<int>(std::min(std::ceil(overlap / width), static_cast<float>(n)));
+    auto first = home - reach;
+    auto last = home + reach;
+    if (periodic && 2 * reach + 1 >= n) {
+      // Visit every bin only once
+      first = 0;
+      last = n - 1;
+    }
+
+    const auto period = width * n;
+    for (auto b = first; b <= last; ++b) {
+      auto bin = b;
+      if (periodic) {
+        bin = ((b % n) + n) % n;
+      } else if (b < 0 || b >= n) {
+        continue;
+      }
+      auto distance = std::abs(value - (lower + (bin + 0.5f) * width));
+      if (periodic) {
+        distance = std::min(distance, period - distance);
+      }
+      if (bin == home || distance <= 0.5f * width + overlap) {
+        func(static_cast<unsigned>(bin));
+      }
+    }
+  }
+} // namespace detail
+
+/**
+ * @brief Split hits into overlapping phi sectors and eta regions
+ *
+ * Sector i * etaRegions + j contains the hits of phi sector i and eta region
+ * j. The partition is re-used, such that its storage can be kept across
+ * events.
+ */
+inline void partitionHits(std::span<const float> eta, std::span<const float> phi, const SectorConfig& config,
+                          HitPartition& partition) {
+  const auto nHits = phi.size();
+  const auto nSectors = config.numSectors();
+
+  float etaMin = std::numeric_limits<float>::max();
+  float etaMax = std::numeric_limits<float>::lowest();
+  for (const auto value : eta) {
+    if (std::isfinite(value)) {
+      etaMin = std::min(etaMin, value);
+      etaMax = std::max(etaMax, value);
+    }
+  }
+  if (etaMin > etaMax) {
+    etaMin = etaMax = 0.f;
+  }
+  const float etaWidth = (etaMax - etaMin) / config.etaRegions;
+  const float phiWidth = 2 * std::numbers::pi_v<float> / config.phiSectors;
+
+  auto forEachSector = [&](std::size_t iHit, auto&& func) {
+    const auto hitEta = std::isnan(eta[iHit]) ? etaMin : std::clamp(eta[iHit], etaMin, etaMax);
+    detail::forEachOverlappingBin(
+        phi[iHit], -std::numbers::pi_v<float>, phiWidth, config.phiSectors, config.phiOverlap, true,
+        [&](unsigned iPhi) {
+          detail::forEachOverlappingBin(hitEta, etaMin, etaWidth, config.etaRegions, config.etaOverlap, false,
+                                        [&](unsigned iEta) { func(iPhi * config.etaRegions + iEta); });
+        });
+  };
+
+  // Counting sort of the hits into the sectors, which keeps the hits in each
+  // sector in ascending order
+  partition.offsets.assign(nSectors + 1, 0);
+  for (std::size_t i = 0; i < nHits; ++i) {
+    forEachSector(i, [&](unsigned iSector) { ++partition.offsets[iSector + 1]; });
+  }
+  for (std::size_t s = 0; s < nSectors; ++s) {
+    partition.offsets[s + 1] += partition.offsets[s];
+  }
+  partition.hits.resize(partition.offsets.back());
+  std::vector<std::uint32_t> fillPos(partition.offsets.begin(), partition.offsets.end() - 1);
+  for (std::size_t i = 0; i < nHits; ++i) {
+    forEachSector(i, [&](unsigned iSector) { partition.hits[fillPos[iSector]++] = static_cast<std::uint32_t>(i); });
+  }
+}
+
+} // namespace mlutils
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "ObjectPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/// Configuration of how requests are combined into batches
+struct BatchingConfig {
+  /// Maximum number of rows (e.g. hits) in a batch. Larger requests are run
+  /// on their own
+  std::size_t maxBatchRows{500000};
+  /// A batch is run as soon as it contains this many requests (e.g. the number
+  /// of concurrently processed events). 0: no limit
+  std::size_t maxBatchRequests{0};
+  /// How long the first request of a batch waits for others to join
+  std::chrono::microseconds maxWaitTime{1000};
+};
+
+/// Counters of the batches that have been run
+struct BatchingStats {
+  std::size_t numBatches{0};
+  std::size_t numRequests{0};
+  std::size_t numRows{0};
+};
+
+/**
+ * @brief Combine concurrent inference requests of a row-wise model into
+ * batches
+ *
+ * For models that treat every row independently (e.g. a per hit MLP), the
+ * inputs of requests from several threads (e.g. events) can be concatenated
+ * along the row axis and run in one call, which makes better use of the
+ * model. The first request of a batch becomes its leader and waits until the
+ * batch is full or the maximum wait time has passed. It then runs the batch on
+ * its own thread and scatters the results back, while the other requests of
+ * the batch wait for that. No additional threads are used.
+ *
+ * Only requests with the same input and output row widths are combined.
+ */
+class InferenceBatcher {
+public:
+  /// Run the model on [numRows, inputWidth] input, filling the
+  /// [numRows, outputWidth] output. Has to be safe to call concurrently
+  using BatchFunc = std::function<void(std::span<const float> input, std::size_t numRows, std::span<float> output)>;
+
+  explicit InferenceBatcher(BatchFunc func, BatchingConfig config = {})
+      : m_func(std::move(func)), m_config(config),
+        m_storage([]() { return std::make_unique<BatchStorage>(); }) {}
+
+  InferenceBatcher(const InferenceBatcher&) = delete;
+  InferenceBatcher& operator=(const InferenceBatcher&) = delete;
+  InferenceBatcher(InferenceBatcher&&) = delete;
+  InferenceBatcher& operator=(InferenceBatcher&&) = delete;
+  ~InferenceBatcher() = default;
+
+  const BatchingConfig& config() const { return m_config; }
+
+  /**
+   * @brief Run the model on the input, possibly together with other requests
+   *
+   * Blocks until the results have been written to output. Exceptions from the
+   * model are re-thrown in all requests of the affected batch.
+   *
+   * @param input   Row-major [numRows, inputWidth] input
+   * @param numRows The number of rows
+   * @param output  Row-major [numRows, outputWidth] output
+   */
+  void run(std::span<const float> input, std::size_t numRows, std::span<float> output);
+
+  BatchingStats stats() const {
+    return {m_numBatches.load(std::memory_order_relaxed), m_numRequests.load(std::memory_order_relaxed),
+            m_numRows.load(std::memory_order_relaxed)};
+  }
+
+private:
+  struct Request {
+    std::span<const float> input;
+    std::size_t numRows;
+    std::span<float> output;
+  };
+
+  struct Batch {
+    std::vector<Request> requests{};
+    std::size_t numRows{0};
+    std::size_t inputWidth{0};
+    std::size_t outputWidth{0};
+    // Guarded by m_mutex. The error is set by the leader before done
+    bool closed{false};
+    bool done{false};
+    std::exception_ptr error{nullptr};
+  };
+
+  /// Concatenated inputs and outputs of a batch
+  struct BatchStorage {
+    std::vector<float> input{};
+    std::vector<float> output{};
+  };
+
+  bool accepts(const Batch& batch, const Request& request) const {
+    return request.input.size() / request.numRows == batch.inputWidth &&
+           request.output.size() / request.numRows == batch.outputWidth &&
+           batch.numRows + request.numRows <= m_config.maxBatchRows;
+  }
+
+  bool isFull(const Batch& batch) const {
+    return batch.numRows >= m_config.maxBatchRows ||
+           (m_config.maxBatchRequests > 0 && batch.requests.size() >= m_config.maxBatchRequests);
+  }
+
+  /// Stop accepting requests for a batch (m_mutex has to be held)
+  void close(const std::shared_ptr<Batch>& batch) {
+    batch->closed = true;
+    if (m_openBatch == batch) {
+      m_openBatch.reset();
+    }
+  }
+
+  void execute(const Batch& batch);
+
+  void record(std::size_t numRequests, std::size_t numRows) {
+    m_numBatches.fetch_add(1, std::memory_order_relaxed);
+    m_numRequests.fetch_add(numRequests, std::memory_order_relaxed);
+    m_numRows.fetch_add(numRows, std::memory_order_relaxed);
+  }
+
+  BatchFunc m_func;
+  BatchingConfig m_config;
+  ObjectPool<BatchStorage> m_storage;
+
+  std::mutex m_mutex{};
+  std::condition_variable m_cv{};
+  std::shared_ptr<Batch> m_openBatch{nullptr};
+
+  std::atomic<std::size_t> m_numBatches{0};
+  std::atomic<std::size_t> m_numRequests{0};
+  std::atomic<std::size_t> m_numRows{0};
+};
+
+inline void InferenceBatcher::run(std::span<const float> input, std::size_t numRows, std::span<float> output) {
+  if (numRows == 0) {
+    return;
+  }
+  assert(input.size() % numRows == 0 && output.size() % numRows == 0);
+  const Request request{input, numRows, output};
+
+  if (numRows >= m_config.maxBatchRows || m_config.maxBatchRequests == 1) {
+    // Nothing to combine this with
+    record(1, numRows);
+    m_func(input, numRows, output);
+    return;
+  }
+
+  std::unique_lock lock{m_mutex};
+  if (m_openBatch && !accepts(*m_openBatch, request)) {
+    // Let the leader run the current batch right away, this one starts a new
+    // one instead
+    close(m_openBatch);
+    m_cv.notify_all();
+  }
+
+  auto batch = m_openBatch;
+  const bool isLeader = batch == nullptr;
+  if (isLeader) {
+    batch = m_openBatch = std::make_shared<Batch>();
+    batch->inputWidth = input.size() / numRows;
+    batch->outputWidth = output.size() / numRows;
+  }
+  batch->requests.push_back(request);
+  batch->numRows += numRows;
+  if (isFull(*batch)) {
+    close(batch);
+    m_cv.notify_all();
+  }
+
+  if (isLeader) {
+    m_cv.wait_for(lock, m_config.maxWaitTime, [&batch]() { return batch->closed; });
+    close(batch);
+    lock.unlock();
+
+    try {
+      execute(*batch);
+    } catch (...) {
+      batch->error = std::current_exception();
+    }
+
+    lock.lock();
+    batch->done = true;
+    m_cv.notify_all();
+  } else {
+    m_cv.wait(lock, [&batch]() { return batch->done; });
+  }
+
+  if (batch->error) {
+    std::rethrow_exception(batch->error);
+  }
+}
+
+inline void InferenceBatcher::execute(const Batch& batch) {
+  record(batch.requests.size(), batch.numRows);
+
+  if (batch.requests.size() == 1) {
+    const auto& request = batch.requests.front();
+    m_func(request.input, request.numRows, request.output);
+    return;
+  }
+
+  auto storage = m_storage.acquire();
+  auto& input = storage->input;
+  auto& output = storage->output;
+  input.clear();
+  for (const auto& request : batch.requests) {
+    input.insert(input.end(), request.input.begin(), request.input.end());
+  }
+  output.resize(batch.numRows * batch.outputWidth);
+
+  m_func(input, batch.numRows, output);
+
+  std::size_t offset = 0;
+  for (const auto& request : batch.requests) {
+    std::copy_n(output.begin() + offset, request.output.size(), request.output.begin());
+    offset += request.output.size();
+  }
+}
+
+} // namespace mlutils
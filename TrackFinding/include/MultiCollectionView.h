@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief A read-only view that presents several collections as one contiguous
+ * range of elements.
+ *
+ * Global indices run over the collections in the order in which they are
+ * passed, i.e. the elements of the first collection are [0, size(0)), followed
+ * by the ones of the second, etc. Elements are not copied; only the start
+ * offset of each collection is stored, so that an element can be located via
+ * a (cheap) binary search over the (few) collections.
+ *
+ * The view can be reset with new collections, re-using its internal storage.
+ *
+ * @note The collections have to outlive the view (or the next reset)
+ */
+template <typename CollT>
+class MultiCollectionView {
+public:
+  /// Position of an element in terms of collection index and index in that
+  /// collection
+  struct Location {
+    std::size_t collection;
+    std::size_t index;
+  };
+
+  MultiCollectionView() = default;
+  explicit MultiCollectionView(std::span<const CollT* const> collections) { reset(collections); }
+
+  /// Point the view to a new set of collections
+  void reset(std::span<const CollT* const> collections) {
+    m_collections.assign(collections.begin(), collections.end());
+    m_offsets.clear();
+    m_offsets.reserve(collections.size() + 1);
+    m_offsets.push_back(0);
+    for (const auto* coll : collections) {
+      m_offsets.push_back(m_offsets.back() + coll->size());
+    }
+  }
+
+  /// The total number of elements in all collections
+  std::size_t size() const { return m_offsets.empty() ? 0 : m_offsets.back(); }
+  bool empty() const { return size() == 0; }
+
+  std::size_t numCollections() const { return m_collections.size(); }
+  const CollT& collection(std::size_t iColl) const { return *m_collections[iColl]; }
+  /// The global index of the first element of a collection
+  std::size_t offset(std::size_t iColl) const { return m_offsets[iColl]; }
+
+  /// Get the location of the element with the given global index
+  Location locate(std::size_t globalIdx) const {
+    assert(globalIdx < size());
+    // The last collection that starts at or before globalIdx. Empty
+    // collections share their offset with the next one and are skipped this way
+    const auto it = std::ranges::upper_bound(m_offsets, globalIdx);
+    const auto iColl = static_cast<std::size_t>(std::distance(m_offsets.begin(), it)) - 1;
+    return {iColl, globalIdx - m_offsets[iColl]};
+  }
+
+  /// Access an element via its global index
+  decltype(auto) operator[](std::size_t globalIdx) const {
+    const auto [iColl, idx] = locate(globalIdx);
+    return (*m_collections[iColl])[idx];
+  }
+
+  /// Call func(globalIdx, element) for all elements, in order
+  template <typename Func>
+  void forEach(Func&& func) const {
+    std::size_t globalIdx = 0;
+    for (const auto* coll : m_collections) {
+      for (const auto& elem : *coll) {
+        func(globalIdx++, elem);
+      }
+    }
+  }
+
+private:
+  std::vector<const CollT*> m_collections{};
+  std::vector<std::size_t> m_offsets{};
+};
+
+} // namespace mlutils
@@ -1,23 +1,38 @@
 #pragma once
 
+#include "ProfileSummary.h"
+
 #include <onnxruntime_cxx_api.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <memory>
 #include <numeric>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
+#include <version>
+
+#ifdef __cpp_lib_mdspan
+#include <mdspan>
+#endif
 
 namespace mlutils {
 namespace detail {
   /**
    * @brief Type trait to extract the scalar type from nested containers.
    *
-   * For scalar types, returns the type itself. For std::vector<T>, recursively
-   * extracts the scalar type from T. This allows handling arbitrarily nested
-   * vectors like std::vector<std::vector<float>>.
+   * For scalar types, returns the type itself. For std::vector<T>,
+   * std::array<T, N>, std::span<T> (and std::mdspan<T> if available),
+   * recursively extracts the scalar type from T. This allows handling
+   * arbitrarily nested containers like std::vector<std::vector<float>> or
+   * std::vector<std::array<float, 4>>.
    */
   template <typename T>
   struct scalar_type {
@@ -29,8 +44,87 @@ namespace detail {
     using type = typename scalar_type<T>::type;
   };
 
+  template <typename T, size_t N>
+  struct scalar_type<std::array<T, N>> {
+    using type = typename scalar_type<T>::type;
+  };
+
+  template <typename T, size_t Extent>
+  struct scalar_type<std::span<T, Extent>> {
+    using type = typename scalar_type<std::remove_cv_t<T>>::type;
+  };
+
   template <typename T>
   using scalar_type_t = typename scalar_type<T>::type;
+
+  /**
+   * @brief Type trait for the shape of types whose shape is known at compile
+   * time, i.e. scalars (shape {}) and (nested) std::arrays of scalars.
+   */
+  template <typename T>
+  struct static_shape {
+    static constexpr bool is_fixed = std::is_arithmetic_v<T>;
+    static constexpr std::array<int64_t, 0> value{};
+  };
+
+  template <typename T, size_t N>
+  struct static_shape<std::array<T, N>> {
+    static constexpr bool is_fixed = static_shape<T>::is_fixed;
+    static constexpr auto value = []() {
+      std::array<int64_t, static_shape<T>::value.size() + 1> shape{static_cast<int64_t>(N)};
+      std::ranges::copy(static_shape<T>::value, shape.begin() + 1);
+      return shape;
+    }();
+  };
+
+  /// Types with a shape that is known at compile time
+  template <typename T>
+  concept FixedShape = static_shape<T>::is_fixed;
+
+  /// The number of scalars in a type with a fixed shape
+  template <FixedShape T>
+  constexpr size_t static_size = []() {
+    size_t size = 1;
+    for (const auto dim : static_shape<T>::value) {
+      size *= dim;
+    }
+    return size;
+  }();
+
+  template <typename T>
+  struct is_mdspan : std::false_type {};
+
+  template <typename T>
+  struct is_row_major_mdspan : std::false_type {};
+
+#ifdef __cpp_lib_mdspan
+  template <typename T, typename Extents, typename Layout, typename Accessor>
+  struct scalar_type<std::mdspan<T, Extents, Layout, Accessor>> {
+    using type = std::remove_cv_t<T>;
+  };
+
+  template <typename T, typename Extents, typename Layout, typename Accessor>
+  struct is_mdspan<std::mdspan<T, Extents, Layout, Accessor>> : std::true_type {};
+
+  template <typename T, typename Extents, typename Accessor>
+  struct is_row_major_mdspan<std::mdspan<T, Extents, std::layout_right, Accessor>> : std::true_type {};
+#endif
+
+  template <typename T>
+  constexpr bool is_mdspan_v = is_mdspan<T>::value;
+
+  /**
+   * @brief Types whose scalars are all stored contiguously in row-major order.
+   *
+   * This is the case for scalars, for contiguous ranges (e.g. std::vector,
+   * std::span) of types with fixed shape (e.g. std::vector<std::array<float,
+   * 4>>) and for row-major std::mdspans.
+   */
+  template <typename T>
+  concept ContiguousData =
+      FixedShape<T> ||
+      (std::ranges::contiguous_range<T> && FixedShape<std::remove_cv_t<std::ranges::range_value_t<T>>>) ||
+      is_row_major_mdspan<T>::value;
 } // namespace detail
 
 /**
@@ -38,40 +132,77 @@ namespace detail {
  *
  * For scalar types, returns 1. For containers, recursively counts all scalar
  * elements. Useful for pre-allocating memory when flattening nested structures.
+ * For containers of fixed shape types this does not need to look at the
+ * individual elements.
  *
  * @param value The value or container to count elements in
  * @return Total number of scalar elements
  */
 template <typename T>
-size_t totalSize(const T&) {
-  return 1;
+size_t totalSize(const T& value) {
+  if constexpr (detail::FixedShape<T>) {
+    return detail::static_size<T>;
+  } else if constexpr (detail::is_mdspan_v<T>) {
+    return value.size();
+  } else if constexpr (std::ranges::sized_range<T> && detail::FixedShape<std::ranges::range_value_t<T>>) {
+    return std::ranges::size(value) * detail::static_size<std::ranges::range_value_t<T>>;
+  } else if constexpr (std::ranges::range<T>) {
+    // No fold_left yet
+    const auto sizes = value | std::views::transform([](const auto& v) { return totalSize(v); });
+    return std::accumulate(sizes.begin(), sizes.end(), size_t{0});
+  } else {
+    return 1;
+  }
 }
 
-template <typename T>
-size_t totalSize(const std::vector<T>& value) {
-  // No fold_left yet
-  const auto sizes = value | std::views::transform([](const auto& v) { return totalSize(v); });
-  return std::accumulate(sizes.begin(), sizes.end(), 0);
+/**
+ * @brief Get a flat, non-owning view of all scalars in a container whose
+ * scalars are stored contiguously.
+ *
+ * This is a zero-copy alternative to flatten for e.g.
+ * std::vector<std::array<float, N>>, std::span<float> or row-major
+ * std::mdspans.
+ *
+ * @param value The container to get a view of
+ * @return A view of all scalars in the container in row-major order
+ */
+template <detail::ContiguousData T>
+std::span<const detail::scalar_type_t<T>> flatView(const T& value) {
+  using Scalar = detail::scalar_type_t<T>;
+  if constexpr (std::is_arithmetic_v<T>) {
+    return {&value, 1};
+  } else if constexpr (detail::is_mdspan_v<T>) {
+    return {value.data_handle(), value.size()};
+  } else {
+    using Element = std::remove_cv_t<std::ranges::range_value_t<T>>;
+    // (Nested) std::arrays are guaranteed to be aggregates without any
+    // additional members, this makes sure that there is also no padding
+    static_assert(sizeof(Element) == detail::static_size<Element> * sizeof(Scalar));
+    return {reinterpret_cast<const Scalar*>(std::ranges::data(value)), totalSize(value)};
+  }
 }
 
 /**
  * @brief Flatten nested containers into a single vector of scalar values.
  *
- * Recursively traverses nested std::vector structures and extracts all scalar
- * values into a flat output vector. Supports arbitrary nesting levels.
+ * Recursively traverses nested containers and extracts all scalar values into
+ * a flat output vector. Supports arbitrary nesting levels. Containers whose
+ * scalars are stored contiguously are copied in one go.
  *
  * @param value The value or container to flatten
  * @param output The output vector to append flattened values to
  */
 template <typename T>
 void flatten(const T& value, std::vector<detail::scalar_type_t<T>>& output) {
-  output.push_back(value);
-}
-
-template <typename T>
-void flatten(const std::vector<T>& vec, std::vector<detail::scalar_type_t<T>>& output) {
-  for (const auto& item : vec) {
-    flatten(item, output);
+  if constexpr (detail::ContiguousData<T> && !std::is_arithmetic_v<T>) {
+    const auto view = flatView(value);
+    output.insert(output.end(), view.begin(), view.end());
+  } else if constexpr (std::ranges::range<T>) {
+    for (const auto& item : value) {
+      flatten(item, output);
+    }
+  } else {
+    output.push_back(value);
   }
 }
 
@@ -95,37 +226,221 @@ std::vector<detail::scalar_type_t<T>> flatten(const T& value) {
  * @brief Extract the dimensions of a nested container structure.
  *
  * For scalar types, returns an empty vector (0-dimensional).
- * For nested std::vector structures, returns the dimensions as a vector of sizes.
+ * For nested containers, returns the dimensions as a vector of sizes. The
+ * dimensions of fixed size types (e.g. std::array) are known at compile time
+ * and also available for empty containers.
  *
- * @note Assumes that all vectors at the same nesting level have the same size
- * (i.e. rectangular structure) and only looks at the first element at each level to determine dimensions. Does not do
- * any validation of these assumptions!
+ * @note Assumes that all containers at the same nesting level have the same
+ * size (i.e. rectangular structure) and only looks at the first element at each
+ * level to determine dimensions. Does not do any validation of these
+ * assumptions! Use hasShape for that.
  *
  * @param value The value or container to analyze
  * @return Vector of dimensions, where each element represents the size at that nesting level
  */
 template <typename T>
-std::vector<int64_t> getDimensions(const T&) {
-  return std::vector<int64_t>{};
+std::vector<int64_t> getDimensions(const T& value) {
+  if constexpr (detail::FixedShape<T>) {
+    const auto& shape = detail::static_shape<T>::value;
+    return std::vector<int64_t>(shape.begin(), shape.end());
+  } else if constexpr (detail::is_mdspan_v<T>) {
+    std::vector<int64_t> dims(T::rank());
+    for (size_t i = 0; i < T::rank(); ++i) {
+      dims[i] = value.extent(i);
+    }
+    return dims;
+  } else if constexpr (std::ranges::range<T>) {
+    using Element = std::remove_cv_t<std::ranges::range_value_t<T>>;
+    std::vector<int64_t> dims{};
+    if constexpr (detail::FixedShape<Element>) {
+      dims = getDimensions(Element{});
+    } else if (!std::ranges::empty(value)) {
+      // Get the dimensions of the first nested container
+      dims = getDimensions(*std::ranges::begin(value));
+    }
+    // Prepend the size of the current container to the dimensions we already collected
+    dims.insert(dims.begin(), std::ranges::size(value));
+    return dims;
+  } else {
+    return std::vector<int64_t>{};
+  }
 }
 
+/**
+ * @brief Check whether a (nested) container has the expected shape
+ *
+ * Contrary to getDimensions this checks all elements, i.e. it also detects
+ * jagged containers.
+ *
+ * @param value The value or container to check
+ * @param dims The expected dimensions
+ * @return true if the value has exactly the expected shape
+ */
 template <typename T>
-std::vector<int64_t> getDimensions(const std::vector<T>& value) {
-  if (value.empty()) {
-    return std::vector<int64_t>{0};
+bool hasShape(const T& value, std::span<const int64_t> dims) {
+  if constexpr (detail::FixedShape<T> || detail::is_mdspan_v<T>) {
+    return std::ranges::equal(getDimensions(value), dims);
+  } else if constexpr (std::ranges::range<T>) {
+    if (dims.empty() || static_cast<int64_t>(std::ranges::size(value)) != dims[0]) {
+      return false;
+    }
+    return std::ranges::all_of(value, [&dims](const auto& item) { return hasShape(item, dims.subspan(1)); });
   } else {
-    // Get the dimensions of the first nested vector
-    auto dims = getDimensions(value[0]);
-    // Prepend the size of the current vector to the dimensions we already collected
-    dims.insert(dims.begin(), value.size());
-    return dims;
+    return dims.empty();
   }
 }
 
+/**
+ * @brief The precision of the (weights of the) model that is loaded
+ *
+ * The reduced precision variants are created from the fp32 model with
+ * scripts/quantize_model.py and are stored next to it as <model>.int8.onnx and
+ * <model>.fp16.onnx. Their inputs and outputs are still fp32.
+ */
+enum class ModelPrecision {
+  FP32,        ///< The original model
+  FP16Weights, ///< Weights stored as fp16, computations in fp32
+  Int8         ///< Dynamically quantized to int8 weights and activations
+};
+
+/**
+ * @brief Convert a string (fp32, fp16, int8) into a ModelPrecision
+ *
+ * @throws std::invalid_argument if the string is not a valid precision
+ */
+ModelPrecision toModelPrecision(std::string_view precision);
+
+/**
+ * @brief Get the path of the variant of a model with the given precision,
+ * e.g. model.int8.onnx for model.onnx
+ */
+std::string modelVariantPath(const std::string& modelPath, ModelPrecision precision);
+
+/**
+ * @brief Configuration of the ONNX Runtime session that is used for inference.
+ *
+ * The defaults run the model on a single CPU core, which is usually what we
+ * want in a multi-threaded framework where parallelism comes from processing
+ * several events concurrently.
+ */
+struct SessionConfig {
+  /// Number of threads used to parallelize the execution within nodes (0: ONNX Runtime default)
+  int intraOpNumThreads{1};
+  /// Number of threads used to parallelize the execution of the graph (0: ONNX Runtime default)
+  /// @note Only has an effect in ORT_PARALLEL execution mode
+  int interOpNumThreads{1};
+  /// Whether to execute the operators in the graph sequentially or in parallel
+  ExecutionMode executionMode{ORT_SEQUENTIAL};
+  /// Which optimizations ONNX Runtime may perform on the model graph
+  GraphOptimizationLevel graphOptimizationLevel{ORT_ENABLE_EXTENDED};
+  /// Whether the threads of the thread pools spin while waiting for work. Lowers
+  /// latency at the cost of burning CPU cycles
+  bool allowSpinning{true};
+  /// Use an arena for the CPU memory allocations
+  bool enableCpuMemArena{true};
+  /// Pre-plan memory allocations based on the shapes seen in previous runs
+  bool enableMemPattern{true};
+  /// Directory in which the optimized models are cached (in ORT format) to
+  /// avoid re-running the graph optimizations on every start. Cached models
+  /// are invalidated if the contents of the original model change. Caching is
+  /// disabled if this is empty.
+  /// @note With ORT_ENABLE_ALL the optimized model can be specific to the
+  /// hardware it has been created on, so the cache should not be shared
+  /// between different machines in that case
+  std::string optimizedModelCacheDir{};
+  /// Enable the ONNX Runtime profiler, which writes the profile to a JSON file
+  /// whose name starts with this prefix. Profiling is disabled if this is empty
+  std::string profilingFilePrefix{};
+  /// Stop profiling after this many inferences, in order to bound the overhead
+  /// (0: profile until the session is destroyed)
+  size_t profilingMaxRuns{100};
+  /// Load the variant of the model with this precision instead of the passed
+  /// (fp32) model
+  ModelPrecision precision{ModelPrecision::FP32};
+
+  bool operator==(const SessionConfig&) const = default;
+};
+
+/**
+ * @brief Information about how a model has been loaded
+ */
+struct ModelLoadInfo {
+  enum class Source {
+    File,           ///< Loaded (and optimized) from the original model file
+    OptimizedCache, ///< Loaded from a previously cached optimized model
+    SharedSession   ///< Re-used an already existing session for the model
+  };
+
+  Source source{Source::File};
+  /// Time it took to load the model
+  double loadTimeMs{0};
+  /// Time it took to load and optimize the original model when the cached
+  /// optimized model was created. Only set when loading from the cache
+  double referenceLoadTimeMs{0};
+  /// Path to the cached optimized model (if caching is enabled)
+  std::string optimizedModelPath{};
+  /// Path to the model that has actually been loaded, i.e. the variant with
+  /// the configured precision
+  std::string modelPath{};
+};
+
+/**
+ * @brief Convert a string (disable, basic, extended, all) into an ONNX Runtime
+ * graph optimization level.
+ *
+ * @throws std::invalid_argument if the string is not a valid optimization level
+ */
+GraphOptimizationLevel toGraphOptimizationLevel(std::string_view level);
+
+/**
+ * @brief Convert a string (sequential, parallel) into an ONNX Runtime execution
+ * mode.
+ *
+ * @throws std::invalid_argument if the string is not a valid execution mode
+ */
+ExecutionMode toExecutionMode(std::string_view mode);
+
+class InferenceBuffers;
+class SessionProfiler;
+
+/**
+ * @brief Non-owning view of the data and shape of a named input tensor.
+ *
+ * The data and the shape have to stay valid until inference has been run.
+ */
+struct InputTensor {
+  InputTensor(std::string_view inputName, std::span<const float> values, std::span<const int64_t> tensorShape)
+      : name(inputName), data(values.data()), byteSize(values.size_bytes()),
+        elementType(ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT), shape(tensorShape) {}
+
+  InputTensor(std::string_view inputName, std::span<const int64_t> values, std::span<const int64_t> tensorShape)
+      : name(inputName), data(values.data()), byteSize(values.size_bytes()),
+        elementType(ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64), shape(tensorShape) {}
+
+  std::string_view name;
+  const void* data;
+  size_t byteSize;
+  ONNXTensorElementDataType elementType;
+  std::span<const int64_t> shape;
+};
+
+/**
+ * @brief Wrapper around an ONNX Runtime session for running inference.
+ *
+ * All instances share one process-wide Ort::Env. Sessions are shared between
+ * all instances that load the same model with the same SessionConfig, such
+ * that the model is only parsed and optimized once and its weights are only
+ * kept in memory once. Sessions are reference counted and released once the
+ * last model using them is destroyed.
+ *
+ * @note The logging level and name of a shared session are the ones of the
+ * model that first loaded it.
+ */
 class ONNXInferenceModel {
 public:
   // Constructor
-  explicit ONNXInferenceModel(const std::string& name, OrtLoggingLevel logLevel = ORT_LOGGING_LEVEL_WARNING);
+  explicit ONNXInferenceModel(const std::string& name, OrtLoggingLevel logLevel = ORT_LOGGING_LEVEL_WARNING,
+                              const SessionConfig& config = {});
 
   ONNXInferenceModel() = delete;
   ONNXInferenceModel(const ONNXInferenceModel&) = delete;
@@ -136,49 +451,222 @@ public:
   // Destructor
   ~ONNXInferenceModel() = default;
 
-  // Load model from file
+  // Load model from file, re-using an already existing session if possible
   bool loadModel(const std::string& modelPath);
 
+  /// Information about how the model has been loaded
+  [[nodiscard]] const ModelLoadInfo& loadInfo() const { return m_loadInfo; }
+
+  /// Check whether this model uses the same ONNX Runtime session as another one
+  [[nodiscard]] bool sharesSessionWith(const ONNXInferenceModel& other) const {
+    return m_session != nullptr && m_session == other.m_session;
+  }
+
   template <typename T>
-  [[nodiscard]] std::vector<Ort::Value> runInference(const T& inputData);
+    requires std::is_arithmetic_v<detail::scalar_type_t<T>>
+  [[nodiscard]] std::vector<Ort::Value> runInference(const T& inputData) const;
 
-  // Run inference on input data
+  /**
+   * @brief Run inference on input data
+   *
+   * This is safe to call concurrently from several threads on the same
+   * instance, as it does not modify any state of the model and an
+   * Ort::Session supports concurrent calls to Run.
+   */
   [[nodiscard]] std::vector<Ort::Value> runInference(const std::vector<float>& inputData,
-                                                     const std::vector<int64_t>& inputShape);
+                                                     const std::vector<int64_t>& inputShape) const;
+
+  /**
+   * @brief Run inference with inputs and outputs that have been bound to the
+   * passed buffers.
+   *
+   * Contrary to the other overloads this does not allocate any output tensors,
+   * the outputs are written into the (re-usable) buffers instead. Safe to call
+   * concurrently as long as every thread uses its own buffers.
+   *
+   * @note ONNX Runtime still allocates a few small objects inside Run (e.g.
+   * its execution frame). Their number is fixed for a given model and does not
+   * grow with the size of the inputs.
+   */
+  void runInference(InferenceBuffers& buffers) const;
+
+  /**
+   * @brief Run inference on several (named) inputs of different types.
+   *
+   * The input data is not copied. Only the requested outputs are returned, if
+   * no output names are passed all outputs are returned. Safe to call
+   * concurrently.
+   *
+   * @throws std::invalid_argument if an input or output name is unknown or the
+   * type of an input does not match the one expected by the model
+   */
+  [[nodiscard]] std::vector<Ort::Value> runInference(std::span<const InputTensor> inputs,
+                                                     std::span<const std::string_view> outputNames = {}) const;
+
+  /// Get the index of an input by its name
+  /// @throws std::invalid_argument if the model has no input with that name
+  [[nodiscard]] size_t inputIndex(std::string_view name) const;
+
+  /// Get the index of an output by its name
+  /// @throws std::invalid_argument if the model has no output with that name
+  [[nodiscard]] size_t outputIndex(std::string_view name) const;
+
+  /// The shape of an input as declared by the model, dynamic dimensions are -1
+  /// @throws std::out_of_range if the model has no input with that index
+  [[nodiscard]] const std::vector<int64_t>& inputShape(size_t index) const { return m_inputShapes.at(index); }
 
   // Print model information to stream
   template <typename StreamT>
   void dumpModel(StreamT& stream) const;
 
+  /**
+   * @brief Stop profiling (if it is still running) and get the profile file
+   *
+   * Profiling is stopped for all models sharing the session.
+   *
+   * @return The path to the profile, or an empty string if profiling is not
+   * enabled
+   */
+  std::string endProfiling() const;
+
+  /// Stop profiling and print the topK most expensive operator types
+  template <typename StreamT>
+  void dumpProfile(StreamT& stream, size_t topK = 10) const;
+
 private:
   // ONNX Runtime objects
-  std::unique_ptr<Ort::Env> m_env{nullptr};
-  std::unique_ptr<Ort::Session> m_session{nullptr};
+  std::shared_ptr<Ort::Session> m_session{nullptr};
+  // Shared by all models that use the same session. Only set if profiling is
+  // enabled
+  std::shared_ptr<SessionProfiler> m_profiler{nullptr};
   std::unique_ptr<Ort::SessionOptions> m_sessionOptions{nullptr};
+  SessionConfig m_config{};
   Ort::AllocatorWithDefaultOptions m_allocator{}; // default allocator
+  Ort::MemoryInfo m_memoryInfo{nullptr};          // CPU memory info for input tensors
 
   // Model metadata
   std::vector<std::string> m_inputNames{};
   std::vector<std::string> m_outputNames{};
+  // Pointers into the names above as they are necessary for Ort::Session::Run.
+  // These stay valid when the model is moved, since moving a vector keeps its
+  // elements in place
+  std::vector<const char*> m_inputNamePtrs{};
+  std::vector<const char*> m_outputNamePtrs{};
   std::vector<std::vector<int64_t>> m_inputShapes{};
   std::vector<std::vector<int64_t>> m_outputShapes{};
-  std::string m_envName{};
+  std::vector<ONNXTensorElementDataType> m_inputTypes{};
+  std::vector<ONNXTensorElementDataType> m_outputTypes{};
+  std::string m_name{};
+  ModelLoadInfo m_loadInfo{};
 
   bool m_modelLoaded{false};
 
   // Helper methods
   void extractModelInfo();
   void cleanup();
+
+  friend class InferenceBuffers;
+};
+
+/**
+ * @brief Re-usable input and output bindings for an ONNXInferenceModel.
+ *
+ * Inputs are bound directly to caller owned memory, outputs are written into
+ * grow-only buffers that are owned by this class. Once the buffers have grown
+ * to the largest size that is necessary, running inference does not allocate
+ * any memory in this layer any longer. Only the fixed per run allocations of
+ * ONNX Runtime itself remain. Bindings are only re-created if the
+ * shape or location of the data changes.
+ *
+ * @note Not thread-safe, every thread should use its own instance (e.g. via an
+ * mlutils::ObjectPool). The model must outlive the buffers and must not be
+ * moved or re-loaded while they are in use.
+ */
+class InferenceBuffers {
+public:
+  explicit InferenceBuffers(const ONNXInferenceModel& model);
+
+  InferenceBuffers(const InferenceBuffers&) = delete;
+  InferenceBuffers& operator=(const InferenceBuffers&) = delete;
+  InferenceBuffers(InferenceBuffers&&) = default;
+  InferenceBuffers& operator=(InferenceBuffers&&) = default;
+  ~InferenceBuffers() = default;
+
+  /// Bind the (first) input of the model to the passed data. The data is not
+  /// copied and has to stay valid until inference has been run
+  void bindInput(std::span<const float> data, std::span<const int64_t> shape);
+
+  /// Bind an input of the model by name. The data is not copied and has to
+  /// stay valid until inference has been run
+  /// @throws std::invalid_argument for unknown inputs or mismatching types
+  void bindInput(const InputTensor& input);
+
+  /// Bind an output of the model to an internal buffer that is large enough
+  /// to hold an output of the passed shape. Only outputs that have been bound
+  /// are returned when running inference.
+  /// @throws std::invalid_argument if the output is not a float tensor
+  void bindOutput(size_t index, std::span<const int64_t> shape);
+
+  /// Get the values of an output after inference has been run
+  [[nodiscard]] std::span<const float> output(size_t index) const;
+
+  /// Get the shape that has been bound for an output
+  [[nodiscard]] std::span<const int64_t> outputShape(size_t index) const { return m_outputShapes[index]; }
+
+  /// The number of times that any of the output buffers had to grow
+  [[nodiscard]] size_t numReallocations() const { return m_numReallocations; }
+
+private:
+  const ONNXInferenceModel* m_model{nullptr};
+  Ort::IoBinding m_binding{nullptr};
+
+  // Needed to detect whether an input needs to be re-bound
+  std::vector<const void*> m_inputData{};
+  std::vector<std::vector<int64_t>> m_inputShapes{};
+
+  std::vector<std::vector<float>> m_outputBuffers{};
+  std::vector<std::vector<int64_t>> m_outputShapes{};
+  // Needed to detect whether an output needs to be re-bound
+  std::vector<const float*> m_boundOutputData{};
+
+  size_t m_numReallocations{0};
+
+  friend class ONNXInferenceModel;
 };
 
 template <typename T>
-std::vector<Ort::Value> ONNXInferenceModel::runInference(const T& inputData) {
-  auto input = flatten(inputData);
-  auto dims = getDimensions(inputData);
-  // Very basic check to at least avoid glaring mistakes in the inputData shape
-  assert(input.size() == std::reduce(dims.begin(), dims.end(), 1u, std::multiplies<>()));
+  requires std::is_arithmetic_v<detail::scalar_type_t<T>>
+std::vector<Ort::Value> ONNXInferenceModel::runInference(const T& inputData) const {
+  if (!m_modelLoaded) {
+    throw std::runtime_error("Model not loaded");
+  }
+  const auto dims = getDimensions(inputData);
+  // Only validate the complete shape in debug builds, as it has to look at
+  // every element
+  assert(hasShape(inputData, dims));
+
+  if constexpr (detail::ContiguousData<T>) {
+    // No need to flatten, the input tensor can be created directly on top of the data
+    const std::array inputs = {InputTensor{m_inputNames[0], flatView(inputData), dims}};
+    return runInference(inputs);
+  } else {
+    const auto input = flatten(inputData);
+    const std::array inputs = {InputTensor{m_inputNames[0], input, dims}};
+    return runInference(inputs);
+  }
+}
 
-  return runInference(input, dims);
+template <typename StreamT>
+void ONNXInferenceModel::dumpProfile(StreamT& stream, size_t topK) const {
+  const auto profileFile = endProfiling();
+  if (profileFile.empty()) {
+    stream << "Profiling is not enabled" << std::endl;
+    return;
+  }
+
+  stream << "=== ONNX Runtime profile of " << m_name << " (" << profileFile << ") ===" << std::endl;
+  printProfileSummary(stream, summarizeProfileFile(profileFile, topK));
+  stream << "===============================" << std::endl;
 }
 
 template <typename StreamT>
@@ -189,7 +677,7 @@ void ONNXInferenceModel::dumpModel(StreamT& stream) const {
   }
 
   stream << "=== ONNX Model Information ===" << std::endl;
-  stream << "Environment Name: " << m_envName << std::endl;
+  stream << "Model Name: " << m_name << std::endl;
 
   stream << "Inputs (" << m_inputNames.size() << "):" << std::endl;
   for (size_t i = 0; i < m_inputNames.size(); ++i) {
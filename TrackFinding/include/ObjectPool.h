@@ -0,0 +1,94 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief A thread-safe pool of re-usable objects.
+ *
+ * Objects are handed out via RAII handles that return them to the pool once
+ * they go out of scope. If no idle object is available a new one is created,
+ * so the pool grows to the maximum number of objects that are in use
+ * concurrently (typically the number of threads). This allows to keep
+ * expensive to create (or large) per-thread state, e.g. buffers, across
+ * events without having to know the number of threads upfront.
+ *
+ * @note The pool has to outlive all handles that have been acquired from it.
+ */
+template <typename T>
+class ObjectPool {
+public:
+  using Factory = std::function<std::unique_ptr<T>()>;
+
+  /// RAII handle to an object from the pool
+  class Handle {
+  public:
+    Handle(ObjectPool* pool, std::unique_ptr<T> object) : m_pool(pool), m_object(std::move(object)) {}
+    Handle(const Handle&) = delete;
+    Handle& operator=(const Handle&) = delete;
+    Handle(Handle&& other) noexcept = default;
+    Handle& operator=(Handle&& other) noexcept {
+      release();
+      m_pool = other.m_pool;
+      m_object = std::move(other.m_object);
+      return *this;
+    }
+    ~Handle() { release(); }
+
+    T& operator*() const { return *m_object; }
+    T* operator->() const { return m_object.get(); }
+
+  private:
+    void release() {
+      if (m_object) {
+        m_pool->release(std::move(m_object));
+      }
+    }
+
+    ObjectPool* m_pool{nullptr};
+    std::unique_ptr<T> m_object{nullptr};
+  };
+
+  explicit ObjectPool(Factory factory) : m_factory(std::move(factory)) {}
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+  ObjectPool(ObjectPool&&) = delete;
+  ObjectPool& operator=(ObjectPool&&) = delete;
+  ~ObjectPool() = default;
+
+  /// Get an idle object from the pool or create a new one if there is none
+  [[nodiscard]] Handle acquire() {
+    {
+      std::lock_guard lock{m_mutex};
+      if (!m_idle.empty()) {
+        auto object = std::move(m_idle.back());
+        m_idle.pop_back();
+        return Handle{this, std::move(object)};
+      }
+    }
+    return Handle{this, m_factory()};
+  }
+
+  /// The number of objects that are currently not in use
+  [[nodiscard]] size_t numIdle() const {
+    std::lock_guard lock{m_mutex};
+    return m_idle.size();
+  }
+
+private:
+  void release(std::unique_ptr<T> object) {
+    std::lock_guard lock{m_mutex};
+    m_idle.push_back(std::move(object));
+  }
+
+  Factory m_factory;
+  mutable std::mutex m_mutex{};
+  std::vector<std::unique_ptr<T>> m_idle{};
+};
+
+} // namespace mlutils
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlutils {
+
+/// The accumulated kernel time of one operator type in an ONNX Runtime profile
+struct OpProfile {
+  std::string opType{};
+  std::size_t numCalls{0};
+  double totalUs{0};
+  /// Fraction of the total kernel time of all operators
+  double fraction{0};
+};
+
+namespace detail {
+  /// Find the value of a key in a flat JSON object (or one of its nested
+  /// objects). Returns the raw value, i.e. strings without the quotes
+  inline std::optional<std::string_view> findJsonValue(std::string_view object, std::string_view key) {
+    const auto quotedKey = "\"" + std::string(key) + "\"";
+    auto pos = object.find(quotedKey);
+    if (pos == std::string_view::npos) {
+      return std::nullopt;
+    }
+    pos = object.find_first_not_of(" \t\n\r", pos + quotedKey.size());
+    if (pos == std::string_view::npos || object[pos] != ':') {
+      return std::nullopt;
+    }
+    pos = object.find_first_not_of(" \t\n\r", pos + 1);
+    if (pos == std::string_view::npos) {
+      return std::nullopt;
+    }
+    if (object[pos] == '"') {
+      // Operator and node names do not contain escaped quotes
+      const auto end = object.find('"', pos + 1);
+      if (end == std::string_view::npos) {
+        return std::nullopt;
+      }
+      return object.substr(pos + 1, end - pos - 1);
+    }
+    const auto end = object.find_first_of(",}", pos);
+    return object.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+  }
+
+  /// Split the top level array of a JSON document into its objects
+  inline std::vector<std::string_view> splitJsonObjects(std::string_view json) {
+    std::vector<std::string_view> objects{};
+    int depth = 0;
+    bool inString = false;
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < json.size(); ++i) {
+      const auto c = json[i];
+      if (inString) {
+        if (c == '\\') {
+          ++i;
+        } else if (c == '"') {
+          inString = false;
+        }
+        continue;
+      }
+      if (c == '"') {
+        inString = true;
+      } else if (c == '{' || c == '[') {
+        if (c == '{' && depth == 1) {
+          start = i;
+        }
+        ++depth;
+      } else if (c == '}' || c == ']') {
+        --depth;
+        if (c == '}' && depth == 1) {
+          objects.push_back(json.substr(start, i - start + 1));
+        }
+      }
+    }
+    return objects;
+  }
+} // namespace detail
+
+/**
+ * @brief Summarize the kernel times of an ONNX Runtime profile by operator
+ * type
+ *
+ * The profile is the JSON array of trace events that ONNX Runtime writes when
+ * profiling is enabled. Only the kernel time of the nodes is considered.
+ *
+ * @param profileJson The contents of the profile
+ * @param topK        Only return the topK most expensive operator types (0: all)
+ * @return The operator types sorted by their total kernel time
+ */
+inline std::vector<OpProfile> summarizeProfile(std::string_view profileJson, std::size_t topK = 10) {
+  std::map<std::string, OpProfile, std::less<>> byType{};
+  double totalUs = 0;
+  for (const auto event : detail::splitJsonObjects(profileJson)) {
+    const auto category = detail::findJsonValue(event, "cat");
+    const auto name = detail::findJsonValue(event, "name");
+    if (category != "Node" || !name || !name->ends_with("_kernel_time")) {
+      continue;
+    }
+    const auto duration = detail::findJsonValue(event, "dur");
+    double durationUs = 0;
+    if (!duration ||
+        std::from_chars(duration->data(), duration->data() + duration->size(), durationUs).ec != std::errc{}) {
+      continue;
+    }
+    const auto opType = std::string(detail::findJsonValue(event, "op_name").value_or("Unknown"));
+
+    auto& op = byType[opType];
+    op.opType = opType;
+    ++op.numCalls;
+    op.totalUs += durationUs;
+    totalUs += durationUs;
+  }
+
+  std::vector<OpProfile> ops{};
+  ops.reserve(byType.size());
+  for (auto& [type, op] : byType) {
+    op.fraction = totalUs > 0 ? op.totalUs / totalUs : 0;
+    ops.push_back(std::move(op));
+  }
+  std::ranges::stable_sort(ops, std::greater<>{}, &OpProfile::totalUs);
+  if (topK > 0 && ops.size() > topK) {
+    ops.resize(topK);
+  }
+  return ops;
+}
+
+/**
+ * @brief Summarize the profile that ONNX Runtime has written to a file
+ *
+ * @throws std::runtime_error if the file cannot be read
+ */
+inline std::vector<OpProfile> summarizeProfileFile(const std::string& path, std::size_t topK = 10) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Cannot open profile " + path);
+  }
+  std::stringstream contents{};
+  contents << file.rdbuf();
+  return summarizeProfile(contents.str(), topK);
+}
+
+/// Print a table of the operator types in a profile summary
+template <typename StreamT>
+void printProfileSummary(StreamT& stream, std::span<const OpProfile> ops) {
+  // Format into a separate stream to not change the state of the passed one
+  std::ostringstream table{};
+  table << std::left << std::setw(24) << "Operator" << std::right << std::setw(8) << "Calls" << std::setw(14)
+        << "Total [us]" << std::setw(10) << "Fraction" << '\n';
+  table << std::fixed << std::setprecision(1);
+  for (const auto& op : ops) {
+    table << std::left << std::setw(24) << op.opType << std::right << std::setw(8) << op.numCalls << std::setw(14)
+          << op.totalUs << std::setw(9) << 100 * op.fraction << "%\n";
+  }
+  stream << table.str();
+}
+
+} // namespace mlutils
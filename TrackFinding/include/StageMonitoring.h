@@ -0,0 +1,252 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief Scoped timer that adds the elapsed time (in ms) to a target once it
+ * is stopped or goes out of scope
+ *
+ * A nullptr target disables the timer, which allows to make timing
+ * optional.
+ */
+class ScopedTimer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit ScopedTimer(double* targetMs) : m_target(targetMs) {
+    if (m_target) {
+      m_start = Clock::now();
+    }
+  }
+  explicit ScopedTimer(double& targetMs) : ScopedTimer(&targetMs) {}
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+  ScopedTimer(ScopedTimer&&) = delete;
+  ScopedTimer& operator=(ScopedTimer&&) = delete;
+
+  ~ScopedTimer() { stop(); }
+
+  /// Record the elapsed time. Further calls have no effect
+  void stop() {
+    if (m_target) {
+      *m_target += std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+      m_target = nullptr;
+    }
+  }
+
+private:
+  double* m_target{nullptr};
+  Clock::time_point m_start{};
+};
+
+/// The peak resident set size of the process so far (in kB). This only needs
+/// a single system call and is cheap enough to be queried several times per
+/// event
+inline long peakRssKb() {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+/// The current resident set size of the process (in kB, 0 if unavailable).
+/// Unlike the peak RSS this can also decrease, which allows to follow the
+/// memory use within an event. Reads /proc, so it is only available on Linux.
+/// This takes a few microseconds, i.e. it is fine to call it a few times per
+/// event
+inline long currentRssKb() {
+  std::ifstream statm{"/proc/self/statm"};
+  long sizePages = 0;
+  long residentPages = 0;
+  if (!(statm >> sizePages >> residentPages)) {
+    return 0;
+  }
+  return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * @brief The measurements of the stages of one event
+ *
+ * The storage is kept when resetting, such that records can be re-used across
+ * events.
+ */
+struct StageRecord {
+  /// Wall clock time spent in each stage
+  std::vector<double> timesMs{};
+  /// Change of the current RSS of the process during each stage, i.e. the
+  /// memory that a stage keeps for the later stages (or releases). This is
+  /// process wide, so with several events in flight it also contains the
+  /// allocations of the other events
+  std::vector<long> rssChangeKb{};
+  /// Additional per event counters, e.g. the number of hits or edges
+  std::vector<std::size_t> counters{};
+  /// Current RSS of the process after the last recorded stage (or at the start
+  /// of the event)
+  long rssKb{0};
+
+  /// Prepare the record for a new event
+  void reset(std::size_t numStages, std::size_t numCounters) {
+    rssKb = mlutils::currentRssKb();
+    timesMs.assign(numStages, 0.);
+    rssChangeKb.assign(numStages, 0);
+    counters.assign(numCounters, 0);
+  }
+
+  /// Record the change of the RSS since the previous stage. The stages have to
+  /// be recorded in order
+  void recordRss(std::size_t stage, long currentKb) {
+    rssChangeKb[stage] = currentKb - rssKb;
+    rssKb = currentKb;
+  }
+
+  /// Stop the timer of a stage and record the RSS change during it
+  void finishStage(std::size_t stage, ScopedTimer& timer) {
+    timer.stop();
+    recordRss(stage, mlutils::currentRssKb());
+  }
+};
+
+/// Percentiles and moments of a set of latency measurements
+struct LatencySummary {
+  std::size_t count{0};
+  double mean{0};
+  double min{0};
+  double p50{0};
+  double p90{0};
+  double p99{0};
+  double max{0};
+};
+
+/// The p-th percentile (p in [0, 1]) of sorted values, interpolating linearly
+/// between the closest ranks
+inline double percentile(std::span<const double> sorted, double p) {
+  if (sorted.empty()) {
+    return 0.;
+  }
+  const auto rank = std::clamp(p, 0., 1.) * static_cast<double>(sorted.size() - 1);
+  const auto lower = static_cast<std::size_t>(std::floor(rank));
+  const auto upper = std::min(lower + 1, sorted.size() - 1);
+  return sorted[lower] + (rank - static_cast<double>(lower)) * (sorted[upper] - sorted[lower]);
+}
+
+/// Summarize latency measurements (all zero if there are none)
+inline LatencySummary summarizeLatencies(std::vector<double> values) {
+  if (values.empty()) {
+    return {};
+  }
+  std::ranges::sort(values);
+  return {.count = values.size(),
+          .mean = std::accumulate(values.begin(), values.end(), 0.) / static_cast<double>(values.size()),
+          .min = values.front(),
+          .p50 = percentile(values, 0.5),
+          .p90 = percentile(values, 0.9),
+          .p99 = percentile(values, 0.99),
+          .max = values.back()};
+}
+
+/**
+ * @brief Thread-safe writer of a per event trace of StageRecords
+ *
+ * Files ending in .json are written as JSON lines, i.e. one JSON object per
+ * event and line. All other files are written as CSV with a header line.
+ */
+class StageTraceWriter {
+public:
+  enum class Format { CSV, JSON };
+
+  /**
+   * @brief Open the trace file and write the header (for CSV)
+   *
+   * @throws std::runtime_error if the file cannot be opened
+   */
+  StageTraceWriter(const std::string& path, std::vector<std::string> stageNames,
+                   std::vector<std::string> counterNames)
+      : m_file(path), m_stageNames(std::move(stageNames)), m_counterNames(std::move(counterNames)),
+        m_format(path.ends_with(".json") ? Format::JSON : Format::CSV) {
+    if (!m_file) {
+      throw std::runtime_error("Cannot open stage trace file " + path);
+    }
+    if (m_format == Format::CSV) {
+      m_file << "event";
+      for (const auto& stage : m_stageNames) {
+        m_file << ',' << stage << "_ms";
+      }
+      for (const auto& stage : m_stageNames) {
+        m_file << ',' << stage << "_rss_change_kb";
+      }
+      for (const auto& counter : m_counterNames) {
+        m_file << ',' << counter;
+      }
+      m_file << '\n';
+    }
+  }
+
+  Format format() const { return m_format; }
+
+  /// Write the record of one event
+  void write(std::size_t event, const StageRecord& record) {
+    std::lock_guard lock{m_mutex};
+    if (m_format == Format::CSV) {
+      m_file << event;
+      writeCsv(record.timesMs);
+      writeCsv(record.rssChangeKb);
+      writeCsv(record.counters);
+      m_file << '\n';
+    } else {
+      m_file << "{\"event\": " << event << ", \"time_ms\": {";
+      writeJson(record.timesMs, m_stageNames);
+      m_file << "}, \"rss_change_kb\": {";
+      writeJson(record.rssChangeKb, m_stageNames);
+      m_file << "}, \"counters\": {";
+      writeJson(record.counters, m_counterNames);
+      m_file << "}}\n";
+    }
+  }
+
+  void flush() {
+    std::lock_guard lock{m_mutex};
+    m_file.flush();
+  }
+
+private:
+  template <typename T>
+  void writeCsv(const std::vector<T>& values) {
+    for (const auto& value : values) {
+      m_file << ',' << value;
+    }
+  }
+
+  /// Write "name": value pairs
+  template <typename T>
+  void writeJson(const std::vector<T>& values, const std::vector<std::string>& names) {
+    for (std::size_t i = 0; i < values.size() && i < names.size(); ++i) {
+      m_file << (i > 0 ? ", " : "") << '"' << names[i] << "\": " << values[i];
+    }
+  }
+
+  std::ofstream m_file;
+  std::vector<std::string> m_stageNames;
+  std::vector<std::string> m_counterNames;
+  Format m_format;
+  std::mutex m_mutex{};
+};
+
+} // namespace mlutils
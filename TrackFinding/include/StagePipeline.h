@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief A pool of worker threads with one task queue per worker
+ *
+ * Tasks that are submitted from a worker go into its own queue, all others are
+ * distributed round robin. Workers take the newest task of their own queue
+ * first and steal the oldest task of another queue if theirs is empty. A task
+ * that continues the work of the previous one (e.g. the next stage of the same
+ * event) is hence usually run by the same worker, while the data is still in
+ * its cache.
+ */
+class TaskPool {
+public:
+  explicit TaskPool(unsigned numThreads) {
+    numThreads = std::max(numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; ++i) {
+      m_queues.push_back(std::make_unique<Queue>());
+    }
+    m_workers.reserve(numThreads);
+    for (unsigned i = 0; i < numThreads; ++i) {
+      m_workers.emplace_back([this, i]() { work(i); });
+    }
+  }
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+  TaskPool(TaskPool&&) = delete;
+  TaskPool& operator=(TaskPool&&) = delete;
+
+  /// Runs all tasks that have already been submitted before joining the
+  /// workers
+  ~TaskPool() {
+    {
+      std::lock_guard lock{m_sleepMutex};
+      m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    m_workers.clear();
+  }
+
+  unsigned numThreads() const { return static_cast<unsigned>(m_workers.size()); }
+
+  /// Run a task on one of the workers. Tasks must not throw
+  void submit(std::function<void()> task) {
+    const auto iQueue =
+        t_pool == this ? t_worker : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    {
+      std::lock_guard lock{m_queues[iQueue]->mutex};
+      m_queues[iQueue]->tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard lock{m_sleepMutex};
+      ++m_pending;
+    }
+    m_wakeUp.notify_one();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex{};
+    std::deque<std::function<void()>> tasks{};
+  };
+
+  bool tryPop(std::size_t worker, std::function<void()>& task) {
+    {
+      auto& own = *m_queues[worker];
+      std::lock_guard lock{own.mutex};
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (std::size_t i = 1; i < m_queues.size(); ++i) {
+      auto& other = *m_queues[(worker + i) % m_queues.size()];
+      std::lock_guard lock{other.mutex};
+      if (!other.tasks.empty()) {
+        task = std::move(other.tasks.front());
+        other.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(std::size_t worker) {
+    t_pool = this;
+    t_worker = worker;
+    std::function<void()> task{};
+    while (true) {
+      if (tryPop(worker, task)) {
+        {
+          std::lock_guard lock{m_sleepMutex};
+          --m_pending;
+        }
+        task();
+        task = nullptr;
+        continue;
+      }
+      // A task can be counted as pending before it is in a queue, in which
+      // case this returns right away and the queues are tried again
+      std::unique_lock lock{m_sleepMutex};
+      m_wakeUp.wait(lock, [this]() { return m_stop || m_pending > 0; });
+      if (m_stop && m_pending <= 0) {
+        return;
+      }
+    }
+  }
+
+  static inline thread_local const TaskPool* t_pool{nullptr};
+  static inline thread_local std::size_t t_worker{0};
+
+  std::vector<std::unique_ptr<Queue>> m_queues{};
+  std::atomic<std::size_t> m_nextQueue{0};
+  std::mutex m_sleepMutex{};
+  std::condition_variable m_wakeUp{};
+  /// Submitted tasks that have not been taken from a queue yet. Can briefly be
+  /// negative, as a task can be taken before it is counted
+  std::ptrdiff_t m_pending{0};
+  bool m_stop{false};
+  // Last, such that the workers are joined before the queues are destroyed
+  std::vector<std::jthread> m_workers{};
+};
+
+/**
+ * @brief Run events through a fixed sequence of stages, with the stages of
+ * different events overlapping
+ *
+ * Every stage of every event is a task on a (shared) TaskPool. As soon as an
+ * event has passed a stage, it enters the next one, such that e.g. the
+ * embedding of the next event runs while the edges of the current one are
+ * classified. Each stage processes at most maxConcurrency events at once and
+ * takes the waiting events in the order in which they arrived, i.e. with a
+ * concurrency of one the events pass that stage in the order in which they
+ * have been pushed.
+ *
+ * The events live in a fixed number of slots, which bounds the number of
+ * events in flight and with that the memory. push blocks until a slot is
+ * free. The data of an event (e.g. its buffers) should be kept in EventT,
+ * such that it is re-used by the later events of the slot. After the last
+ * stage, finish takes the result out of the event and the slot is freed.
+ *
+ * @note push must not be called from a task of the same pool, as it blocks
+ * until other tasks have finished.
+ */
+template <typename EventT, typename ResultT>
+class StagePipeline {
+public:
+  struct Stage {
+    /// Run the stage on an event. Has to be safe to call concurrently for
+    /// different events if maxConcurrency is larger than one
+    std::function<void(EventT&)> run{};
+    /// Maximum number of events that are in this stage at the same time
+    unsigned maxConcurrency{1};
+  };
+  using FinishFunc = std::function<ResultT(EventT&)>;
+
+  /**
+   * @param finish      Called for every event after its last stage to get
+   *                    its result
+   * @param maxInFlight The number of slots, i.e. the maximum number of events
+   *                    in the pipeline
+   *
+   * @throws std::invalid_argument if there are no stages or no slots
+   */
+  StagePipeline(TaskPool& pool, std::vector<Stage> stages, FinishFunc finish, std::size_t maxInFlight)
+      : m_pool(pool), m_stages(std::move(stages)), m_finish(std::move(finish)), m_stageStates(m_stages.size()),
+        m_slots(maxInFlight) {
+    if (m_stages.empty() || maxInFlight == 0) {
+      throw std::invalid_argument("A pipeline needs at least one stage and one event in flight");
+    }
+    for (auto& stage : m_stages) {
+      stage.maxConcurrency = std::max(stage.maxConcurrency, 1u);
+    }
+    for (std::size_t slot = maxInFlight; slot > 0; --slot) {
+      m_freeSlots.push_back(slot - 1);
+    }
+  }
+
+  StagePipeline(const StagePipeline&) = delete;
+  StagePipeline& operator=(const StagePipeline&) = delete;
+  StagePipeline(StagePipeline&&) = delete;
+  StagePipeline& operator=(StagePipeline&&) = delete;
+
+  /// Waits for the events in flight, as their tasks refer to the pipeline
+  ~StagePipeline() {
+    std::unique_lock lock{m_mutex};
+    m_slotFreed.wait(lock, [this]() { return m_freeSlots.size() == m_slots.size(); });
+  }
+
+  std::size_t maxInFlight() const { return m_slots.size(); }
+
+  /**
+   * @brief Start an event once a slot is free
+   *
+   * setup is called with the event of the slot on the calling thread, e.g. to
+   * read the event, before the first stage is started. If a stage (or finish)
+   * throws, the remaining stages of the event are skipped and the future
+   * holds the exception. Other events are not affected.
+   *
+   * @returns The result of the event once it has passed all stages
+   * @throws The exceptions of setup, in which case the event is not started
+   */
+  template <typename SetupFunc>
+  std::future<ResultT> push(SetupFunc&& setup) {
+    std::unique_lock lock{m_mutex};
+    m_slotFreed.wait(lock, [this]() { return !m_freeSlots.empty(); });
+    const auto slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    lock.unlock();
+
+    auto& state = m_slots[slot];
+    try {
+      std::forward<SetupFunc>(setup)(state.event);
+    } catch (...) {
+      lock.lock();
+      m_freeSlots.push_back(slot);
+      m_slotFreed.notify_all();
+      throw;
+    }
+    state.result = std::promise<ResultT>{};
+    state.error = nullptr;
+    auto result = state.result.get_future();
+
+    lock.lock();
+    enter(0, slot);
+    return result;
+  }
+
+private:
+  struct Slot {
+    EventT event{};
+    std::promise<ResultT> result{};
+    std::exception_ptr error{nullptr};
+  };
+  struct StageState {
+    std::deque<std::size_t> waiting{};
+    unsigned running{0};
+  };
+
+  /// Let an event enter a stage or queue it there. Needs the lock
+  void enter(std::size_t stage, std::size_t slot) {
+    auto& state = m_stageStates[stage];
+    if (state.running < m_stages[stage].maxConcurrency) {
+      ++state.running;
+      m_pool.submit([this, stage, slot]() { run(stage, slot); });
+    } else {
+      state.waiting.push_back(slot);
+    }
+  }
+
+  void run(std::size_t stage, std::size_t slot) {
+    auto& current = m_slots[slot];
+    try {
+      m_stages[stage].run(current.event);
+    } catch (...) {
+      current.error = std::current_exception();
+    }
+
+    std::unique_lock lock{m_mutex};
+    auto& state = m_stageStates[stage];
+    if (state.waiting.empty()) {
+      --state.running;
+    } else {
+      const auto next = state.waiting.front();
+      state.waiting.pop_front();
+      m_pool.submit([this, stage, next]() { run(stage, next); });
+    }
+    if (stage + 1 < m_stages.size() && !current.error) {
+      enter(stage + 1, slot);
+      return;
+    }
+    lock.unlock();
+    finish(slot);
+  }
+
+  /// Hand out the result of an event and free its slot
+  void finish(std::size_t slot) {
+    auto& current = m_slots[slot];
+    auto result = std::move(current.result);
+    std::optional<ResultT> value{};
+    if (!current.error) {
+      try {
+        value.emplace(m_finish(current.event));
+      } catch (...) {
+        current.error = std::current_exception();
+      }
+    }
+    auto error = std::exchange(current.error, nullptr);
+
+    // The slot can be re-used (and the pipeline destroyed) as soon as it is
+    // free, hence the result is only set afterwards
+    {
+      std::lock_guard lock{m_mutex};
+      m_freeSlots.push_back(slot);
+      m_slotFreed.notify_all();
+    }
+    if (error) {
+      result.set_exception(error);
+    } else {
+      result.set_value(std::move(*value));
+    }
+  }
+
+  TaskPool& m_pool;
+  std::vector<Stage> m_stages;
+  FinishFunc m_finish;
+  std::vector<StageState> m_stageStates;
+  std::vector<Slot> m_slots;
+
+  std::mutex m_mutex{};
+  std::condition_variable m_slotFreed{};
+  std::vector<std::size_t> m_freeSlots{};
+};
+
+} // namespace mlutils
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mlutils {
+
+/**
+ * @brief Union-find (disjoint set) structure that can be updated concurrently
+ * from several threads without locks
+ *
+ * Roots are always linked below the smaller of the two roots, such that the
+ * root of every set is its smallest element. The paths are shortened by path
+ * halving in find. All updates only ever redirect an element to one of its
+ * (current) ancestors, which is why relaxed memory ordering is sufficient: a
+ * stale parent is still an ancestor and linking a root only succeeds if it
+ * still is a root. The results have to be read after all threads that update
+ * the structure have been joined.
+ */
+class ConcurrentUnionFind {
+public:
+  explicit ConcurrentUnionFind(std::size_t numElements) : m_parent(numElements) {
+    assert(numElements <= std::numeric_limits<std::uint32_t>::max());
+    for (std::size_t i = 0; i < numElements; ++i) {
+      m_parent[i].store(static_cast<std::uint32_t>(i), std::memory_order_relaxed);
+    }
+  }
+
+  std::size_t size() const { return m_parent.size(); }
+
+  /// The root of the set of an element, i.e. its smallest element
+  std::uint32_t find(std::uint32_t element) {
+    auto parent = m_parent[element].load(std::memory_order_relaxed);
+    while (parent != element) {
+      const auto grandParent = m_parent[parent].load(std::memory_order_relaxed);
+      // Path halving. If this fails, another thread has already moved the
+      // element further up
+      m_parent[element].compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+      element = grandParent;
+      parent = m_parent[element].load(std::memory_order_relaxed);
+    }
+    return element;
+  }
+
+  /// Merge the sets of two elements
+  void unite(std::uint32_t a, std::uint32_t b) {
+    while (true) {
+      a = find(a);
+      b = find(b);
+      if (a == b) {
+        return;
+      }
+      if (a > b) {
+        std::swap(a, b);
+      }
+      // Link the larger root below the smaller one, unless another thread has
+      // linked it in the meantime
+      auto expected = b;
+      if (m_parent[b].compare_exchange_strong(expected, a, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+private:
+  std::vector<std::atomic<std::uint32_t>> m_parent;
+};
+
+/**
+ * @brief Track building from the classified edges of a graph via connected
+ * components
+ *
+ * The edges that pass the score cut are merged in a ConcurrentUnionFind,
+ * directly from the flat [2, numEdges] edge index (split over several threads
+ * for large graphs). The candidates are then collected in a single pass over
+ * the nodes. They are ordered by their smallest node and contain the nodes in
+ * ascending order, like the components of a connected components search that
+ * visits the nodes in order. Single nodes are candidates as well.
+ *
+ * Optionally, junctions can be split before: A hit of a track is connected to
+ * at most two other hits of it, so every node only keeps its two highest
+ * scoring edges and an edge is only used if both of its nodes keep it. The
+ * candidates are then chains of hits. This needs no direction of the edges, but
+ * it is done on a single thread.
+ */
+class UnionFindTrackBuilder {
+public:
+  struct Config {
+    /// Only edges with at least this score are used (default: all)
+    float scoreCut{std::numeric_limits<float>::lowest()};
+    /// Only keep the two best edges of each node
+    bool splitJunctions{false};
+    /// Maximum number of threads for merging the edges
+    unsigned numThreads{1};
+    /// Minimum number of edges per thread
+    std::size_t minEdgesPerThread{50000};
+  };
+
+  UnionFindTrackBuilder() = default;
+  explicit UnionFindTrackBuilder(const Config& config) : m_config(config) {}
+
+  const Config& config() const { return m_config; }
+
+  /**
+   * @brief Build the track candidates
+   *
+   * @param edgeIndex The edges as [2, numEdges]
+   * @param scores    The score of each edge (empty: all edges pass)
+   * @param nodeIds   The ids of the nodes (e.g. hit indices) that are put into
+   *                  the candidates. Also defines the number of nodes
+   *
+   * @throws std::invalid_argument if the scores do not match the edges or an
+   * edge points to a non-existing node
+   */
+  template <typename IdType>
+  std::vector<std::vector<IdType>> build(std::span<const std::int64_t> edgeIndex, std::span<const float> scores,
+                                         std::span<const IdType> nodeIds) const;
+
+private:
+  /// The indices of the edges that are kept when splitting junctions
+  std::vector<std::uint32_t> junctionFreeEdges(std::span<const std::int64_t> source,
+                                               std::span<const std::int64_t> target,
+                                               std::span<const float> scores, std::size_t numNodes) const;
+
+  Config m_config{};
+};
+
+template <typename IdType>
+std::vector<std::vector<IdType>> UnionFindTrackBuilder::build(std::span<const std::int64_t> edgeIndex,
+                                                              std::span<const float> scores,
+                                                              std::span<const IdType> nodeIds) const {
+  const auto numNodes = nodeIds.size();
+  const auto numEdges = edgeIndex.size() / 2;
+  if (!scores.empty() && scores.size() != numEdges) {
+    throw std::invalid_argument("The number of scores does not match the number of edges");
+  }
+  if (numNodes > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument("Track building is limited to 2^32 nodes");
+  }
+  const auto source = edgeIndex.first(numEdges);
+  const auto target = edgeIndex.subspan(numEdges, numEdges);
+  for (const auto node : edgeIndex) {
+    if (node < 0 || static_cast<std::size_t>(node) >= numNodes) {
+      throw std::invalid_argument("Edge to a node that does not exist");
+    }
+  }
+
+  ConcurrentUnionFind unionFind{numNodes};
+  if (m_config.splitJunctions) {
+    for (const auto edge : junctionFreeEdges(source, target, scores, numNodes)) {
+      unionFind.unite(source[edge], target[edge]);
+    }
+  } else {
+    auto mergeRange = [&](std::size_t begin, std::size_t end) {
+      for (auto edge = begin; edge < end; ++edge) {
+        if (scores.empty() || scores[edge] >= m_config.scoreCut) {
+          unionFind.unite(source[edge], target[edge]);
+        }
+      }
+    };
+    const auto numRanges = std::clamp<std::size_t>(numEdges / std::max<std::size_t>(m_config.minEdgesPerThread, 1), 1,
+                                                   std::max(m_config.numThreads, 1u));
+    const auto rangeSize = (numEdges + numRanges - 1) / numRanges;
+    {
+      std::vector<std::jthread> threads{};
+      threads.reserve(numRanges - 1);
+      for (std::size_t iRange = 1; iRange < numRanges; ++iRange) {
+        threads.emplace_back(mergeRange, std::min(iRange * rangeSize, numEdges),
+                             std::min((iRange + 1) * rangeSize, numEdges));
+      }
+      mergeRange(0, std::min(rangeSize, numEdges));
+    }
+  }
+
+  // The root of each set is its smallest node, i.e. it is visited before all
+  // other nodes of the set and the candidates are labelled in order
+  std::vector<std::uint32_t> labels(numNodes);
+  std::vector<std::uint32_t> sizes{};
+  for (std::uint32_t node = 0; node < numNodes; ++node) {
+    const auto root = unionFind.find(node);
+    if (root == node) {
+      labels[node] = static_cast<std::uint32_t>(sizes.size());
+      sizes.push_back(0);
+    } else {
+      labels[node] = labels[root];
+    }
+    ++sizes[labels[node]];
+  }
+
+  std::vector<std::vector<IdType>> candidates(sizes.size());
+  for (std::size_t label = 0; label < sizes.size(); ++label) {
+    candidates[label].reserve(sizes[label]);
+  }
+  for (std::size_t node = 0; node < numNodes; ++node) {
+    candidates[labels[node]].push_back(nodeIds[node]);
+  }
+  return candidates;
+}
+
+inline std::vector<std::uint32_t> UnionFindTrackBuilder::junctionFreeEdges(std::span<const std::int64_t> source,
+                                                                           std::span<const std::int64_t> target,
+                                                                           std::span<const float> scores,
+                                                                           std::size_t numNodes) const {
+  constexpr auto noEdge = std::numeric_limits<std::uint32_t>::max();
+  const auto numEdges = source.size();
+  auto score = [&](std::uint32_t edge) { return scores.empty() ? 1.f : scores[edge]; };
+
+  // The two best edges of each node. Ties are resolved in favour of the
+  // earlier edge, to be independent of the order of the comparisons
+  std::vector<std::array<std::uint32_t, 2>> best(numNodes, {noEdge, noEdge});
+  auto better = [&](std::uint32_t edge, std::uint32_t other) {
+    return other == noEdge || score(edge) > score(other) || (score(edge) == score(other) && edge < other);
+  };
+  auto offer = [&](std::int64_t node, std::uint32_t edge) {
+    auto& [first, second] = best[node];
+    if (better(edge, first)) {
+      second = first;
+      first = edge;
+    } else if (better(edge, second)) {
+      second = edge;
+    }
+  };
+  for (std::uint32_t edge = 0; edge < numEdges; ++edge) {
+    if (score(edge) < m_config.scoreCut || source[edge] == target[edge]) {
+      continue;
+    }
+    offer(source[edge], edge);
+    offer(target[edge], edge);
+  }
+
+  auto keeps = [&](std::int64_t node, std::uint32_t edge) { return best[node][0] == edge || best[node][1] == edge; };
+  std::vector<std::uint32_t> kept{};
+  for (std::uint32_t edge = 0; edge < numEdges; ++edge) {
+    if (source[edge] != target[edge] && keeps(source[edge], edge) && keeps(target[edge], edge)) {
+      kept.push_back(edge);
+    }
+  }
+  return kept;
+}
+
+/**
+ * @brief The classified edges of one event, e.g. for benchmarking the track
+ * building on recorded events
+ */
+struct RecordedGraph {
+  std::size_t numNodes{0};
+  /// [2, numEdges]
+  std::vector<std::int64_t> edgeIndex{};
+  std::vector<float> scores{};
+
+  std::size_t numEdges() const { return edgeIndex.size() / 2; }
+};
+
+/// Append a graph to a binary stream
+inline void writeGraph(std::ostream& stream, const RecordedGraph& graph) {
+  const std::array<std::uint64_t, 3> header = {graph.numNodes, graph.numEdges(), graph.scores.size()};
+  stream.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+  stream.write(reinterpret_cast<const char*>(graph.edgeIndex.data()),
+               static_cast<std::streamsize>(graph.edgeIndex.size() * sizeof(std::int64_t)));
+  stream.write(reinterpret_cast<const char*>(graph.scores.data()),
+               static_cast<std::streamsize>(graph.scores.size() * sizeof(float)));
+}
+
+/// Read all graphs of a binary stream that has been written by writeGraph
+/// @throws std::runtime_error for a truncated stream
+inline std::vector<RecordedGraph> readGraphs(std::istream& stream) {
+  std::vector<RecordedGraph> graphs{};
+  std::array<std::uint64_t, 3> header{};
+  while (stream.read(reinterpret_cast<char*>(header.data()), sizeof(header))) {
+    auto& graph = graphs.emplace_back();
+    graph.numNodes = header[0];
+    graph.edgeIndex.resize(2 * header[1]);
+    graph.scores.resize(header[2]);
+    stream.read(reinterpret_cast<char*>(graph.edgeIndex.data()),
+                static_cast<std::streamsize>(graph.edgeIndex.size() * sizeof(std::int64_t)));
+    stream.read(reinterpret_cast<char*>(graph.scores.data()),
+                static_cast<std::streamsize>(graph.scores.size() * sizeof(float)));
+    if (!stream) {
+      throw std::runtime_error("Truncated graph record");
+    }
+  }
+  return graphs;
+}
+
+} // namespace mlutils
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mlutils {
+
+/// The number of candidates with at least minHits hits
+template <typename IdType>
+std::size_t countAcceptedCandidates(const std::vector<std::vector<IdType>>& candidates, std::size_t minHits) {
+  std::size_t numAccepted = 0;
+  for (const auto& candidate : candidates) {
+    numAccepted += candidate.size() >= minHits;
+  }
+  return numAccepted;
+}
+
+/**
+ * @brief Create one track for each candidate with at least minHits hits, with
+ * its hits and a copy of the given track state
+ *
+ * If the track collection supports it, the accepted candidates are counted
+ * first and the collection is reserved once. The hits are taken from the
+ * (global) hit view via the indices of the candidates. onTrack is called with
+ * the index of each new track (in this call) and its candidate, e.g. to
+ * monitor only the tracks that are actually put into the output.
+ *
+ * @returns The number of created tracks
+ */
+template <typename IdType, typename HitViewT, typename TrackStateT, typename TrackCollT, typename OnTrackFunc>
+std::size_t fillTracks(const std::vector<std::vector<IdType>>& candidates, std::size_t minHits, const HitViewT& hits,
+                       const TrackStateT& trackState, TrackCollT& tracks, OnTrackFunc&& onTrack) {
+  if constexpr (requires { tracks.reserve(std::size_t{}); }) {
+    tracks.reserve(tracks.size() + countAcceptedCandidates(candidates, minHits));
+  }
+  std::size_t numTracks = 0;
+  for (const auto& candidate : candidates) {
+    if (candidate.size() < minHits) {
+      continue;
+    }
+    auto track = tracks.create();
+    for (const auto idx : candidate) {
+      track.addToTrackerHits(hits[idx]);
+    }
+    track.addToTrackStates(trackState);
+    onTrack(numTracks++, candidate);
+  }
+  return numTracks;
+}
+
+template <typename IdType, typename HitViewT, typename TrackStateT, typename TrackCollT>
+std::size_t fillTracks(const std::vector<std::vector<IdType>>& candidates, std::size_t minHits, const HitViewT& hits,
+                       const TrackStateT& trackState, TrackCollT& tracks) {
+  return fillTracks(candidates, minHits, hits, trackState, tracks, [](std::size_t, const std::vector<IdType>&) {});
+}
+
+} // namespace mlutils
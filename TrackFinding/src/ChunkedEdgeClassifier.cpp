@@ -0,0 +1,153 @@
+#include "ChunkedEdgeClassifier.h"
+#include "StageMonitoring.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+/// Copy the given rows of a [numRows, numColumns] tensor into a new tensor
+ActsPlugins::Tensor<float> gatherRows(const ActsPlugins::Tensor<float>& tensor, std::span<const std::uint32_t> rows,
+                                      const ActsPlugins::ExecutionContext& execContext) {
+  const auto numColumns = tensor.shape()[1];
+  auto result = ActsPlugins::Tensor<float>::Create({rows.size(), numColumns}, execContext);
+  for (std::size_t i = 0; i < rows.size(); ++i) {
+    std::copy_n(tensor.data() + rows[i] * numColumns, numColumns, result.data() + i * numColumns);
+  }
+  return result;
+}
+
+/// Append a row of a [numRows, numColumns] tensor to a flat buffer
+void appendRow(const ActsPlugins::Tensor<float>& tensor, std::size_t row, std::vector<float>& buffer) {
+  const auto numColumns = tensor.shape()[1];
+  const auto* begin = tensor.data() + row * numColumns;
+  buffer.insert(buffer.end(), begin, begin + numColumns);
+}
+
+ActsPlugins::Tensor<float> toTensor(const std::vector<float>& buffer, std::size_t numRows, std::size_t numColumns,
+                                    const ActsPlugins::ExecutionContext& execContext) {
+  auto tensor = ActsPlugins::Tensor<float>::Create({numRows, numColumns}, execContext);
+  std::ranges::copy(buffer, tensor.data());
+  return tensor;
+}
+} // namespace
+
+ChunkedEdgeClassifier::ChunkedEdgeClassifier(std::shared_ptr<ActsPlugins::EdgeClassificationBase> classifier,
+                                             const mlutils::EdgeChunkingConfig& config,
+                                             std::unique_ptr<const Acts::Logger> lggr)
+    : m_classifier(std::move(classifier)), m_config(config), m_logger(std::move(lggr)) {
+  m_config.validate();
+  if (m_config.enabled()) {
+    ACTS_INFO(fmt::format("Classifying edges in chunks of at most {:.1f} MB (estimated) with {} halo hops",
+                          m_config.memoryBudgetBytes / (1024. * 1024.), m_config.haloHops));
+  }
+}
+
+ActsPlugins::PipelineTensors ChunkedEdgeClassifier::operator()(ActsPlugins::PipelineTensors tensors,
+                                                               const ActsPlugins::ExecutionContext& execContext) {
+  return (*this)(std::move(tensors), execContext, nullptr);
+}
+
+ActsPlugins::PipelineTensors ChunkedEdgeClassifier::operator()(ActsPlugins::PipelineTensors tensors,
+                                                               const ActsPlugins::ExecutionContext& execContext,
+                                                               Stats* stats) {
+  const auto numNodes = tensors.nodeFeatures.shape()[0];
+  const auto numEdges = tensors.edgeIndex.shape()[1];
+  const auto totalBytes = m_config.estimateBytes(numNodes, numEdges);
+  if (m_config.fits(totalBytes)) {
+    auto result = (*m_classifier)(std::move(tensors), execContext);
+    if (stats) {
+      *stats = Stats{.numChunks = 1,
+                     .maxChunkBytes = totalBytes,
+                     .numClassifiedEdges = numEdges,
+                     .peakRssKb = mlutils::currentRssKb()};
+    }
+    return result;
+  }
+  if (execContext.device.type != ActsPlugins::Device::Type::eCPU) {
+    throw std::runtime_error("The chunked edge classification is only implemented for tensors on the CPU");
+  }
+
+  Stats chunkStats{};
+  mlutils::EdgeChunker chunker(numNodes, std::span(tensors.edgeIndex.data(), tensors.edgeIndex.size()), m_config);
+  mlutils::EdgeChunk chunk{};
+  // The edges (in global node indices) that pass the classifier
+  std::vector<std::int64_t> sources{};
+  std::vector<std::int64_t> targets{};
+  std::vector<float> scores{};
+  std::optional<std::size_t> scoreColumns{};
+  std::vector<float> edgeFeatures{};
+  std::optional<std::size_t> edgeFeatureColumns{};
+
+  while (chunker.next(chunk)) {
+    ++chunkStats.numChunks;
+    chunkStats.maxChunkBytes = std::max(chunkStats.maxChunkBytes, chunk.estimatedBytes);
+    chunkStats.numOversizedChunks += !m_config.fits(chunk.estimatedBytes);
+    chunkStats.numClassifiedEdges += chunk.numEdges();
+    if (chunk.numEdges() == 0) {
+      continue;
+    }
+
+    auto chunkEdgeIndex = ActsPlugins::Tensor<std::int64_t>::Create({2, chunk.numEdges()}, execContext);
+    std::ranges::copy(chunk.edgeIndex, chunkEdgeIndex.data());
+    std::optional<ActsPlugins::Tensor<float>> chunkEdgeFeatures{};
+    if (tensors.edgeFeatures) {
+      chunkEdgeFeatures = gatherRows(*tensors.edgeFeatures, chunk.edges, execContext);
+    }
+    auto result = (*m_classifier)({gatherRows(tensors.nodeFeatures, chunk.nodes, execContext),
+                                   std::move(chunkEdgeIndex), std::move(chunkEdgeFeatures), std::nullopt},
+                                  execContext);
+    chunkStats.peakRssKb = std::max(chunkStats.peakRssKb, mlutils::currentRssKb());
+
+    // Only keep the edges that belong to this chunk
+    const auto numKept = result.edgeIndex.shape()[1];
+    const auto* kept = result.edgeIndex.data();
+    for (std::size_t i = 0; i < numKept; ++i) {
+      if (!chunk.isCoreNode(kept[i])) {
+        continue;
+      }
+      sources.push_back(chunk.nodes[kept[i]]);
+      targets.push_back(chunk.nodes[kept[numKept + i]]);
+      if (result.edgeScores) {
+        scoreColumns = result.edgeScores->shape()[1];
+        appendRow(*result.edgeScores, i, scores);
+      }
+      if (result.edgeFeatures) {
+        edgeFeatureColumns = result.edgeFeatures->shape()[1];
+        appendRow(*result.edgeFeatures, i, edgeFeatures);
+      }
+    }
+  }
+  ACTS_DEBUG(fmt::format("Classified {} edges in {} chunks ({} edges including the halos), {} edges pass", numEdges,
+                         chunkStats.numChunks, chunkStats.numClassifiedEdges, sources.size()));
+  if (chunkStats.numOversizedChunks > 0) {
+    ACTS_WARNING(fmt::format("{} chunks with a single core node exceed the memory budget (largest: {:.1f} MB)",
+                             chunkStats.numOversizedChunks, chunkStats.maxChunkBytes / (1024. * 1024.)));
+  }
+  if (stats) {
+    *stats = chunkStats;
+  }
+
+  const auto numPassed = sources.size();
+  auto edgeIndex = ActsPlugins::Tensor<std::int64_t>::Create({2, numPassed}, execContext);
+  std::ranges::copy(sources, edgeIndex.data());
+  std::ranges::copy(targets, edgeIndex.data() + numPassed);
+  std::optional<ActsPlugins::Tensor<float>> outputEdgeFeatures{};
+  if (edgeFeatureColumns) {
+    outputEdgeFeatures = toTensor(edgeFeatures, numPassed, *edgeFeatureColumns, execContext);
+  }
+  // Also give an event without passing edges (empty) scores, as the
+  // classifier would have done
+  std::optional<ActsPlugins::Tensor<float>> outputScores{};
+  if (scoreColumns || numPassed == 0) {
+    outputScores = toTensor(scores, numPassed, scoreColumns.value_or(1), execContext);
+  }
+  return {std::move(tensors.nodeFeatures), std::move(edgeIndex), std::move(outputEdgeFeatures),
+          std::move(outputScores)};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "EdgeChunking.h"
+
+#include <Acts/Utilities/Logger.hpp>
+#if __has_include("ActsPlugins/Gnn/Stages.hpp")
+#include <ActsPlugins/Gnn/Stages.hpp>
+#include <ActsPlugins/Gnn/Tensor.hpp>
+#else
+#include <Acts/Plugins/Gnn/Stages.hpp>
+#include <Acts/Plugins/Gnn/Tensor.hpp>
+namespace ActsPlugins {
+using Device = Acts::Device;
+using EdgeClassificationBase = Acts::EdgeClassificationBase;
+using ExecutionContext = Acts::ExecutionContext;
+using PipelineTensors = Acts::PipelineTensors;
+template <typename T>
+using Tensor = Acts::Tensor<T>;
+} // namespace ActsPlugins
+#endif
+
+#include <cstddef>
+#include <memory>
+
+/**
+ * @brief Edge classification that runs another edge classifier on chunks of
+ * the graph, in order to bound the memory that its inference needs
+ *
+ * The graph is split by an mlutils::EdgeChunker. Every chunk is classified on
+ * its own and only the edges that belong to it are kept, such that every edge
+ * of the graph is classified exactly once. The message passing of a GNN only
+ * sees the nodes of a chunk, i.e. the results are identical to classifying the
+ * whole graph at once only if the halo of the chunks spans more hops than the
+ * GNN has message passing steps. Otherwise this is an approximation, which
+ * misses the messages from further away.
+ *
+ * Graphs that fit into the memory budget (or no budget) are passed to the
+ * wrapped classifier as they are.
+ */
+class ChunkedEdgeClassifier final : public ActsPlugins::EdgeClassificationBase {
+public:
+  /// Statistics of classifying one graph
+  struct Stats {
+    std::size_t numChunks{0};
+    /// Estimated memory of the largest chunk
+    std::size_t maxChunkBytes{0};
+    /// Number of chunks that do not fit into the budget, even though they
+    /// only have a single core node
+    std::size_t numOversizedChunks{0};
+    /// Sum of the edges of all chunks, i.e. including the edges that are
+    /// only there for the context
+    std::size_t numClassifiedEdges{0};
+    /// Largest current RSS of the process after the classification of a chunk
+    long peakRssKb{0};
+  };
+
+  ChunkedEdgeClassifier(std::shared_ptr<ActsPlugins::EdgeClassificationBase> classifier,
+                        const mlutils::EdgeChunkingConfig& config, std::unique_ptr<const Acts::Logger> logger);
+
+  ActsPlugins::PipelineTensors operator()(ActsPlugins::PipelineTensors tensors,
+                                          const ActsPlugins::ExecutionContext& execContext = {}) override;
+
+  /// Same as above, but fills the statistics of the chunking
+  ActsPlugins::PipelineTensors operator()(ActsPlugins::PipelineTensors tensors,
+                                          const ActsPlugins::ExecutionContext& execContext, Stats* stats);
+
+  const mlutils::EdgeChunkingConfig& config() const { return m_config; }
+
+private:
+  std::shared_ptr<ActsPlugins::EdgeClassificationBase> m_classifier;
+  mlutils::EdgeChunkingConfig m_config;
+
+  const auto& logger() const { return *m_logger; }
+  std::unique_ptr<const Acts::Logger> m_logger{nullptr};
+};
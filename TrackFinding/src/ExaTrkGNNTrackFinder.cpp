@@ -1,130 +1,268 @@
 #include "ExaTrkGNNTrackFinder.h"
 
-#include "OnnxMetricLearning.h"
-
-#if __has_include("ActsPlugins/Gnn/Stages.hpp")
-#include <ActsPlugins/Gnn/BoostTrackBuilding.hpp>
-#include <ActsPlugins/Gnn/GnnPipeline.hpp>
-#include <ActsPlugins/Gnn/OnnxEdgeClassifier.hpp>
-#include <ActsPlugins/Gnn/Stages.hpp>
-#else
-#include <Acts/Plugins/Gnn/BoostTrackBuilding.hpp>
-#include <Acts/Plugins/Gnn/GnnPipeline.hpp>
-#include <Acts/Plugins/Gnn/OnnxEdgeClassifier.hpp>
-#include <Acts/Plugins/Gnn/Stages.hpp>
-namespace ActsPlugins {
-using BoostTrackBuilding = Acts::BoostTrackBuilding;
-using Device = Acts::Device;
-using EdgeClassificationBase = Acts::EdgeClassificationBase;
-using GnnPipeline = Acts::GnnPipeline;
-using OnnxEdgeClassifier = Acts::OnnxEdgeClassifier;
-} // namespace ActsPlugins
-#endif
-
 #include <k4ActsTracking/ActsGaudiLogger.h>
 
-#include <Math/PositionVector3D.h>
-
 #include <fmt/format.h>
 
 #include <algorithm>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <sstream>
+#include <utility>
 
 namespace {
-std::vector<float> extractHitInformation(const edm4hep::TrackerHitPlaneCollection& hits) {
-  // Could use a std::array here, but that would make switching between 3D and
-  // 4D a bit more cumbersome
-  std::vector<std::vector<float>> embeddingInputs{};
-  embeddingInputs.reserve(hits.size());
+using Chain = GNNTrackFindingChain;
 
-  for (const auto hit : hits) {
-    const auto position = ROOT::Math::XYZPointF(hit.getPosition().x, hit.getPosition().y, hit.getPosition().z);
-
-    std::vector<float> hitInfo = {position.r(), position.phi(), position.z(), hit.getTime()};
-    embeddingInputs.emplace_back(std::move(hitInfo));
+/// Convert a [min, max] range property into the bounds of a cut. An empty
+/// range leaves the bounds unchanged
+/// @throws std::invalid_argument if the range does not have two values
+template <typename T>
+void setRange(const std::vector<T>& range, float& min, float& max) {
+  if (range.empty()) {
+    return;
+  }
+  if (range.size() != 2) {
+    throw std::invalid_argument(fmt::format("Expected a [min, max] range, but got {} values", range.size()));
   }
-  return mlutils::flatten(embeddingInputs);
+  min = static_cast<float>(range[0]);
+  max = static_cast<float>(range[1]);
 }
 } // namespace
 
 ExaTrkGNNTrackFinder::ExaTrkGNNTrackFinder(const std::string& name, ISvcLocator* svcLoc)
     : Transformer(name, svcLoc, {KeyValues("InputHitCollections", {"populate-me-properly"})},
-                  {KeyValues("OutputTrackCandidates", {"ExaTrkGNNTrackCands"})}) {}
+                  {KeyValues("OutputTrackCandidates", {"ExaTrkGNNTrackCands"})}) {
+  for (const auto stage : Chain::StageNames) {
+    m_stageTimes.emplace_back(this, fmt::format("{} time [ms]", stage));
+    m_stageRssChange.emplace_back(this, fmt::format("{} RSS change [MB]", stage));
+    m_stageTimesVsHits.emplace_back(this, fmt::format("{}TimeVsHits", stage),
+                                    fmt::format("Time of {} vs number of hits;hits;time [ms]", stage),
+                                    Gaudi::Accumulators::Axis<double>{100, 0., 200000.},
+                                    Gaudi::Accumulators::Axis<double>{100, 0., 1000.});
+  }
+  for (const auto counter : Chain::CounterNames) {
+    m_eventCounters.emplace_back(this, fmt::format("{} per event", counter));
+  }
+}
 
 StatusCode ExaTrkGNNTrackFinder::initialize() {
   m_logger = makeActsGaudiLogger(this);
   m_monitoringHist.createHistogram(*this);
+  for (auto& hist : m_stageTimesVsHits) {
+    hist.createHistogram(*this);
+  }
 
-  auto graphConstructor =
-      std::make_shared<OnnxMetricLearning>(OnnxMetricLearning::Config{.modelPath = m_nodeEmbeddingModelPath.value(),
-                                                                      .embeddingDim = m_embeddingDim.value(),
-                                                                      .rVal = m_edgeBuildingRadius.value(),
-                                                                      .knnVal = m_edgeBuildingKnn.value()},
-                                           m_logger->clone(name() + ".MetricLearning"));
+  if (!m_stageTraceFile.value().empty()) {
+    try {
+      m_traceWriter = std::make_unique<mlutils::StageTraceWriter>(
+          m_stageTraceFile.value(), std::vector<std::string>(Chain::StageNames.begin(), Chain::StageNames.end()),
+          std::vector<std::string>(Chain::CounterNames.begin(), Chain::CounterNames.end()));
+    } catch (const std::runtime_error& ex) {
+      error() << ex.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    info() << "Writing the per event stage trace to " << m_stageTraceFile.value() << endmsg;
+  }
 
-  std::vector<std::shared_ptr<ActsPlugins::EdgeClassificationBase>> edgeClassifiers{
-      std::make_shared<ActsPlugins::OnnxEdgeClassifier>(
-          ActsPlugins::OnnxEdgeClassifier::Config{.modelPath = m_edgeClassifierModelPath.value(),
-                                                  .cut = m_edgeClassifierCut.value()},
-          m_logger->clone(name() + ".EdgeClassifier"))};
+  Chain::Config chainConfig{};
+  auto& graphConfig = chainConfig.graphConstruction;
+  graphConfig.sessionConfig = mlutils::SessionConfig{.intraOpNumThreads = m_onnxIntraOpThreads.value(),
+                                                     .interOpNumThreads = m_onnxInterOpThreads.value(),
+                                                     .allowSpinning = m_onnxAllowSpinning.value(),
+                                                     .enableCpuMemArena = m_onnxCpuMemArena.value(),
+                                                     .enableMemPattern = m_onnxMemPattern.value(),
+                                                     .optimizedModelCacheDir = m_onnxOptimizedModelCacheDir.value(),
+                                                     .profilingFilePrefix = m_onnxProfilingFilePrefix.value(),
+                                                     .profilingMaxRuns = m_onnxProfilingMaxRuns.value()};
+  try {
+    graphConfig.sessionConfig.executionMode = mlutils::toExecutionMode(m_onnxExecutionMode.value());
+    graphConfig.sessionConfig.graphOptimizationLevel = mlutils::toGraphOptimizationLevel(m_onnxGraphOptLevel.value());
+    graphConfig.sessionConfig.precision = mlutils::toModelPrecision(m_modelPrecision.value());
+  } catch (const std::invalid_argument& ex) {
+    error() << "Invalid ONNX Runtime configuration: " << ex.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
 
-  auto trackBuilder = std::make_shared<ActsPlugins::BoostTrackBuilding>(ActsPlugins::BoostTrackBuilding::Config{},
-                                                                        m_logger->clone(name() + ".TrackBuilder"));
+  try {
+    chainConfig.features.features.clear();
+    chainConfig.features.scales = m_hitFeatureScales.value();
+    for (const auto& feature : m_hitFeatures.value()) {
+      chainConfig.features.features.push_back(mlutils::toHitFeature(feature));
+    }
+  } catch (const std::invalid_argument& ex) {
+    error() << "Invalid hit feature configuration: " << ex.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
 
   try {
-    m_pipeline = std::make_unique<ActsPlugins::GnnPipeline>(graphConstructor, edgeClassifiers, trackBuilder,
-                                                            m_logger->clone(name() + ".Pipeline"));
+    auto& hitFilter = chainConfig.hitFilter;
+    hitFilter.mergeDistance = m_hitMergeDistance.value();
+    hitFilter.mergeCollections = m_hitMergeCollections.value();
+    setRange(m_hitTimeWindow.value(), hitFilter.cuts.timeMin, hitFilter.cuts.timeMax);
+    setRange(m_hitRadiusRange.value(), hitFilter.cuts.rMin, hitFilter.cuts.rMax);
+    for (const auto& window : m_collectionHitTimeWindows.value()) {
+      auto& cuts = hitFilter.collectionCuts.emplace_back();
+      setRange(window, cuts.timeMin, cuts.timeMax);
+    }
+    hitFilter.validate(inputLocations(0).size());
   } catch (const std::invalid_argument& ex) {
-    error() << "Failed to construct GNN Pipeline: " << ex.what() << endmsg;
+    error() << "Invalid hit filter configuration: " << ex.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
+
+  graphConfig.modelPath = m_nodeEmbeddingModelPath.value();
+  graphConfig.embeddingDim = m_embeddingDim.value();
+  graphConfig.rVal = m_edgeBuildingRadius.value();
+  graphConfig.knnVal = m_edgeBuildingKnn.value();
+  graphConfig.edgeBuildingThreads = m_edgeBuildingThreads.value();
+  graphConfig.batchEvents = m_embeddingBatchEvents.value();
+  graphConfig.batchingConfig = mlutils::BatchingConfig{
+      .maxBatchRows = m_embeddingBatchMaxHits.value(),
+      .maxBatchRequests = m_embeddingBatchMaxEvents.value(),
+      .maxWaitTime = std::chrono::microseconds(m_embeddingBatchMaxWait.value())};
+  chainConfig.sectors = mlutils::SectorConfig{.phiSectors = m_graphPhiSectors.value(),
+                                              .phiOverlap = m_graphPhiSectorOverlap.value(),
+                                              .etaRegions = m_graphEtaRegions.value(),
+                                              .etaOverlap = m_graphEtaRegionOverlap.value()};
+
+  chainConfig.edgeClassifierModelPath = m_edgeClassifierModelPath.value();
+  chainConfig.edgeClassifierCut = m_edgeClassifierCut.value();
+  chainConfig.edgeChunking = mlutils::EdgeChunkingConfig{
+      .memoryBudgetBytes = static_cast<std::size_t>(m_edgeClassifierMemoryBudget.value() * 1024 * 1024),
+      .bytesPerNode = m_edgeClassifierBytesPerNode.value(),
+      .bytesPerEdge = m_edgeClassifierBytesPerEdge.value(),
+      .haloHops = m_edgeClassifierHaloHops.value()};
+
+  chainConfig.trackBuilding = m_trackBuildingAlgorithm.value();
+  chainConfig.unionFind = UnionFindTrackBuilding::Config{.scoreCut = m_trackBuildingScoreCut.value(),
+                                                         .splitJunctions = m_trackBuildingSplitJunctions.value(),
+                                                         .numThreads = m_trackBuildingThreads.value()};
+  chainConfig.minHitsPerTrack = m_minHitsPerTrk.value();
+  chainConfig.pipelineThreads = m_pipelineThreads.value();
+  chainConfig.pipelineMaxEvents = m_pipelineMaxEvents.value();
+  chainConfig.pipelineStageConcurrency = m_pipelineStageConcurrency.value();
+
+  try {
+    m_chain = std::make_unique<Chain>(chainConfig, m_logger->clone(name()));
+  } catch (const std::exception& ex) {
+    error() << "Could not set up the track finding: " << ex.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
+
+  try {
+    warmUp();
+  } catch (const std::exception& ex) {
+    error() << "Warm-up failed: " << ex.what() << endmsg;
     return StatusCode::FAILURE;
   }
 
   return StatusCode::SUCCESS;
 }
 
+StatusCode ExaTrkGNNTrackFinder::finalize() {
+  if (m_embeddingBatchEvents.value()) {
+    const auto stats = m_chain->graphConstructor().batchingStats();
+    info() << fmt::format("Ran the node embedding {} times for {} events ({:.2f} events and {:.0f} hits on average)",
+                          stats.numBatches, stats.numRequests,
+                          stats.numBatches ? static_cast<double>(stats.numRequests) / stats.numBatches : 0.,
+                          stats.numBatches ? static_cast<double>(stats.numRows) / stats.numBatches : 0.)
+           << endmsg;
+  }
+  if (m_traceWriter) {
+    m_traceWriter->flush();
+  }
+  if (!m_onnxProfilingFilePrefix.value().empty()) {
+    try {
+      std::ostringstream profile{};
+      m_chain->graphConstructor().model().dumpProfile(profile, m_onnxProfilingTopOps.value());
+      info() << profile.str() << endmsg;
+    } catch (const std::runtime_error& ex) {
+      warning() << "Could not summarize the ONNX Runtime profile: " << ex.what() << endmsg;
+    }
+  }
+  return Transformer::finalize();
+}
+
+void ExaTrkGNNTrackFinder::monitorStages(const mlutils::StageRecord& record) const {
+  const auto nHits = static_cast<double>(record.counters[Chain::NumHits]);
+  for (std::size_t stage = 0; stage < Chain::NumStages; ++stage) {
+    m_stageTimes[stage] += record.timesMs[stage];
+    ++m_stageTimesVsHits[stage][{nHits, record.timesMs[stage]}];
+    m_stageRssChange[stage] += record.rssChangeKb[stage] / 1024.;
+  }
+  for (std::size_t counter = 0; counter < Chain::NumCounters; ++counter) {
+    m_eventCounters[counter] += static_cast<double>(record.counters[counter]);
+  }
+
+  if (m_traceWriter) {
+    m_traceWriter->write(m_eventNumber++, record);
+  }
+}
+
 edm4hep::TrackCollection
 ExaTrkGNNTrackFinder::operator()(std::vector<const edm4hep::TrackerHitPlaneCollection*> const& inputTrackerHits) const {
-  const auto allHits = [&inputTrackerHits]() {
-    edm4hep::TrackerHitPlaneCollection hits{};
-    hits.setSubsetCollection(true);
+  return findTracks(inputTrackerHits, true);
+}
 
-    for (const auto* coll : inputTrackerHits) {
-      std::ranges::copy(*coll, std::back_inserter(hits));
-    }
-    return hits;
-  }();
-  debug() << fmt::format("Collected {} hits from {} collections", allHits.size(), inputTrackerHits.size()) << endmsg;
-  auto embeddingInputs = extractHitInformation(allHits);
-  assert(embeddingInputs.size() == allHits.size() * 4);
-  // Give hits their position in the global hits collection as index
-  std::vector<int> hitIdcs(allHits.size());
-  std::iota(hitIdcs.begin(), hitIdcs.end(), 0);
-
-  const auto trackCandIdcs =
-      m_pipeline->run(embeddingInputs, {}, hitIdcs, ActsPlugins::Device{ActsPlugins::Device::Type::eCPU, 0});
-  debug() << fmt::format("Received {} track candidates", trackCandIdcs.size()) << endmsg;
-
-  edm4hep::TrackCollection trackCands{};
+edm4hep::TrackCollection
+ExaTrkGNNTrackFinder::findTracks(std::vector<const edm4hep::TrackerHitPlaneCollection*> const& inputTrackerHits,
+                                 bool monitor) const {
+  auto record = m_stageRecords.acquire();
+  if (!monitor) {
+    return m_chain->process(inputTrackerHits, *record);
+  }
+
+  // Only the candidates that end up in the output are monitored
   auto histBuffer = m_monitoringHist.buffer();
-  for (const auto& candIdcs : trackCandIdcs) {
-    ++histBuffer[{allHits.size(), trackCands.size(), candIdcs.size()}];
-    if (candIdcs.size() < m_minHitsPerTrk.value()) {
-      continue;
+  const Chain::Observers observers{.track = [&](std::size_t iTrack, std::size_t numTrackHits) {
+    ++histBuffer[{record->counters[Chain::NumHits], iTrack, numTrackHits}];
+  }};
+  auto trackCands = m_chain->process(inputTrackerHits, *record, observers);
+  monitorStages(*record);
+  return trackCands;
+}
+
+void ExaTrkGNNTrackFinder::warmUp() const {
+  const auto numEvents = std::max(1u, m_warmupConcurrency.value());
+  // The hit filtering needs as many collections as it has per collection cuts
+  const auto numCollections = std::max<std::size_t>(1, m_chain->config().hitFilter.collectionCuts.size());
+  for (const auto numHits : m_warmupHitCounts.value()) {
+    std::vector<std::vector<edm4hep::TrackerHitPlaneCollection>> events(numEvents);
+    for (unsigned i = 0; i < numEvents; ++i) {
+      events[i].resize(numCollections);
+      const auto hitArrays = mlutils::generateSyntheticHits(numHits, i);
+      for (std::size_t j = 0; j < hitArrays.size(); ++j) {
+        auto hit = events[i][j % numCollections].create();
+        hit.setPosition({hitArrays.x[j], hitArrays.y[j], hitArrays.z[j]});
+        hit.setTime(hitArrays.time[j]);
+      }
+    }
+
+    const auto startRssKb = mlutils::currentRssKb();
+    double timeMs = 0;
+    mlutils::ScopedTimer timer{timeMs};
+    // The events are processed concurrently, such that each of them acquires
+    // its own buffers from the pools
+    std::vector<std::future<std::size_t>> results{};
+    for (const auto& event : events) {
+      results.push_back(std::async(std::launch::async, [this, &event]() {
+        std::vector<const edm4hep::TrackerHitPlaneCollection*> collections{};
+        for (const auto& coll : event) {
+          collections.push_back(&coll);
+        }
+        return findTracks(collections, false).size();
+      }));
     }
-    auto track = trackCands.create();
-    for (const auto idx : candIdcs) {
-      track.addToTrackerHits(allHits[idx]);
+    std::size_t numTracks = 0;
+    for (auto& result : results) {
+      numTracks += result.get();
     }
-    // In order to be able to run the (Marlin based) refitting downstream we
-    // need a single trackstate. For now we just fudge that by adding it here
-    // with the minimal information that is necessary. Once we have a proper
-    // pipeline that can start fitting from the hits alone, this can be removed
-    // again.
-    auto trackState = edm4hep::TrackState{};
-    trackState.location = edm4hep::TrackState::AtFirstHit;
-    track.addToTrackStates(trackState);
-  }
-  debug() << fmt::format("Produced {} output track candidates", trackCands.size()) << endmsg;
-  return trackCands;
+    timer.stop();
+    info() << fmt::format("Warm-up with {} events of {} hits took {:.1f} ms ({} tracks), RSS increased by {:.1f} MB",
+                          numEvents, numHits, timeMs, numTracks, (mlutils::currentRssKb() - startRssKb) / 1024.)
+           << endmsg;
+  }
 }
 
 DECLARE_COMPONENT(ExaTrkGNNTrackFinder)
@@ -1,23 +1,20 @@
 #pragma once
 
-#include <k4FWCore/Transformer.h>
+#include "GNNTrackFindingChain.h"
+#include "ObjectPool.h"
+#include "StageMonitoring.h"
 
-#include <Acts/Utilities/Logger.hpp>
-#if __has_include("ActsPlugins/Gnn/GnnPipeline.hpp")
-#include <ActsPlugins/Gnn/GnnPipeline.hpp>
-#else
-#include <Acts/Plugins/Gnn/GnnPipeline.hpp>
-namespace ActsPlugins {
-using GnnPipeline = Acts::Pipeline;
-}
-#endif
+#include <k4FWCore/Transformer.h>
 
+#include <Gaudi/Accumulators.h>
 #include <Gaudi/Accumulators/RootHistogram.h>
 #include <Gaudi/Property.h>
 
 #include <edm4hep/TrackCollection.h>
 #include <edm4hep/TrackerHitPlaneCollection.h>
 
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <string>
@@ -29,6 +26,7 @@ struct ExaTrkGNNTrackFinder : public k4FWCore::Transformer<edm4hep::TrackCollect
   ExaTrkGNNTrackFinder(const std::string& name, ISvcLocator* svcLoc);
 
   StatusCode initialize() override;
+  StatusCode finalize() override;
 
   edm4hep::TrackCollection operator()(std::vector<const edm4hep::TrackerHitPlaneCollection*> const&) const override;
 
@@ -36,27 +34,183 @@ struct ExaTrkGNNTrackFinder : public k4FWCore::Transformer<edm4hep::TrackCollect
       this, "NodeEmbeddingModelPath",
       "Path to the ONNX model file for the node embedding / graph construction metric model"};
   Gaudi::Property<float> m_edgeBuildingRadius{this, "EdgeBuildingRadius", 0.1f,
-                                              "The radius parameter for the KD-Tree that is used in edge building"};
-  Gaudi::Property<float> m_edgeBuildingKnn{this, "EdgeBuildingKnn", 100.f,
-                                           "The KNN parameter for the KD-Tree that is used in edge building"};
+                                              "The radius in embedding space within which hits are connected by edges"};
+  Gaudi::Property<float> m_edgeBuildingKnn{
+      this, "EdgeBuildingKnn", 100.f,
+      "The maximum number of neighbours per hit that is used in edge building (<= 0: unlimited, as in the CPU edge "
+      "building of Acts)"};
+  Gaudi::Property<unsigned> m_edgeBuildingThreads{this, "EdgeBuildingNumThreads", 1,
+                                                  "Number of threads that are used for building the edges"};
+  Gaudi::Property<unsigned> m_graphPhiSectors{
+      this, "GraphPhiSectors", 1, "Number of phi sectors in which the edges are built independently (1: no sectors)"};
+  Gaudi::Property<float> m_graphPhiSectorOverlap{
+      this, "GraphPhiSectorOverlap", 0.f, "Hits within this distance (in phi) of a sector are also put into it"};
+  Gaudi::Property<unsigned> m_graphEtaRegions{
+      this, "GraphEtaRegions", 1, "Number of eta regions in which the edges are built independently (1: no regions)"};
+  Gaudi::Property<float> m_graphEtaRegionOverlap{
+      this, "GraphEtaRegionOverlap", 0.f, "Hits within this distance (in eta) of a region are also put into it"};
+  Gaudi::Property<std::vector<float>> m_hitTimeWindow{
+      this, "HitTimeWindow", {}, "Only hits within this [min, max] time window (in ns) enter the graph (empty: all)"};
+  Gaudi::Property<std::vector<float>> m_hitRadiusRange{
+      this, "HitRadiusRange", {}, "Only hits within this [min, max] radial range (in mm) enter the graph (empty: all)"};
+  Gaudi::Property<std::vector<std::vector<double>>> m_collectionHitTimeWindows{
+      this, "CollectionHitTimeWindows", {},
+      "An additional [min, max] time window (in ns) for the hits of each input collection, in the order of the "
+      "InputHitCollections (empty: none)"};
+  Gaudi::Property<float> m_hitMergeDistance{
+      this, "HitMergeDistance", 0.f,
+      "Hits of the same collection within this distance (in mm) of each other, e.g. on double layers, enter the graph "
+      "as one hit and are put on the same track (0: no merging)"};
+  Gaudi::Property<std::vector<std::size_t>> m_hitMergeCollections{
+      this, "HitMergeCollections", {},
+      "The indices (in InputHitCollections) of the collections in which hits are merged (empty: all)"};
+  Gaudi::Property<std::vector<std::string>> m_hitFeatures{
+      this, "HitFeatures", {"r", "phi", "z", "time"}, "The per hit input features (and their order) for the models"};
+  Gaudi::Property<std::vector<float>> m_hitFeatureScales{
+      this, "HitFeatureScales", {}, "Factors by which the hit features are divided (empty: no scaling)"};
   Gaudi::Property<int> m_embeddingDim{this, "EmbeddingDim", 4, "The embedding dimension for the node embedding model"};
 
+  Gaudi::Property<int> m_onnxIntraOpThreads{
+      this, "OnnxIntraOpNumThreads", 1,
+      "Number of threads ONNX Runtime uses within an operator of the node embedding model (0: ONNX default)"};
+  Gaudi::Property<int> m_onnxInterOpThreads{
+      this, "OnnxInterOpNumThreads", 1,
+      "Number of threads ONNX Runtime uses across operators of the node embedding model (0: ONNX default)"};
+  Gaudi::Property<std::string> m_onnxExecutionMode{
+      this, "OnnxExecutionMode", "sequential",
+      "Execution mode of ONNX Runtime for the node embedding model (sequential, parallel)"};
+  Gaudi::Property<std::string> m_onnxGraphOptLevel{
+      this, "OnnxGraphOptimizationLevel", "extended",
+      "Graph optimization level of ONNX Runtime for the node embedding model (disable, basic, extended, all)"};
+  Gaudi::Property<bool> m_onnxAllowSpinning{this, "OnnxAllowSpinning", true,
+                                            "Whether the ONNX Runtime thread pools spin while waiting for work"};
+  Gaudi::Property<bool> m_onnxCpuMemArena{this, "OnnxEnableCpuMemArena", true,
+                                          "Whether ONNX Runtime uses an arena for CPU memory allocations"};
+  Gaudi::Property<bool> m_onnxMemPattern{this, "OnnxEnableMemPattern", true,
+                                         "Whether ONNX Runtime pre-plans memory allocations based on previous runs"};
+  Gaudi::Property<std::string> m_onnxOptimizedModelCacheDir{
+      this, "OnnxOptimizedModelCacheDir", "",
+      "Directory in which the optimized node embedding model is cached for faster startup (empty: no caching)"};
+  Gaudi::Property<std::string> m_modelPrecision{
+      this, "ModelPrecision", "fp32",
+      "Precision of the node embedding and edge classifier models (fp32, fp16, int8). The reduced precision variants "
+      "are expected next to the original models (see scripts/quantize_model.py)"};
+  Gaudi::Property<std::string> m_onnxProfilingFilePrefix{
+      this, "OnnxProfilingFilePrefix", "",
+      "Prefix of the ONNX Runtime profile of the node embedding model (empty: no profiling)"};
+  Gaudi::Property<std::size_t> m_onnxProfilingMaxRuns{
+      this, "OnnxProfilingMaxRuns", 100, "Number of inferences after which profiling stops (0: profile all)"};
+  Gaudi::Property<std::size_t> m_onnxProfilingTopOps{
+      this, "OnnxProfilingTopOps", 10, "Number of operator types that are shown in the profile summary"};
+
+  Gaudi::Property<bool> m_embeddingBatchEvents{
+      this, "EmbeddingBatchEvents", false,
+      "Run the node embedding model on the hits of several concurrently processed events at once"};
+  Gaudi::Property<std::size_t> m_embeddingBatchMaxHits{this, "EmbeddingBatchMaxHits", 500000,
+                                                       "Maximum number of hits in a batch of events"};
+  Gaudi::Property<std::size_t> m_embeddingBatchMaxEvents{
+      this, "EmbeddingBatchMaxEvents", 0,
+      "A batch is run as soon as it contains this many events, e.g. the number of event slots (0: no limit)"};
+  Gaudi::Property<int> m_embeddingBatchMaxWait{
+      this, "EmbeddingBatchMaxWaitMicroseconds", 1000,
+      "Maximum time (in microseconds) that an event waits for other events to join its batch"};
+
   Gaudi::Property<std::string> m_edgeClassifierModelPath{this, "EdgeClassifierModelPath",
                                                          "Path to the ONNX model file for the edge classifier GNN"};
   Gaudi::Property<float> m_edgeClassifierCut{this, "EdgeClassifierCut", 0.5f,
                                              "Cut value to use for the edge classifier GNN"};
+  Gaudi::Property<double> m_edgeClassifierMemoryBudget{
+      this, "EdgeClassifierMemoryBudgetMB", 0.,
+      "Estimated memory (in MB) that the edge classifier may use per event. Larger graphs are classified in chunks "
+      "(0: no chunking)"};
+  Gaudi::Property<std::size_t> m_edgeClassifierBytesPerNode{
+      this, "EdgeClassifierBytesPerNode", 2048, "Estimated memory that the edge classifier needs per node (in bytes)"};
+  Gaudi::Property<std::size_t> m_edgeClassifierBytesPerEdge{
+      this, "EdgeClassifierBytesPerEdge", 4096, "Estimated memory that the edge classifier needs per edge (in bytes)"};
+  Gaudi::Property<unsigned> m_edgeClassifierHaloHops{
+      this, "EdgeClassifierHaloHops", 1,
+      "Number of hops by which the chunks are extended with neighbouring nodes. The chunked classification is exact if "
+      "this exceeds the number of message passing steps of the GNN"};
+
+  Gaudi::Property<std::string> m_trackBuildingAlgorithm{
+      this, "TrackBuildingAlgorithm", "unionfind",
+      "The track building from the classified edges (unionfind: concurrent union-find, boost: Boost connected "
+      "components of the Acts GNN plugin)"};
+  Gaudi::Property<float> m_trackBuildingScoreCut{
+      this, "TrackBuildingScoreCut", 0.f,
+      "Only edges with at least this score are used for the union-find track building"};
+  Gaudi::Property<bool> m_trackBuildingSplitJunctions{
+      this, "TrackBuildingSplitJunctions", false,
+      "Split junctions in the union-find track building by keeping only the two best edges of each hit"};
+  Gaudi::Property<unsigned> m_trackBuildingThreads{this, "TrackBuildingNumThreads", 1,
+                                                   "Number of threads for the union-find track building"};
 
   Gaudi::Property<uint32_t> m_minHitsPerTrk{this, "MinHitsPerTrack", 3,
                                             "Minimum number of hits per track for it to be considered for the output"};
 
+  Gaudi::Property<unsigned> m_pipelineThreads{
+      this, "PipelineNumThreads", 0,
+      "Run the stages of the concurrently processed events as tasks on a shared pool of this many threads, such that "
+      "e.g. the embedding of one event overlaps the edge classification of another (0: every event runs on its own "
+      "thread)"};
+  Gaudi::Property<std::size_t> m_pipelineMaxEvents{
+      this, "PipelineMaxEventsInFlight", 4,
+      "Maximum number of events in the pipelined stages, which bounds the memory. Further events wait until one of "
+      "them has finished"};
+  Gaudi::Property<unsigned> m_pipelineStageConcurrency{
+      this, "PipelineStageConcurrency", 1, "Maximum number of events in each of the pipelined stages at the same time"};
+
+  Gaudi::Property<std::vector<std::size_t>> m_warmupHitCounts{
+      this, "WarmupHitCounts", {},
+      "Numbers of hits of the synthetic events that are processed during initialize, in order to have the ONNX "
+      "Runtime arenas and the re-used buffers sized before the first event, e.g. a typical and a large event size "
+      "(empty: no warm-up)"};
+  Gaudi::Property<unsigned> m_warmupConcurrency{
+      this, "WarmupConcurrency", 1,
+      "Number of synthetic events of each size that are processed concurrently during the warm-up, e.g. the number of "
+      "threads, such that every thread finds warm buffers"};
+
+  Gaudi::Property<std::string> m_stageTraceFile{
+      this, "StageTraceFile", "",
+      "File into which the time and memory of each stage are written for every event (*.json: JSON lines, otherwise "
+      "CSV, empty: no trace)"};
+
 private:
-  std::unique_ptr<ActsPlugins::GnnPipeline> m_pipeline{nullptr};
+  std::unique_ptr<GNNTrackFindingChain> m_chain{nullptr};
   std::unique_ptr<const Acts::Logger> m_logger{nullptr};
 
+  /// Fill the stage monitoring (and trace) from the record of an event
+  void monitorStages(const mlutils::StageRecord& record) const;
+
+  /// Run the track finding on the hits of one event. The monitoring is only
+  /// filled for real events
+  edm4hep::TrackCollection findTracks(std::vector<const edm4hep::TrackerHitPlaneCollection*> const& inputTrackerHits,
+                                      bool monitor) const;
+
+  /// Process synthetic events of the configured sizes
+  /// @throws std::exception from the track finding
+  void warmUp() const;
+
+  // One record for each thread that processes events
+  mutable mlutils::ObjectPool<mlutils::StageRecord> m_stageRecords{
+      []() { return std::make_unique<mlutils::StageRecord>(); }};
+
 public:
   void registerCallBack(Gaudi::StateMachine::Transition, std::function<void()>) {}
 
 private:
+  // One entry per stage (or counter). The accumulators can neither be copied
+  // nor moved, hence the deques
+  mutable std::deque<Gaudi::Accumulators::StatCounter<double>> m_stageTimes{};
+  mutable std::deque<Gaudi::Accumulators::StatCounter<double>> m_stageRssChange{};
+  mutable std::deque<Gaudi::Accumulators::RootHistogram<2>> m_stageTimesVsHits{};
+  mutable std::deque<Gaudi::Accumulators::StatCounter<double>> m_eventCounters{};
+  std::unique_ptr<mlutils::StageTraceWriter> m_traceWriter{nullptr};
+  mutable std::atomic<std::size_t> m_eventNumber{0};
+
+  /// Filled once per output track with the number of hits in the event, the
+  /// index of the track in the output and its number of hits. Candidates with
+  /// fewer than MinHitsPerTrack hits are not filled
   mutable Gaudi::Accumulators::RootHistogram<3> m_monitoringHist{this,
                                                                  "MonitoringHistogram",
                                                                  "Monitoring histogram for GNN track finding",
@@ -0,0 +1,275 @@
+#include "GNNTrackFindingChain.h"
+#include "TrackOutput.h"
+
+#if __has_include("ActsPlugins/Gnn/Stages.hpp")
+#include <ActsPlugins/Gnn/BoostTrackBuilding.hpp>
+#include <ActsPlugins/Gnn/OnnxEdgeClassifier.hpp>
+#else
+#include <Acts/Plugins/Gnn/BoostTrackBuilding.hpp>
+#include <Acts/Plugins/Gnn/OnnxEdgeClassifier.hpp>
+namespace ActsPlugins {
+using BoostTrackBuilding = Acts::BoostTrackBuilding;
+using Device = Acts::Device;
+using OnnxEdgeClassifier = Acts::OnnxEdgeClassifier;
+} // namespace ActsPlugins
+#endif
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+GNNTrackFindingChain::GNNTrackFindingChain(const Config& config, std::unique_ptr<const Acts::Logger> logger)
+    : m_config(config), m_logger(std::move(logger)) {
+  const auto stageLogger = [this](std::string_view stage) {
+    return m_logger->clone(fmt::format("{}.{}", m_logger->name(), stage));
+  };
+  m_config.sectors.validate();
+  m_config.edgeChunking.validate();
+  if (m_config.trackBuilding != "unionfind" && m_config.trackBuilding != "boost") {
+    throw std::invalid_argument(fmt::format("Invalid track building algorithm '{}' (valid values: unionfind, boost)",
+                                            m_config.trackBuilding));
+  }
+
+  m_featureExtractor = mlutils::HitFeatureExtractor(m_config.features);
+  if (m_featureExtractor.usesCompiledLayout()) {
+    ACTS_DEBUG("Using the compiled kernel for the hit feature layout");
+  } else {
+    ACTS_INFO("No compiled kernel for the configured hit feature layout, extracting the features one at a time");
+  }
+
+  m_graphConstructor = std::make_unique<OnnxMetricLearning>(m_config.graphConstruction, stageLogger("MetricLearning"));
+  if (const auto modelFeatures = m_graphConstructor->numInputFeatures();
+      modelFeatures && *modelFeatures != m_featureExtractor.numFeatures()) {
+    throw std::invalid_argument(fmt::format("The embedding model expects {} features per hit, but {} hit features are "
+                                            "configured",
+                                            *modelFeatures, m_featureExtractor.numFeatures()));
+  }
+
+  const auto edgeClassifierPath =
+      mlutils::modelVariantPath(m_config.edgeClassifierModelPath, m_config.graphConstruction.sessionConfig.precision);
+  if (!std::filesystem::exists(edgeClassifierPath)) {
+    throw std::runtime_error(fmt::format("Edge classifier model {} does not exist", edgeClassifierPath));
+  }
+  m_edgeClassifier = std::make_unique<ChunkedEdgeClassifier>(
+      std::make_shared<ActsPlugins::OnnxEdgeClassifier>(
+          ActsPlugins::OnnxEdgeClassifier::Config{.modelPath = edgeClassifierPath, .cut = m_config.edgeClassifierCut},
+          stageLogger("EdgeClassifier")),
+      m_config.edgeChunking, stageLogger("ChunkedEdgeClassifier"));
+
+  if (m_config.trackBuilding == "unionfind") {
+    m_trackBuilder = std::make_unique<UnionFindTrackBuilding>(m_config.unionFind, stageLogger("TrackBuilder"));
+  } else {
+    m_trackBuilder = std::make_unique<ActsPlugins::BoostTrackBuilding>(ActsPlugins::BoostTrackBuilding::Config{},
+                                                                       stageLogger("TrackBuilder"));
+  }
+
+  m_execContext.device = ActsPlugins::Device{ActsPlugins::Device::Type::eCPU, 0};
+
+  if (m_config.pipelineThreads > 0) {
+    using Pipeline = mlutils::StagePipeline<PipelineEvent, edm4hep::TrackCollection>;
+    const auto concurrency = m_config.pipelineStageConcurrency;
+    std::vector<Pipeline::Stage> stages{
+        {.run =
+             [this](PipelineEvent& pe) {
+               collectHits(pe.collections, pe.event, *pe.record);
+               extractFeatures(pe.event, *pe.record);
+             },
+         .maxConcurrency = concurrency},
+        {.run = [this](PipelineEvent& pe) { constructGraph(pe.event, *pe.record); }, .maxConcurrency = concurrency},
+        {.run = [this](PipelineEvent& pe) { classifyEdges(pe.event, *pe.record, *pe.observers); },
+         .maxConcurrency = concurrency},
+        {.run = [this](PipelineEvent& pe) { pe.tracks.emplace(buildTracks(pe.event, *pe.record, *pe.observers)); },
+         .maxConcurrency = concurrency}};
+    m_taskPool = std::make_unique<mlutils::TaskPool>(m_config.pipelineThreads);
+    m_pipeline = std::make_unique<Pipeline>(
+        *m_taskPool, std::move(stages),
+        [](PipelineEvent& pe) {
+          auto tracks = std::move(*pe.tracks);
+          pe.tracks.reset();
+          return tracks;
+        },
+        m_config.pipelineMaxEvents);
+    ACTS_INFO(fmt::format("Running the stages on {} threads with at most {} events in flight and {} events per stage",
+                          m_config.pipelineThreads, m_config.pipelineMaxEvents, concurrency));
+    if (m_config.graphConstruction.batchEvents && concurrency < 2) {
+      ACTS_WARNING("The node embedding of several events can only be batched if more than one event at a time is in "
+                   "the graph construction");
+    }
+  }
+}
+
+edm4hep::TrackCollection GNNTrackFindingChain::process(std::span<const TrackerHitCollection* const> collections,
+                                                       mlutils::StageRecord& record) const {
+  return process(collections, record, Observers{});
+}
+
+std::future<edm4hep::TrackCollection>
+GNNTrackFindingChain::submit(std::span<const TrackerHitCollection* const> collections, mlutils::StageRecord& record,
+                             const Observers& observers) const {
+  if (!m_pipeline) {
+    std::promise<edm4hep::TrackCollection> tracks{};
+    try {
+      tracks.set_value(process(collections, record, observers));
+    } catch (...) {
+      tracks.set_exception(std::current_exception());
+    }
+    return tracks.get_future();
+  }
+  record.reset(NumStages, NumCounters);
+  return m_pipeline->push([&](PipelineEvent& pe) {
+    pe.collections = collections;
+    pe.record = &record;
+    pe.observers = &observers;
+  });
+}
+
+edm4hep::TrackCollection GNNTrackFindingChain::process(std::span<const TrackerHitCollection* const> collections,
+                                                       mlutils::StageRecord& record,
+                                                       const Observers& observers) const {
+  if (m_pipeline) {
+    return submit(collections, record, observers).get();
+  }
+
+  auto event = m_events.acquire();
+  record.reset(NumStages, NumCounters);
+  collectHits(collections, *event, record);
+  extractFeatures(*event, record);
+  constructGraph(*event, record);
+  classifyEdges(*event, record, observers);
+  return buildTracks(*event, record, observers);
+}
+
+void GNNTrackFindingChain::collectHits(std::span<const TrackerHitCollection* const> collections, Event& event,
+                                       mlutils::StageRecord& record) const {
+  mlutils::ScopedTimer hitTimer{record.timesMs[HitCollection]};
+  auto& allHits = event.hits;
+  allHits.reset(collections);
+  ACTS_DEBUG(fmt::format("Collected {} hits from {} collections", allHits.size(), collections.size()));
+  auto& hitArrays = event.hitArrays;
+  hitArrays.clear();
+  hitArrays.reserve(allHits.size());
+  allHits.forEach([&hitArrays](std::size_t, const auto& hit) {
+    const auto& position = hit.getPosition();
+    hitArrays.push_back(position.x, position.y, position.z, hit.getTime());
+  });
+  record.counters[NumHits] = allHits.size();
+
+  // Give hits their position in the global hit view as index, such that the
+  // track candidates refer to all hits also if only some of them enter the
+  // graph. The buffer of all hits always holds 0, 1, 2, ... so only newly
+  // needed indices have to be filled
+  event.filtered = m_config.hitFilter.enabled();
+  if (event.filtered) {
+    auto& selection = event.hitSelection;
+    event.collectionSizes.clear();
+    for (const auto* coll : collections) {
+      event.collectionSizes.push_back(coll->size());
+    }
+    mlutils::selectHits(hitArrays, event.collectionSizes, m_config.hitFilter, selection);
+    event.selectedHitIdcs.assign(selection.hits.begin(), selection.hits.end());
+    ACTS_DEBUG(fmt::format("Selected {} of {} hits ({} merged)", selection.size(), allHits.size(),
+                           selection.merged.size()));
+  } else {
+    auto& hitIdcs = event.hitIdcs;
+    const auto nFilled = hitIdcs.size();
+    hitIdcs.resize(allHits.size());
+    if (nFilled < hitIdcs.size()) {
+      std::iota(hitIdcs.begin() + nFilled, hitIdcs.end(), static_cast<int>(nFilled));
+    }
+  }
+  record.counters[NumSelectedHits] = event.graphHits().size();
+  record.finishStage(HitCollection, hitTimer);
+}
+
+void GNNTrackFindingChain::extractFeatures(Event& event, mlutils::StageRecord& record) const {
+  // Fill the node features directly into the tensor that is passed through
+  // the stages
+  mlutils::ScopedTimer featureTimer{record.timesMs[FeatureExtraction]};
+  const auto& graphHits = event.graphHits();
+  auto& nodeFeatures = event.nodeFeatures.emplace(
+      ActsPlugins::Tensor<float>::Create({graphHits.size(), m_featureExtractor.numFeatures()}, m_execContext));
+  m_featureExtractor.extract(graphHits, std::span(nodeFeatures.data(), nodeFeatures.size()));
+  record.finishStage(FeatureExtraction, featureTimer);
+}
+
+void GNNTrackFindingChain::constructGraph(Event& event, mlutils::StageRecord& record) const {
+  OnnxMetricLearning::Timings graphTimings{};
+  auto nodeFeatures = std::move(*event.nodeFeatures);
+  event.nodeFeatures.reset();
+  if (!m_config.sectors.enabled()) {
+    event.tensors.emplace((*m_graphConstructor)(std::move(nodeFeatures), m_execContext, &graphTimings));
+  } else {
+    // The partitioning is accounted to the edge building
+    mlutils::ScopedTimer partitionTimer{graphTimings.edgeBuildingMs};
+    const auto& graphHits = event.graphHits();
+    mlutils::computeEtaPhi(graphHits, event.eta, event.phi);
+    mlutils::partitionHits(event.eta, event.phi, m_config.sectors, event.partition);
+    partitionTimer.stop();
+    ACTS_DEBUG(fmt::format("Partitioned {} hits into {} sectors ({} hits including overlaps)", graphHits.size(),
+                           event.partition.numSectors(), event.partition.hits.size()));
+    event.tensors.emplace(
+        (*m_graphConstructor)(std::move(nodeFeatures), event.partition, m_execContext, &graphTimings));
+  }
+  record.timesMs[Embedding] = graphTimings.embeddingMs;
+  record.recordRss(Embedding, graphTimings.embeddingRssKb);
+  record.timesMs[EdgeBuilding] = graphTimings.edgeBuildingMs;
+  record.recordRss(EdgeBuilding, mlutils::currentRssKb());
+  record.counters[NumEdges] = event.tensors->edgeIndex.shape()[1];
+}
+
+void GNNTrackFindingChain::classifyEdges(Event& event, mlutils::StageRecord& record,
+                                         const Observers& observers) const {
+  mlutils::ScopedTimer classificationTimer{record.timesMs[EdgeClassification]};
+  ChunkedEdgeClassifier::Stats chunkStats{};
+  event.tensors.emplace((*m_edgeClassifier)(std::move(*event.tensors), m_execContext, &chunkStats));
+  record.counters[NumEdgeChunks] = chunkStats.numChunks;
+  record.counters[EdgeChunkEstimateKb] = chunkStats.maxChunkBytes / 1024;
+  record.counters[EdgeClassificationRssKb] = chunkStats.peakRssKb;
+  record.counters[NumClassifiedEdges] = event.tensors->edgeIndex.shape()[1];
+  record.finishStage(EdgeClassification, classificationTimer);
+  if (observers.classifiedGraph) {
+    observers.classifiedGraph(*event.tensors);
+  }
+}
+
+edm4hep::TrackCollection GNNTrackFindingChain::buildTracks(Event& event, mlutils::StageRecord& record,
+                                                           const Observers& observers) const {
+  mlutils::ScopedTimer trackBuildingTimer{record.timesMs[TrackBuilding]};
+  auto tensors = std::move(*event.tensors);
+  event.tensors.reset();
+  auto trackCandIdcs = (*m_trackBuilder)(std::move(tensors), event.graphHitIdcs(), m_execContext);
+  if (event.filtered) {
+    mlutils::addMergedHits(event.hitSelection, trackCandIdcs);
+  }
+  record.counters[NumTrackCandidates] = trackCandIdcs.size();
+  record.finishStage(TrackBuilding, trackBuildingTimer);
+  ACTS_DEBUG(fmt::format("Received {} track candidates", trackCandIdcs.size()));
+
+  mlutils::ScopedTimer outputTimer{record.timesMs[EDMOutput]};
+  // In order to be able to run the (Marlin based) refitting downstream we
+  // need a single trackstate. For now we just fudge that by adding it here
+  // with the minimal information that is necessary. Once we have a proper
+  // pipeline that can start fitting from the hits alone, this can be removed
+  // again.
+  auto trackState = edm4hep::TrackState{};
+  trackState.location = edm4hep::TrackState::AtFirstHit;
+  edm4hep::TrackCollection tracks{};
+  if (observers.track) {
+    mlutils::fillTracks(trackCandIdcs, m_config.minHitsPerTrack, event.hits, trackState, tracks,
+                        [&observers](std::size_t iTrack, const auto& candIdcs) {
+                          observers.track(iTrack, candIdcs.size());
+                        });
+  } else {
+    mlutils::fillTracks(trackCandIdcs, m_config.minHitsPerTrack, event.hits, trackState, tracks);
+  }
+  record.counters[NumTracks] = tracks.size();
+  record.finishStage(EDMOutput, outputTimer);
+  ACTS_DEBUG(fmt::format("Produced {} output track candidates", tracks.size()));
+  return tracks;
+}
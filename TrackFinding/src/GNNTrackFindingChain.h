@@ -0,0 +1,236 @@
+#pragma once
+
+#include "ChunkedEdgeClassifier.h"
+#include "EdgeChunking.h"
+#include "HitFeatures.h"
+#include "HitFiltering.h"
+#include "HitPartitioning.h"
+#include "MultiCollectionView.h"
+#include "ObjectPool.h"
+#include "OnnxMetricLearning.h"
+#include "StageMonitoring.h"
+#include "StagePipeline.h"
+#include "UnionFindTrackBuilding.h"
+
+#include <Acts/Utilities/Logger.hpp>
+#if __has_include("ActsPlugins/Gnn/Stages.hpp")
+#include <ActsPlugins/Gnn/Stages.hpp>
+#include <ActsPlugins/Gnn/Tensor.hpp>
+#else
+#include <Acts/Plugins/Gnn/Stages.hpp>
+#include <Acts/Plugins/Gnn/Tensor.hpp>
+namespace ActsPlugins {
+using ExecutionContext = Acts::ExecutionContext;
+using PipelineTensors = Acts::PipelineTensors;
+using TrackBuildingBase = Acts::TrackBuildingBase;
+template <typename T>
+using Tensor = Acts::Tensor<T>;
+} // namespace ActsPlugins
+#endif
+
+#include <edm4hep/TrackCollection.h>
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief The complete GNN track finding for the hits of one event, from the
+ * hit collection to the EDM4hep track candidates
+ *
+ * The stages are run directly (instead of via a GnnPipeline) in order to hand
+ * the node features to the graph construction without copying them. This is
+ * shared by the ExaTrkGNNTrackFinder and the gnn_replay_benchmark, such that
+ * the benchmark measures exactly the chain that runs in production.
+ *
+ * Safe to call concurrently for different events. The working memory of each
+ * event is taken from a pool and re-used by later events.
+ *
+ * Optionally, the stages are run as tasks on a shared pool of threads (see
+ * mlutils::StagePipeline) instead of on the calling thread. Then the stages
+ * of the events that are processed concurrently overlap, e.g. the embedding
+ * of one event runs while the edges of another one are classified, and the
+ * number of events in the stages is limited, which bounds the memory.
+ */
+class GNNTrackFindingChain {
+public:
+  using TrackerHitCollection = edm4hep::TrackerHitPlaneCollection;
+  using HitView = mlutils::MultiCollectionView<TrackerHitCollection>;
+
+  struct Config {
+    /// The hits that enter the graph construction
+    mlutils::HitFilterConfig hitFilter{};
+    mlutils::HitFeatureConfig features{};
+    /// The node embedding model and the edge building
+    OnnxMetricLearning::Config graphConstruction{.embeddingDim = 4, .rVal = 0.1f, .knnVal = 100.f};
+    /// Build the edges independently in sectors of the detector
+    mlutils::SectorConfig sectors{};
+    /// The (fp32) edge classifier model. The variant with the precision of the
+    /// graph construction session is used
+    std::string edgeClassifierModelPath{};
+    float edgeClassifierCut{0.5f};
+    mlutils::EdgeChunkingConfig edgeChunking{};
+    /// The track building algorithm (unionfind, boost)
+    std::string trackBuilding{"unionfind"};
+    UnionFindTrackBuilding::Config unionFind{.scoreCut = 0.f};
+    /// Minimum number of hits of a track candidate to be put into the output
+    std::size_t minHitsPerTrack{3};
+
+    /// Threads on which the stages of the events run (0: every event runs on
+    /// the calling thread)
+    unsigned pipelineThreads{0};
+    /// Maximum number of events in the stages. Further events wait until one
+    /// of them has finished
+    std::size_t pipelineMaxEvents{4};
+    /// Maximum number of events in each stage at the same time
+    unsigned pipelineStageConcurrency{1};
+  };
+
+  /// The stages of the track finding that are monitored
+  enum Stage : std::size_t {
+    HitCollection,
+    FeatureExtraction,
+    Embedding,
+    EdgeBuilding,
+    EdgeClassification,
+    TrackBuilding,
+    EDMOutput,
+    NumStages
+  };
+  static constexpr std::array<std::string_view, NumStages> StageNames = {
+      "HitCollection", "FeatureExtraction", "Embedding", "EdgeBuilding", "EdgeClassification", "TrackBuilding",
+      "EDMOutput"};
+  /// Per event counters that are monitored
+  enum Counter : std::size_t {
+    NumHits,
+    NumEdges,
+    NumClassifiedEdges,
+    NumTrackCandidates,
+    NumTracks,
+    NumEdgeChunks,
+    EdgeChunkEstimateKb,
+    EdgeClassificationRssKb,
+    NumSelectedHits,
+    NumCounters
+  };
+  static constexpr std::array<std::string_view, NumCounters> CounterNames = {
+      "Hits", "Edges", "ClassifiedEdges", "TrackCandidates", "Tracks", "EdgeChunks", "EdgeChunkEstimateKb",
+      "EdgeClassificationRssKb", "SelectedHits"};
+
+  /// Optional callbacks into the processing of an event
+  struct Observers {
+    /// Called with the classified graph before the track building
+    std::function<void(const ActsPlugins::PipelineTensors&)> classifiedGraph{};
+    /// Called for each track that is put into the output with its index in
+    /// the output and its number of hits
+    std::function<void(std::size_t, std::size_t)> track{};
+  };
+
+  /**
+   * @throws std::invalid_argument for an invalid configuration
+   * @throws std::runtime_error if a model cannot be loaded
+   */
+  GNNTrackFindingChain(const Config& config, std::unique_ptr<const Acts::Logger> logger);
+
+  /**
+   * @brief Find the tracks in the hits of one event
+   *
+   * @param record Filled with the time and memory of each stage and the per
+   *               event counters
+   */
+  edm4hep::TrackCollection process(std::span<const TrackerHitCollection* const> collections,
+                                   mlutils::StageRecord& record, const Observers& observers) const;
+  edm4hep::TrackCollection process(std::span<const TrackerHitCollection* const> collections,
+                                   mlutils::StageRecord& record) const;
+
+  /**
+   * @brief Start the track finding for the hits of one event
+   *
+   * With the pipelined stages this returns as soon as the event has entered
+   * the first stage, which can take a while if the maximum number of events
+   * is in the stages. Otherwise the event is processed right away. The
+   * collections, the record and the observers have to stay valid until the
+   * tracks are ready.
+   *
+   * @returns The tracks, or the exception of the track finding
+   */
+  std::future<edm4hep::TrackCollection> submit(std::span<const TrackerHitCollection* const> collections,
+                                               mlutils::StageRecord& record, const Observers& observers) const;
+
+  /// Whether the stages run as tasks on a pool of threads
+  bool pipelined() const { return m_pipeline != nullptr; }
+
+  const Config& config() const { return m_config; }
+
+  /// Whether the hit features are extracted with a compiled kernel
+  bool usesCompiledFeatureLayout() const { return m_featureExtractor.usesCompiledLayout(); }
+
+  /// The graph construction, e.g. for its batching statistics or its profile
+  const OnnxMetricLearning& graphConstructor() const { return *m_graphConstructor; }
+
+private:
+  /// The state of one event while it passes the stages, including the working
+  /// memory that is re-used by later events
+  struct Event {
+    HitView hits{};
+    mlutils::HitArrays hitArrays{};
+    /// The index of each hit in the graph in the view of all hits. Always
+    /// holds 0, 1, 2, ... if the hits are not filtered
+    std::vector<int> hitIdcs{};
+    // Only used when the hits are filtered
+    bool filtered{false};
+    std::vector<std::size_t> collectionSizes{};
+    mlutils::HitSelection hitSelection{};
+    std::vector<int> selectedHitIdcs{};
+    // Only used when the graph is built in sectors
+    std::vector<float> eta{};
+    std::vector<float> phi{};
+    mlutils::HitPartition partition{};
+
+    std::optional<ActsPlugins::Tensor<float>> nodeFeatures{};
+    std::optional<ActsPlugins::PipelineTensors> tensors{};
+
+    const mlutils::HitArrays& graphHits() const { return filtered ? hitSelection.hitArrays : hitArrays; }
+    std::vector<int>& graphHitIdcs() { return filtered ? selectedHitIdcs : hitIdcs; }
+  };
+
+  void collectHits(std::span<const TrackerHitCollection* const> collections, Event& event,
+                   mlutils::StageRecord& record) const;
+  void extractFeatures(Event& event, mlutils::StageRecord& record) const;
+  void constructGraph(Event& event, mlutils::StageRecord& record) const;
+  void classifyEdges(Event& event, mlutils::StageRecord& record, const Observers& observers) const;
+  edm4hep::TrackCollection buildTracks(Event& event, mlutils::StageRecord& record, const Observers& observers) const;
+
+  Config m_config;
+  mlutils::HitFeatureExtractor m_featureExtractor{};
+  std::unique_ptr<OnnxMetricLearning> m_graphConstructor{nullptr};
+  std::unique_ptr<ChunkedEdgeClassifier> m_edgeClassifier{nullptr};
+  std::unique_ptr<ActsPlugins::TrackBuildingBase> m_trackBuilder{nullptr};
+  ActsPlugins::ExecutionContext m_execContext{};
+  // One event for each thread that processes events
+  mutable mlutils::ObjectPool<Event> m_events{[]() { return std::make_unique<Event>(); }};
+
+  const auto& logger() const { return *m_logger; }
+  std::unique_ptr<const Acts::Logger> m_logger{nullptr};
+
+  /// An event in one of the slots of the pipeline
+  struct PipelineEvent {
+    Event event{};
+    std::span<const TrackerHitCollection* const> collections{};
+    mlutils::StageRecord* record{nullptr};
+    const Observers* observers{nullptr};
+    std::optional<edm4hep::TrackCollection> tracks{};
+  };
+  // Last, such that the events in flight are finished before the stages are
+  // destroyed
+  std::unique_ptr<mlutils::TaskPool> m_taskPool{nullptr};
+  std::unique_ptr<mlutils::StagePipeline<PipelineEvent, edm4hep::TrackCollection>> m_pipeline{nullptr};
+};
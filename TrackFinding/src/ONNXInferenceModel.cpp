@@ -1,24 +1,379 @@
 #include "ONNXInferenceModel.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 
 namespace mlutils {
 
-ONNXInferenceModel::ONNXInferenceModel(const std::string& name, OrtLoggingLevel logLevel)
-    : m_env(std::make_unique<Ort::Env>(logLevel, name.c_str())),
-      m_sessionOptions(std::make_unique<Ort::SessionOptions>()), m_envName(name) {
-  // Run model on a single CPU core
-  m_sessionOptions->SetIntraOpNumThreads(1);
-  // Let ONNX perform optimizations on the model graph to improve performance
-  m_sessionOptions->SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+/**
+ * @brief Stops the profiling of a session after a maximum number of runs
+ *
+ * Runs and the end of profiling are only synchronized as long as profiling is
+ * active, afterwards running the session does not take any locks.
+ */
+class SessionProfiler {
+public:
+  explicit SessionProfiler(size_t maxRuns) : m_maxRuns(maxRuns) {}
+
+  /// Prevent profiling from being ended while a run is in progress
+  std::shared_lock<std::shared_mutex> guardRun() {
+    if (!m_active.load(std::memory_order_acquire)) {
+      return {};
+    }
+    return std::shared_lock{m_mutex};
+  }
+
+  /// Count a finished run and end profiling once the maximum has been reached
+  void countRun(Ort::Session& session) {
+    if (m_maxRuns > 0 && m_active.load(std::memory_order_acquire) && ++m_numRuns == m_maxRuns) {
+      end(session);
+    }
+  }
+
+  /// End profiling (if it is still active) and return the profile file
+  std::string end(Ort::Session& session) {
+    std::unique_lock lock{m_mutex};
+    if (m_active.load(std::memory_order_relaxed)) {
+      Ort::AllocatorWithDefaultOptions allocator{};
+      m_profileFile = session.EndProfilingAllocated(allocator).get();
+      m_active.store(false, std::memory_order_release);
+    }
+    return m_profileFile;
+  }
+
+private:
+  size_t m_maxRuns;
+  std::atomic<size_t> m_numRuns{0};
+  std::atomic<bool> m_active{true};
+  std::shared_mutex m_mutex{};
+  std::string m_profileFile{};
+};
+
+namespace {
+  /// The ONNX Runtime environment that is shared by all models in the process
+  Ort::Env& sharedEnv() {
+    static Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "MLTracking"};
+    return env;
+  }
+
+  namespace fs = std::filesystem;
+  using Clock = std::chrono::steady_clock;
+
+  double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  /// FNV-1a hash of the contents of a file. Used to detect changes in a model
+  /// for which an optimized version has been cached
+  uint64_t hashFileContents(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("Cannot open file " + path.string());
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    std::array<char, 1 << 16> buffer{};
+    while (file) {
+      file.read(buffer.data(), buffer.size());
+      for (std::streamsize i = 0; i < file.gcount(); ++i) {
+        hash ^= static_cast<unsigned char>(buffer[i]);
+        hash *= 0x100000001b3ULL;
+      }
+    }
+    return hash;
+  }
+
+  /// The parts of the file name of a cached optimized model. The full name is
+  /// <stem>.<content-hash>.opt<level>.api<ORT-API-version>.ort
+  struct CacheFileName {
+    std::string prefix;
+    std::string hash;
+    std::string suffix;
+
+    std::string str() const { return prefix + hash + suffix; }
+  };
+
+  CacheFileName cacheFileName(const fs::path& modelPath, const SessionConfig& config) {
+    std::ostringstream hash{};
+    hash << std::hex << std::setw(16) << std::setfill('0') << hashFileContents(modelPath);
+    // Also encode the ORT API version, as the ORT format is not necessarily
+    // stable across versions
+    return {modelPath.stem().string() + ".", hash.str(),
+            ".opt" + std::to_string(static_cast<int>(config.graphOptimizationLevel)) + ".api" +
+                std::to_string(ORT_API_VERSION) + ".ort"};
+  }
+
+  /// Remove all cached optimized models for previous versions of a model
+  void removeStaleCacheFiles(const fs::path& cacheDir, const CacheFileName& current) {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(cacheDir, ec)) {
+      const auto name = entry.path().filename().string();
+      if (name.starts_with(current.prefix) && name.size() == current.str().size() && name.ends_with(current.suffix) &&
+          name != current.str()) {
+        fs::remove(entry.path(), ec);
+        fs::remove(entry.path().string() + ".loadtime", ec);
+      }
+    }
+  }
+
+  /// Read the time it took to create a cached optimized model
+  double readReferenceLoadTime(const fs::path& cachePath) {
+    std::ifstream file(cachePath.string() + ".loadtime");
+    double loadTime{0};
+    file >> loadTime;
+    return loadTime;
+  }
+
+  /// Load a model with the shared environment. If caching is enabled, try to
+  /// load a previously optimized model from the cache and create it if it is
+  /// not there (or out of date)
+  std::unique_ptr<Ort::Session> createSession(const std::string& modelPath, const SessionConfig& config,
+                                              const Ort::SessionOptions& options, ModelLoadInfo& loadInfo) {
+    if (config.optimizedModelCacheDir.empty()) {
+      loadInfo.source = ModelLoadInfo::Source::File;
+      return std::make_unique<Ort::Session>(sharedEnv(), modelPath.c_str(), options);
+    }
+
+    const auto cacheDir = fs::path(config.optimizedModelCacheDir);
+    const auto cacheName = cacheFileName(modelPath, config);
+    const auto cachePath = cacheDir / cacheName.str();
+    loadInfo.optimizedModelPath = cachePath.string();
+
+    if (fs::exists(cachePath)) {
+      try {
+        auto cachedOptions = options.Clone();
+        // All optimizations have already been applied to the cached model
+        cachedOptions.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+        auto session = std::make_unique<Ort::Session>(sharedEnv(), cachePath.c_str(), cachedOptions);
+        loadInfo.source = ModelLoadInfo::Source::OptimizedCache;
+        loadInfo.referenceLoadTimeMs = readReferenceLoadTime(cachePath);
+        return session;
+      } catch (const std::exception& e) {
+        std::cerr << "Could not load cached optimized model " << cachePath << " (" << e.what()
+                  << "), falling back to " << modelPath << std::endl;
+      }
+    }
+
+    loadInfo.source = ModelLoadInfo::Source::File;
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+    removeStaleCacheFiles(cacheDir, cacheName);
+
+    // Write to a temporary file first and only move it into place once it is
+    // complete to not interfere with other processes using the same cache
+    const auto tmpPath = cachePath.string() + "." + std::to_string(getpid()) + ".tmp";
+    try {
+      auto cachingOptions = options.Clone();
+      cachingOptions.SetOptimizedModelFilePath(tmpPath.c_str());
+      cachingOptions.AddConfigEntry("session.save_model_format", "ORT");
+
+      const auto start = Clock::now();
+      auto session = std::make_unique<Ort::Session>(sharedEnv(), modelPath.c_str(), cachingOptions);
+      std::ofstream(cachePath.string() + ".loadtime") << elapsedMs(start);
+      fs::rename(tmpPath, cachePath);
+      return session;
+    } catch (const std::exception& e) {
+      std::cerr << "Could not cache optimized model to " << cachePath << " (" << e.what() << ")" << std::endl;
+      fs::remove(tmpPath, ec);
+      loadInfo.optimizedModelPath.clear();
+    }
+
+    return std::make_unique<Ort::Session>(sharedEnv(), modelPath.c_str(), options);
+  }
+
+  /// A session together with its profiler (if profiling is enabled)
+  struct SharedSession {
+    std::unique_ptr<Ort::Session> session;
+    std::unique_ptr<SessionProfiler> profiler;
+  };
+
+  /// Run a session via the passed function. If the session is profiled, make
+  /// sure that profiling is not ended during the run and count it
+  template <typename RunFunc>
+  auto runProfiled(SessionProfiler* profiler, Ort::Session& session, RunFunc&& run) {
+    if (!profiler) {
+      return run();
+    }
+    if constexpr (std::is_void_v<std::invoke_result_t<RunFunc>>) {
+      {
+        const auto guard = profiler->guardRun();
+        run();
+      }
+      profiler->countRun(session);
+    } else {
+      auto result = [&]() {
+        const auto guard = profiler->guardRun();
+        return run();
+      }();
+      profiler->countRun(session);
+      return result;
+    }
+  }
+
+  /// Registry of all sessions that are currently in use. It only holds weak
+  /// references, such that a session is released once the last model using it
+  /// is gone.
+  class SessionRegistry {
+  public:
+    static SessionRegistry& instance() {
+      static SessionRegistry registry{};
+      return registry;
+    }
+
+    /// Get the session for the model (and config) or create it with the passed
+    /// function if it does not exist yet
+    template <typename CreateFunc>
+    std::shared_ptr<SharedSession> getOrCreate(const std::string& modelPath, const SessionConfig& config,
+                                               CreateFunc&& create) {
+      std::lock_guard lock{m_mutex};
+      std::erase_if(m_entries, [](const auto& entry) { return entry.session.expired(); });
+
+      const auto it = std::ranges::find_if(
+          m_entries, [&](const auto& entry) { return entry.modelPath == modelPath && entry.config == config; });
+      if (it != m_entries.end()) {
+        if (auto session = it->session.lock()) {
+          return session;
+        }
+      }
+
+      auto session = std::make_shared<SharedSession>(SharedSession{create(), nullptr});
+      if (!config.profilingFilePrefix.empty()) {
+        session->profiler = std::make_unique<SessionProfiler>(config.profilingMaxRuns);
+      }
+      m_entries.push_back(Entry{modelPath, config, session});
+      return session;
+    }
+
+  private:
+    struct Entry {
+      std::string modelPath;
+      SessionConfig config;
+      std::weak_ptr<SharedSession> session;
+    };
+
+    std::mutex m_mutex{};
+    std::vector<Entry> m_entries{};
+  };
+} // namespace
+
+GraphOptimizationLevel toGraphOptimizationLevel(std::string_view level) {
+  if (level == "disable") {
+    return GraphOptimizationLevel::ORT_DISABLE_ALL;
+  }
+  if (level == "basic") {
+    return GraphOptimizationLevel::ORT_ENABLE_BASIC;
+  }
+  if (level == "extended") {
+    return GraphOptimizationLevel::ORT_ENABLE_EXTENDED;
+  }
+  if (level == "all") {
+    return GraphOptimizationLevel::ORT_ENABLE_ALL;
+  }
+  throw std::invalid_argument("Invalid graph optimization level '" + std::string(level) +
+                              "' (valid values: disable, basic, extended, all)");
+}
+
+ExecutionMode toExecutionMode(std::string_view mode) {
+  if (mode == "sequential") {
+    return ExecutionMode::ORT_SEQUENTIAL;
+  }
+  if (mode == "parallel") {
+    return ExecutionMode::ORT_PARALLEL;
+  }
+  throw std::invalid_argument("Invalid execution mode '" + std::string(mode) +
+                              "' (valid values: sequential, parallel)");
+}
+
+ModelPrecision toModelPrecision(std::string_view precision) {
+  if (precision == "fp32") {
+    return ModelPrecision::FP32;
+  }
+  if (precision == "fp16") {
+    return ModelPrecision::FP16Weights;
+  }
+  if (precision == "int8") {
+    return ModelPrecision::Int8;
+  }
+  throw std::invalid_argument("Invalid model precision '" + std::string(precision) +
+                              "' (valid values: fp32, fp16, int8)");
+}
+
+std::string modelVariantPath(const std::string& modelPath, ModelPrecision precision) {
+  if (precision == ModelPrecision::FP32) {
+    return modelPath;
+  }
+  auto path = fs::path(modelPath);
+  const auto extension = path.extension().string();
+  path.replace_extension(precision == ModelPrecision::Int8 ? ".int8" : ".fp16");
+  return path.string() + extension;
+}
+
+ONNXInferenceModel::ONNXInferenceModel(const std::string& name, OrtLoggingLevel logLevel, const SessionConfig& config)
+    : m_sessionOptions(std::make_unique<Ort::SessionOptions>()), m_config(config),
+      m_memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)), m_name(name) {
+  m_sessionOptions->SetLogId(m_name.c_str());
+  m_sessionOptions->SetLogSeverityLevel(logLevel);
+  m_sessionOptions->SetIntraOpNumThreads(config.intraOpNumThreads);
+  m_sessionOptions->SetInterOpNumThreads(config.interOpNumThreads);
+  m_sessionOptions->SetExecutionMode(config.executionMode);
+  m_sessionOptions->SetGraphOptimizationLevel(config.graphOptimizationLevel);
+
+  const auto* spinning = config.allowSpinning ? "1" : "0";
+  m_sessionOptions->AddConfigEntry("session.intra_op.allow_spinning", spinning);
+  m_sessionOptions->AddConfigEntry("session.inter_op.allow_spinning", spinning);
+
+  if (config.enableCpuMemArena) {
+    m_sessionOptions->EnableCpuMemArena();
+  } else {
+    m_sessionOptions->DisableCpuMemArena();
+  }
+  if (config.enableMemPattern) {
+    m_sessionOptions->EnableMemPattern();
+  } else {
+    m_sessionOptions->DisableMemPattern();
+  }
+  if (!config.profilingFilePrefix.empty()) {
+    m_sessionOptions->EnableProfiling(config.profilingFilePrefix.c_str());
+  }
 }
 
 bool ONNXInferenceModel::loadModel(const std::string& modelPath) {
   try {
     cleanup();
 
-    m_session = std::make_unique<Ort::Session>(*m_env, modelPath.c_str(), *m_sessionOptions);
+    const auto variantPath = modelVariantPath(modelPath, m_config.precision);
+    if (variantPath != modelPath && !fs::exists(variantPath)) {
+      throw std::runtime_error("Reduced precision model " + variantPath + " does not exist (it can be created with " +
+                               "scripts/quantize_model.py)");
+    }
+
+    const auto start = Clock::now();
+    m_loadInfo = ModelLoadInfo{.source = ModelLoadInfo::Source::SharedSession, .modelPath = variantPath};
+    const auto shared = SessionRegistry::instance().getOrCreate(variantPath, m_config, [&]() {
+      return createSession(variantPath, m_config, *m_sessionOptions, m_loadInfo);
+    });
+    // Aliasing shared_ptrs that keep the whole shared session alive
+    m_session = std::shared_ptr<Ort::Session>(shared, shared->session.get());
+    if (shared->profiler) {
+      m_profiler = std::shared_ptr<SessionProfiler>(shared, shared->profiler.get());
+    }
+    m_loadInfo.loadTimeMs = elapsedMs(start);
     extractModelInfo();
     m_modelLoaded = true;
 
@@ -31,37 +386,174 @@ bool ONNXInferenceModel::loadModel(const std::string& modelPath) {
 }
 
 std::vector<Ort::Value> ONNXInferenceModel::runInference(const std::vector<float>& inputData,
-                                                         const std::vector<int64_t>& inputShape) {
+                                                         const std::vector<int64_t>& inputShape) const {
   if (!m_modelLoaded) {
     throw std::runtime_error("Model not loaded");
   }
 
   try {
-    // Create input tensor
-    auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    // We re-use the buffer provided by the inputData
-    auto inputTensor = Ort::Value::CreateTensor(memoryInfo, const_cast<float*>(inputData.data()), inputData.size(),
+    // Create input tensor. We re-use the buffer provided by the inputData
+    auto inputTensor = Ort::Value::CreateTensor(m_memoryInfo, const_cast<float*>(inputData.data()), inputData.size(),
                                                 inputShape.data(), inputShape.size());
 
-    // Prepare input/output names
-    std::vector<const char*> inputNames;
-    std::vector<const char*> outputNames;
+    // Run inference
+    return runProfiled(m_profiler.get(), *m_session, [&]() {
+      return m_session->Run(Ort::RunOptions{nullptr}, m_inputNamePtrs.data(), &inputTensor, 1,
+                            m_outputNamePtrs.data(), m_outputNamePtrs.size());
+    });
+  } catch (const std::exception& e) {
+    throw std::runtime_error("Inference failed: " + std::string(e.what()));
+  }
+}
 
-    for (const auto& name : m_inputNames) {
-      inputNames.push_back(name.c_str());
+std::vector<Ort::Value> ONNXInferenceModel::runInference(std::span<const InputTensor> inputs,
+                                                         std::span<const std::string_view> outputNames) const {
+  if (!m_modelLoaded) {
+    throw std::runtime_error("Model not loaded");
+  }
+
+  std::vector<const char*> inputNames{};
+  std::vector<Ort::Value> inputTensors{};
+  inputNames.reserve(inputs.size());
+  inputTensors.reserve(inputs.size());
+  for (const auto& input : inputs) {
+    const auto index = inputIndex(input.name);
+    if (input.elementType != m_inputTypes[index]) {
+      throw std::invalid_argument("Input '" + std::string(input.name) + "' has element type " +
+                                  std::to_string(input.elementType) + " but model expects " +
+                                  std::to_string(m_inputTypes[index]));
     }
-    for (const auto& name : m_outputNames) {
-      outputNames.push_back(name.c_str());
+    inputNames.push_back(m_inputNamePtrs[index]);
+    // ONNX runtime does not modify inputs, so the const_cast is safe
+    inputTensors.push_back(Ort::Value::CreateTensor(m_memoryInfo, const_cast<void*>(input.data), input.byteSize,
+                                                    input.shape.data(), input.shape.size(), input.elementType));
+  }
+
+  std::vector<const char*> requestedOutputs{};
+  if (outputNames.empty()) {
+    requestedOutputs = m_outputNamePtrs;
+  } else {
+    requestedOutputs.reserve(outputNames.size());
+    for (const auto name : outputNames) {
+      requestedOutputs.push_back(m_outputNamePtrs[outputIndex(name)]);
     }
+  }
 
-    // Run inference
-    return m_session->Run(Ort::RunOptions{nullptr}, inputNames.data(), &inputTensor, 1, outputNames.data(),
-                          outputNames.size());
+  try {
+    return runProfiled(m_profiler.get(), *m_session, [&]() {
+      return m_session->Run(Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(), inputTensors.size(),
+                            requestedOutputs.data(), requestedOutputs.size());
+    });
+  } catch (const std::exception& e) {
+    throw std::runtime_error("Inference failed: " + std::string(e.what()));
+  }
+}
+
+std::string ONNXInferenceModel::endProfiling() const {
+  if (!m_profiler) {
+    return {};
+  }
+  return m_profiler->end(*m_session);
+}
+
+size_t ONNXInferenceModel::inputIndex(std::string_view name) const {
+  const auto it = std::ranges::find(m_inputNames, name);
+  if (it == m_inputNames.end()) {
+    throw std::invalid_argument("Model has no input named '" + std::string(name) + "'");
+  }
+  return std::distance(m_inputNames.begin(), it);
+}
+
+size_t ONNXInferenceModel::outputIndex(std::string_view name) const {
+  const auto it = std::ranges::find(m_outputNames, name);
+  if (it == m_outputNames.end()) {
+    throw std::invalid_argument("Model has no output named '" + std::string(name) + "'");
+  }
+  return std::distance(m_outputNames.begin(), it);
+}
+
+void ONNXInferenceModel::runInference(InferenceBuffers& buffers) const {
+  if (!m_modelLoaded) {
+    throw std::runtime_error("Model not loaded");
+  }
+  assert(buffers.m_model == this);
+
+  try {
+    runProfiled(m_profiler.get(), *m_session,
+                [&]() { m_session->Run(Ort::RunOptions{nullptr}, buffers.m_binding); });
   } catch (const std::exception& e) {
     throw std::runtime_error("Inference failed: " + std::string(e.what()));
   }
 }
 
+InferenceBuffers::InferenceBuffers(const ONNXInferenceModel& model)
+    : m_model(&model), m_binding(*model.m_session), m_inputData(model.m_inputNames.size(), nullptr),
+      m_inputShapes(model.m_inputNames.size()), m_outputBuffers(model.m_outputNames.size()),
+      m_outputShapes(model.m_outputNames.size()), m_boundOutputData(model.m_outputNames.size(), nullptr) {
+  if (!model.m_modelLoaded) {
+    throw std::runtime_error("Cannot create inference buffers for a model that is not loaded");
+  }
+}
+
+void InferenceBuffers::bindInput(std::span<const float> data, std::span<const int64_t> shape) {
+  bindInput(InputTensor{m_model->m_inputNames[0], data, shape});
+}
+
+void InferenceBuffers::bindInput(const InputTensor& input) {
+  const auto index = m_model->inputIndex(input.name);
+  auto& boundShape = m_inputShapes[index];
+  if (input.data == m_inputData[index] && std::ranges::equal(input.shape, boundShape)) {
+    return;
+  }
+  if (input.elementType != m_model->m_inputTypes[index]) {
+    throw std::invalid_argument("Input '" + std::string(input.name) + "' has element type " +
+                                std::to_string(input.elementType) + " but model expects " +
+                                std::to_string(m_model->m_inputTypes[index]));
+  }
+
+  m_inputData[index] = input.data;
+  boundShape.assign(input.shape.begin(), input.shape.end());
+  // ONNX runtime does not modify inputs, so the const_cast is safe
+  auto tensor = Ort::Value::CreateTensor(m_model->m_memoryInfo, const_cast<void*>(input.data), input.byteSize,
+                                         boundShape.data(), boundShape.size(), input.elementType);
+  // Re-binding the same name replaces the previously bound tensor
+  m_binding.BindInput(m_model->m_inputNamePtrs[index], tensor);
+}
+
+void InferenceBuffers::bindOutput(size_t index, std::span<const int64_t> shape) {
+  if (m_model->m_outputTypes[index] != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+    throw std::invalid_argument("Output '" + m_model->m_outputNames[index] +
+                                "' cannot be bound, only float outputs are supported");
+  }
+  const auto size = static_cast<size_t>(std::reduce(shape.begin(), shape.end(), int64_t{1}, std::multiplies<>()));
+  auto& buffer = m_outputBuffers[index];
+  if (size > buffer.size()) {
+    if (size > buffer.capacity()) {
+      ++m_numReallocations;
+    }
+    buffer.resize(size);
+  }
+
+  if (buffer.data() == m_boundOutputData[index] && std::ranges::equal(shape, m_outputShapes[index])) {
+    return;
+  }
+
+  m_boundOutputData[index] = buffer.data();
+  m_outputShapes[index].assign(shape.begin(), shape.end());
+  auto tensor = Ort::Value::CreateTensor(m_model->m_memoryInfo, buffer.data(), size, m_outputShapes[index].data(),
+                                         m_outputShapes[index].size());
+  m_binding.BindOutput(m_model->m_outputNamePtrs[index], tensor);
+}
+
+std::span<const float> InferenceBuffers::output(size_t index) const {
+  const auto& shape = m_outputShapes[index];
+  if (shape.empty()) {
+    return {};
+  }
+  const auto size = static_cast<size_t>(std::reduce(shape.begin(), shape.end(), int64_t{1}, std::multiplies<>()));
+  return {m_outputBuffers[index].data(), size};
+}
+
 void ONNXInferenceModel::extractModelInfo() {
   if (!m_session) {
     return;
@@ -70,8 +562,12 @@ void ONNXInferenceModel::extractModelInfo() {
   // Clear existing info
   m_inputNames.clear();
   m_outputNames.clear();
+  m_inputNamePtrs.clear();
+  m_outputNamePtrs.clear();
   m_inputShapes.clear();
   m_outputShapes.clear();
+  m_inputTypes.clear();
+  m_outputTypes.clear();
 
   Ort::AllocatorWithDefaultOptions allocator;
 
@@ -85,6 +581,7 @@ void ONNXInferenceModel::extractModelInfo() {
     auto tensorInfo = inputTypeInfo.GetTensorTypeAndShapeInfo();
     auto shape = tensorInfo.GetShape();
     m_inputShapes.push_back(shape);
+    m_inputTypes.push_back(tensorInfo.GetElementType());
   }
 
   // Extract output information
@@ -97,15 +594,30 @@ void ONNXInferenceModel::extractModelInfo() {
     auto tensorInfo = outputTypeInfo.GetTensorTypeAndShapeInfo();
     auto shape = tensorInfo.GetShape();
     m_outputShapes.push_back(shape);
+    m_outputTypes.push_back(tensorInfo.GetElementType());
+  }
+
+  // Only take the pointers once all names are in place to avoid invalidating
+  // them by a reallocation
+  for (const auto& name : m_inputNames) {
+    m_inputNamePtrs.push_back(name.c_str());
+  }
+  for (const auto& name : m_outputNames) {
+    m_outputNamePtrs.push_back(name.c_str());
   }
 }
 
 void ONNXInferenceModel::cleanup() {
+  m_profiler.reset();
   m_session.reset();
   m_inputNames.clear();
   m_outputNames.clear();
+  m_inputNamePtrs.clear();
+  m_outputNamePtrs.clear();
   m_inputShapes.clear();
   m_outputShapes.clear();
+  m_inputTypes.clear();
+  m_outputTypes.clear();
   m_modelLoaded = false;
 }
 
@@ -1,25 +1,20 @@
 #include "OnnxMetricLearning.h"
 #include "ONNXInferenceModel.h"
-
-#if __has_include("ActsPlugins/Gnn/detail/TensorVectorConversion.hpp")
-#include <ActsPlugins/Gnn/detail/TensorVectorConversion.hpp>
-#include <ActsPlugins/Gnn/detail/buildEdges.hpp>
-#else
-#include <Acts/Plugins/Gnn/detail/TensorVectorConversion.hpp>
-#include <Acts/Plugins/Gnn/detail/buildEdges.hpp>
-#endif
+#include "StageMonitoring.h"
 
 #include <onnxruntime_cxx_api.h>
 
-#include <torch/torch.h>
-
 #include <fmt/format.h>
-#include <fmt/ostream.h>
 #include <fmt/ranges.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <memory>
+#include <optional>
 #include <span>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace {
@@ -43,71 +38,158 @@ constexpr OrtLoggingLevel getOnnxLogLevel(Acts::Logging::Level lvl) {
   return ORT_LOGGING_LEVEL_WARNING;
 }
 
-/// Convert ONNX element type to torch scalar type
-constexpr torch::ScalarType toTorchType(ONNXTensorElementDataType elementType) {
-  switch (elementType) {
-  case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
-    return torch::kFloat32;
-  case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
-    return torch::kFloat64;
-  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
-    return torch::kInt32;
-  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
-    return torch::kInt64;
-  default:
-    throw std::runtime_error("Unsupported ONNX tensor element type");
-  }
-}
+} // namespace
 
-/// Convert the Onnx tensor into a torch Tensor.
-/// @note: This doesn't take ownership, it essentially just "re-skins" the data
-/// owned by the Onnx tensor
-torch::Tensor toTorchTensor(const Ort::Value& onnxTensor) {
-  auto tensorInfo = onnxTensor.GetTensorTypeAndShapeInfo();
-  auto shape = tensorInfo.GetShape();
-  auto elementType = tensorInfo.GetElementType();
+OnnxMetricLearning::OnnxMetricLearning(const Config& cfg, std::unique_ptr<const Acts::Logger> lggr)
+    : m_model("MetricLearning", getOnnxLogLevel(lggr->level()), cfg.sessionConfig),
+      m_bufferPool([this]() { return std::make_unique<mlutils::InferenceBuffers>(m_model); }),
+      m_edgeBuilder({.radius = cfg.rVal,
+                     .knn = static_cast<int>(cfg.knnVal),
+                     .shuffleDirections = cfg.shuffleDirections,
+                     .numThreads = cfg.edgeBuildingThreads}),
+      m_embeddingPool([]() { return std::make_unique<std::vector<float>>(); }), m_config(cfg),
+      m_logger(std::move(lggr)) {
+  ACTS_INFO(fmt::format("Loading model from {}", config().modelPath));
+  if (!m_model.loadModel(config().modelPath)) {
+    throw std::runtime_error(fmt::format("Could not load the embedding model from {}", config().modelPath));
+  }
 
-  const void* data = onnxTensor.GetTensorData<void>();
-  const auto torchType = toTorchType(elementType);
+  const auto& loadInfo = m_model.loadInfo();
+  if (loadInfo.modelPath != config().modelPath) {
+    ACTS_INFO(fmt::format("Using the reduced precision variant {}", loadInfo.modelPath));
+  }
+  switch (loadInfo.source) {
+  case mlutils::ModelLoadInfo::Source::File:
+    ACTS_INFO(fmt::format("Loaded and optimized model in {:.1f} ms", loadInfo.loadTimeMs));
+    if (!loadInfo.optimizedModelPath.empty()) {
+      ACTS_INFO(fmt::format("Cached optimized model to {}", loadInfo.optimizedModelPath));
+    }
+    break;
+  case mlutils::ModelLoadInfo::Source::OptimizedCache:
+    ACTS_INFO(fmt::format("Loaded cached optimized model from {} in {:.1f} ms (saved {:.1f} ms w.r.t. optimizing the "
+                          "original model)",
+                          loadInfo.optimizedModelPath, loadInfo.loadTimeMs,
+                          loadInfo.referenceLoadTimeMs - loadInfo.loadTimeMs));
+    break;
+  case mlutils::ModelLoadInfo::Source::SharedSession:
+    ACTS_INFO("Re-using already loaded model");
+    break;
+  }
 
-  // Create torch tensor from existing data without copying
-  auto torchTensor = torch::from_blob(const_cast<void*>(data), shape, torchType);
-  return torchTensor;
+  if (config().batchEvents) {
+    const auto& batching = config().batchingConfig;
+    ACTS_INFO(fmt::format("Batching the embedding of concurrent events (max. {} hits, max. {} events, max. wait time "
+                          "{} us)",
+                          batching.maxBatchRows, batching.maxBatchRequests, batching.maxWaitTime.count()));
+    m_batcher = std::make_unique<mlutils::InferenceBatcher>(
+        [this](std::span<const float> input, std::size_t numRows, std::span<float> output) {
+          embed(input, numRows, output);
+        },
+        batching);
+  }
 }
 
-} // namespace
+std::optional<std::size_t> OnnxMetricLearning::numInputFeatures() const {
+  const auto& shape = m_model.inputShape(0);
+  if (shape.size() != 2 || shape[1] < 0) {
+    return std::nullopt;
+  }
+  return static_cast<std::size_t>(shape[1]);
+}
 
-OnnxMetricLearning::OnnxMetricLearning(const Config& cfg, std::unique_ptr<const Acts::Logger> lggr)
-    : m_model("MetricLearning", getOnnxLogLevel(lggr->level())), m_config(cfg), m_logger(std::move(lggr)) {
-  ACTS_INFO(fmt::format("Loading model from {}", config().modelPath));
-  m_model.loadModel(config().modelPath);
+void OnnxMetricLearning::embed(std::span<const float> input, std::size_t numRows, std::span<float> output) const {
+  auto buffers = m_bufferPool.acquire();
+  const std::array inputShape = {static_cast<int64_t>(numRows), static_cast<int64_t>(input.size() / numRows)};
+  const std::array<int64_t, 2> outputShape = {static_cast<int64_t>(numRows), config().embeddingDim};
+  buffers->bindInput(input, inputShape);
+  buffers->bindOutput(0, outputShape);
+  m_model.runInference(*buffers);
+  std::ranges::copy(buffers->output(0), output.begin());
 }
 
 ActsPlugins::PipelineTensors OnnxMetricLearning::operator()(std::vector<float>& inputValues, std::size_t numNodes,
                                                             const std::vector<uint64_t>&,
                                                             const ActsPlugins::ExecutionContext& execContext) {
-
   assert(inputValues.size() % numNodes == 0);
-  std::vector inputShape = {static_cast<int64_t>(numNodes), static_cast<int64_t>(inputValues.size() / numNodes)};
-  ACTS_DEBUG(fmt::format("Embedding input tensor shape: {}", inputShape));
-  ACTS_DEBUG(fmt::format("First input space point: {}", std::span(inputValues.data(), inputShape[1])));
+  auto nodeFeatures = ActsPlugins::Tensor<float>::Create({numNodes, inputValues.size() / numNodes}, execContext);
+  std::ranges::copy(inputValues, nodeFeatures.data());
+  return (*this)(std::move(nodeFeatures), execContext);
+}
 
-  const auto outputs = m_model.runInference(inputValues, inputShape);
-  auto embeddedPoints = toTorchTensor(outputs[0]);
-  assert(embeddedPoints.size(0) == inputShape[0]); // Do not change the number of points
-  assert(embeddedPoints.size(1) == config().embeddingDim);
-  ACTS_DEBUG(fmt::format("Embedding output tensor shape: [{}, {}]", embeddedPoints.size(0), embeddedPoints.size(1)));
-  ACTS_VERBOSE(fmt::format("Embedding space of first SP: [{}]", fmt::streamed(embeddedPoints.slice(0, 0, 1))));
+ActsPlugins::PipelineTensors OnnxMetricLearning::operator()(ActsPlugins::Tensor<float> nodeFeatures,
+                                                            const ActsPlugins::ExecutionContext& execContext,
+                                                            Timings* timings) {
+  return constructGraph(std::move(nodeFeatures), nullptr, execContext, timings);
+}
+
+ActsPlugins::PipelineTensors OnnxMetricLearning::operator()(ActsPlugins::Tensor<float> nodeFeatures,
+                                                            const mlutils::HitPartition& partition,
+                                                            const ActsPlugins::ExecutionContext& execContext,
+                                                            Timings* timings) {
+  return constructGraph(std::move(nodeFeatures), &partition, execContext, timings);
+}
+
+ActsPlugins::PipelineTensors OnnxMetricLearning::constructGraph(ActsPlugins::Tensor<float> nodeFeatures,
+                                                                const mlutils::HitPartition* partition,
+                                                                const ActsPlugins::ExecutionContext& execContext,
+                                                                Timings* timings) {
+  const std::array inputShape = {static_cast<int64_t>(nodeFeatures.shape()[0]),
+                                 static_cast<int64_t>(nodeFeatures.shape()[1])};
+  const auto inputValues = std::span<const float>(nodeFeatures.data(), nodeFeatures.size());
+  ACTS_DEBUG(fmt::format("Embedding input tensor shape: {}", inputShape));
+  ACTS_DEBUG(fmt::format("First input space point: {}",
+                         inputValues.first(std::min<std::size_t>(inputShape[1], inputValues.size()))));
+
+  // The embedded points only need to live until the edges are built, after
+  // that the buffers can be re-used for the next event
+  mlutils::ScopedTimer embeddingTimer{timings ? &timings->embeddingMs : nullptr};
+  const std::array<int64_t, 2> outputShape = {inputShape[0], config().embeddingDim};
+  std::optional<mlutils::ObjectPool<mlutils::InferenceBuffers>::Handle> buffers{};
+  std::optional<mlutils::ObjectPool<std::vector<float>>::Handle> embedding{};
+  std::span<const float> embeddedPoints{};
+  if (m_batcher) {
+    embedding.emplace(m_embeddingPool.acquire());
+    auto& points = **embedding;
+    points.resize(outputShape[0] * outputShape[1]);
+    m_batcher->run(inputValues, nodeFeatures.shape()[0], points);
+    embeddedPoints = points;
+  } else {
+    buffers.emplace(m_bufferPool.acquire());
+    (*buffers)->bindInput(inputValues, inputShape);
+    (*buffers)->bindOutput(0, outputShape);
+    m_model.runInference(**buffers);
+    embeddedPoints = (*buffers)->output(0);
+  }
+  embeddingTimer.stop();
+  if (timings) {
+    timings->embeddingRssKb = mlutils::currentRssKb();
+  }
+  ACTS_DEBUG(fmt::format("Embedding output tensor shape: [{}, {}]", outputShape[0], outputShape[1]));
+  ACTS_VERBOSE(fmt::format("Embedding space of first SP: {}",
+                           embeddedPoints.first(std::min<std::size_t>(outputShape[1], embeddedPoints.size()))));
 
   ACTS_DEBUG("Starting to build edges");
-  auto edgeList =
-      ActsPlugins::detail::buildEdges(embeddedPoints, m_config.rVal, m_config.knnVal, m_config.shuffleDirections);
+  mlutils::ScopedTimer edgeBuildingTimer{timings ? &timings->edgeBuildingMs : nullptr};
+  std::optional<ActsPlugins::Tensor<std::int64_t>> edgeIndex{};
+  auto allocateEdges = [&](std::size_t numEdges) {
+    edgeIndex.emplace(ActsPlugins::Tensor<std::int64_t>::Create({2, numEdges}, execContext));
+    return edgeIndex->data();
+  };
+  std::size_t nEdges = 0;
+  if (partition) {
+    ACTS_DEBUG(fmt::format("Building edges in {} sectors with {} nodes in total", partition->numSectors(),
+                           partition->hits.size()));
+    nEdges = m_edgeBuilder.build(embeddedPoints, outputShape[1], *partition, allocateEdges);
+  } else {
+    nEdges = m_edgeBuilder.build(embeddedPoints, outputShape[1], allocateEdges);
+  }
+  edgeBuildingTimer.stop();
   ACTS_DEBUG("Finished building edges");
 
-  ACTS_VERBOSE(fmt::format("Shape of built edges: ({}, {})", edgeList.size(0), edgeList.size(1)));
-  ACTS_VERBOSE(fmt::format("Slice of edgeList: {}", fmt::streamed(edgeList.slice(1, 0, 5))));
+  ACTS_VERBOSE(fmt::format("Shape of built edges: (2, {})", nEdges));
+  const auto nPrint = std::min<std::size_t>(nEdges, 5);
+  ACTS_VERBOSE(fmt::format("Slice of edgeList: {} -> {}", std::span(edgeIndex->data(), nPrint),
+                           std::span(edgeIndex->data() + nEdges, nPrint)));
 
-  return {ActsPlugins::detail::torchToActsTensor<float>(
-              ActsPlugins::detail::vectorToTensor2D(inputValues, inputShape[1]), execContext),
-          ActsPlugins::detail::torchToActsTensor<int64_t>(edgeList, execContext), std::nullopt, std::nullopt};
+  return {std::move(nodeFeatures), std::move(*edgeIndex), std::nullopt, std::nullopt};
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "EdgeBuilding.h"
+#include "InferenceBatcher.h"
 #include "ONNXInferenceModel.h"
+#include "ObjectPool.h"
 
 #include <Acts/Utilities/Logger.hpp>
 #if __has_include("ActsPlugins/Gnn/Stages.hpp")
@@ -12,12 +15,17 @@
 namespace ActsPlugins {
 using ExecutionContext = Acts::ExecutionContext;
 using PipelineTensors = Acts::PipelineTensors;
+template <typename T>
+using Tensor = Acts::Tensor<T>;
 } // namespace ActsPlugins
 #endif
 
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
 // Implementing this class close to what Acts does for Torch in a way that would
 // make it somewhat straight forward to move it to Acts once it has matured
@@ -30,22 +38,82 @@ public:
     float rVal{1.6};               // Same as TorchMetricLearning
     float knnVal{500.};            // Same as TorchMetricLearning
     bool shuffleDirections{false}; // Same as TorchMetricLearning
+    // Threads for the edge building (or over sectors for partitioned events)
+    unsigned edgeBuildingThreads{1};
 
     // For edge features
     float phiScale = 3.141592654; // Same as TorchmetricLearning
+
+    // Configuration of the ONNX Runtime session for the embedding model
+    mlutils::SessionConfig sessionConfig{};
+
+    // Run the embedding model on the hits of several concurrent events at once
+    bool batchEvents{false};
+    mlutils::BatchingConfig batchingConfig{};
+  };
+
+  /// Time spent in the steps of the graph construction
+  struct Timings {
+    /// Includes the time waiting for other events if events are batched
+    double embeddingMs{0};
+    double edgeBuildingMs{0};
+    /// Current RSS of the process after the embedding
+    long embeddingRssKb{0};
   };
 
   OnnxMetricLearning(const Config& cfg, std::unique_ptr<const Acts::Logger> logger);
   ~OnnxMetricLearning() = default;
 
+  /// Copies the node features into the node feature tensor of the output
   ActsPlugins::PipelineTensors operator()(std::vector<float>& inputValues, std::size_t numNodes,
                                           const std::vector<uint64_t>& moduleIds,
                                           const ActsPlugins::ExecutionContext& execContext = {}) override;
 
+  /// Run the graph construction on node features that already are in a
+  /// [numNodes, numFeatures] tensor. The tensor is handed on to the returned
+  /// PipelineTensors without copying it. If timings are passed, the time of
+  /// the individual steps is added to them
+  ActsPlugins::PipelineTensors operator()(ActsPlugins::Tensor<float> nodeFeatures,
+                                          const ActsPlugins::ExecutionContext& execContext = {},
+                                          Timings* timings = nullptr);
+
+  /// Same as above, but the edges are only built between nodes in the same
+  /// sector of the partition. The sectors are processed in parallel
+  ActsPlugins::PipelineTensors operator()(ActsPlugins::Tensor<float> nodeFeatures,
+                                          const mlutils::HitPartition& partition,
+                                          const ActsPlugins::ExecutionContext& execContext = {},
+                                          Timings* timings = nullptr);
+
   const Config& config() const { return m_config; }
 
+  /// The embedding model, e.g. to get its profile
+  const mlutils::ONNXInferenceModel& model() const { return m_model; }
+
+  /// The number of node features of the embedding model (empty if the model
+  /// does not fix it)
+  std::optional<std::size_t> numInputFeatures() const;
+
+  /// The statistics of the combined embedding model calls (all zero if events
+  /// are not batched)
+  mlutils::BatchingStats batchingStats() const { return m_batcher ? m_batcher->stats() : mlutils::BatchingStats{}; }
+
 private:
+  ActsPlugins::PipelineTensors constructGraph(ActsPlugins::Tensor<float> nodeFeatures,
+                                              const mlutils::HitPartition* partition,
+                                              const ActsPlugins::ExecutionContext& execContext, Timings* timings);
+
+  /// Run the embedding model on [numRows, numFeatures] input and copy the
+  /// result into output. Used for the batched events
+  void embed(std::span<const float> input, std::size_t numRows, std::span<float> output) const;
+
   mlutils::ONNXInferenceModel m_model;
+  // Re-usable inference buffers for each thread that runs the graph construction
+  mutable mlutils::ObjectPool<mlutils::InferenceBuffers> m_bufferPool;
+  mlutils::RadiusEdgeBuilder m_edgeBuilder;
+  // Only set if events are batched. The embedded points of each event are
+  // then written into a buffer from the embedding pool
+  std::unique_ptr<mlutils::InferenceBatcher> m_batcher{nullptr};
+  mutable mlutils::ObjectPool<std::vector<float>> m_embeddingPool;
 
   Config m_config;
 
@@ -0,0 +1,35 @@
+#include "UnionFindTrackBuilding.h"
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+UnionFindTrackBuilding::UnionFindTrackBuilding(const Config& cfg, std::unique_ptr<const Acts::Logger> lggr)
+    : m_builder(cfg), m_logger(std::move(lggr)) {}
+
+std::vector<std::vector<int>> UnionFindTrackBuilding::operator()(ActsPlugins::PipelineTensors tensors,
+                                                                 std::vector<int>& spacePointIDs,
+                                                                 const ActsPlugins::ExecutionContext& execContext) {
+  if (execContext.device.type != ActsPlugins::Device::Type::eCPU) {
+    throw std::runtime_error("The union-find track building is only implemented for tensors on the CPU");
+  }
+  const auto numNodes = tensors.nodeFeatures.shape()[0];
+  if (spacePointIDs.size() != numNodes) {
+    throw std::invalid_argument(
+        fmt::format("Got {} space point ids for a graph with {} nodes", spacePointIDs.size(), numNodes));
+  }
+
+  const auto& edgeIndex = tensors.edgeIndex;
+  std::span<const float> scores{};
+  if (tensors.edgeScores) {
+    scores = std::span(tensors.edgeScores->data(), tensors.edgeScores->size());
+  }
+  ACTS_DEBUG(fmt::format("Building tracks from {} edges between {} nodes", edgeIndex.shape()[1], numNodes));
+  auto candidates = m_builder.build(std::span<const std::int64_t>(edgeIndex.data(), edgeIndex.size()), scores,
+                                    std::span<const int>(spacePointIDs));
+  ACTS_DEBUG(fmt::format("Found {} track candidates", candidates.size()));
+  return candidates;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "TrackBuilding.h"
+
+#include <Acts/Utilities/Logger.hpp>
+#if __has_include("ActsPlugins/Gnn/Stages.hpp")
+#include <ActsPlugins/Gnn/Stages.hpp>
+#else
+#include <Acts/Plugins/Gnn/Stages.hpp>
+namespace ActsPlugins {
+using Device = Acts::Device;
+using ExecutionContext = Acts::ExecutionContext;
+using PipelineTensors = Acts::PipelineTensors;
+using TrackBuildingBase = Acts::TrackBuildingBase;
+} // namespace ActsPlugins
+#endif
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Track building via a (concurrent) union-find over the edges, see
+ * mlutils::UnionFindTrackBuilder
+ *
+ * Gives the same candidates as the BoostTrackBuilding of the Acts GNN plugin,
+ * but without building an intermediate graph.
+ */
+class UnionFindTrackBuilding final : public ActsPlugins::TrackBuildingBase {
+public:
+  using Config = mlutils::UnionFindTrackBuilder::Config;
+
+  UnionFindTrackBuilding(const Config& cfg, std::unique_ptr<const Acts::Logger> logger);
+
+  /// @throws std::invalid_argument if the number of space points does not
+  /// match the number of nodes
+  std::vector<std::vector<int>> operator()(ActsPlugins::PipelineTensors tensors, std::vector<int>& spacePointIDs,
+                                           const ActsPlugins::ExecutionContext& execContext = {}) override;
+
+  const Config& config() const { return m_builder.config(); }
+
+private:
+  mlutils::UnionFindTrackBuilder m_builder;
+
+  const auto& logger() const { return *m_logger; }
+  std::unique_ptr<const Acts::Logger> m_logger{nullptr};
+};
@@ -0,0 +1,79 @@
+#include "ONNXInferenceModel.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+const std::string modelDir = MLTRACKING_BENCHMARK_MODEL_DIR;
+constexpr std::int64_t numFeatures = 4;
+
+std::vector<float> randomFeatures(std::size_t nHits, unsigned seed = 42) {
+  std::mt19937 rng{seed};
+  std::normal_distribution<float> dist{0.f, 1.f};
+  std::vector<float> features(nHits * numFeatures);
+  for (auto& feature : features) {
+    feature = dist(rng);
+  }
+  return features;
+}
+
+/// Load one of the generated models. The default SessionConfig runs the models
+/// on a single thread, which keeps the results reproducible
+std::unique_ptr<mlutils::ONNXInferenceModel> loadModel(benchmark::State& state, const std::string& modelName) {
+  auto model = std::make_unique<mlutils::ONNXInferenceModel>(modelName);
+  if (!model->loadModel(modelDir + "/" + modelName)) {
+    state.SkipWithError(("Could not load " + modelDir + "/" + modelName).c_str());
+    return nullptr;
+  }
+  return model;
+}
+
+/// runInference allocating the output tensors in every call
+void BM_RunInference(benchmark::State& state, const std::string& modelName) {
+  const auto model = loadModel(state, modelName);
+  if (!model) {
+    return;
+  }
+  const auto nHits = state.range(0);
+  const auto features = randomFeatures(nHits);
+  const std::vector<std::int64_t> shape = {nHits, numFeatures};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model->runInference(features, shape));
+  }
+  state.SetItemsProcessed(state.iterations() * nHits);
+}
+BENCHMARK_CAPTURE(BM_RunInference, affine, std::string("affine.onnx"))->Arg(1000)->Arg(20000)->Arg(100000);
+BENCHMARK_CAPTURE(BM_RunInference, mlp, std::string("mlp.onnx"))->Arg(1000)->Arg(20000)->Arg(100000);
+
+/// runInference with re-used input and output bindings
+void BM_RunInferenceBuffers(benchmark::State& state, const std::string& modelName, std::int64_t outputWidth) {
+  const auto model = loadModel(state, modelName);
+  if (!model) {
+    return;
+  }
+  const auto nHits = state.range(0);
+  const auto features = randomFeatures(nHits);
+  const std::array<std::int64_t, 2> shape = {nHits, numFeatures};
+  mlutils::InferenceBuffers buffers{*model};
+  buffers.bindInput(features, shape);
+  const std::array<std::int64_t, 2> outputShape = {nHits, outputWidth};
+  buffers.bindOutput(0, outputShape);
+  for (auto _ : state) {
+    model->runInference(buffers);
+    benchmark::DoNotOptimize(buffers.output(0).data());
+  }
+  state.SetItemsProcessed(state.iterations() * nHits);
+}
+BENCHMARK_CAPTURE(BM_RunInferenceBuffers, affine, std::string("affine.onnx"), numFeatures)
+    ->Arg(1000)
+    ->Arg(20000)
+    ->Arg(100000);
+BENCHMARK_CAPTURE(BM_RunInferenceBuffers, mlp, std::string("mlp.onnx"), 8)->Arg(1000)->Arg(20000)->Arg(100000);
+
+} // namespace
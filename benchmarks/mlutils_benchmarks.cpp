@@ -0,0 +1,170 @@
+#include "HitFeatures.h"
+#include "ONNXInferenceModel.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+/// Number of hits that are typical for the events we process
+constexpr std::int64_t typicalHits = 20000;
+
+/// Hits with random (but reproducible) positions and times
+mlutils::HitArrays randomHits(std::size_t nHits, unsigned seed = 42) {
+  std::mt19937 rng{seed};
+  std::uniform_real_distribution<float> dist{-1500.f, 1500.f};
+  mlutils::HitArrays hits{};
+  hits.reserve(nHits);
+  for (std::size_t i = 0; i < nHits; ++i) {
+    hits.push_back(dist(rng), dist(rng), dist(rng), dist(rng));
+  }
+  return hits;
+}
+
+/// The hit counts for which the size dependent benchmarks run
+void hitCounts(benchmark::internal::Benchmark* bench) {
+  bench->Arg(1000)->Arg(typicalHits)->Arg(100000);
+}
+
+void setProcessed(benchmark::State& state, std::size_t itemsPerIteration, std::size_t bytesPerIteration) {
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(itemsPerIteration));
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(bytesPerIteration));
+}
+
+// flatten and getDimensions on [nHits, 4] inputs
+
+void BM_FlattenNested2D(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const std::vector<std::vector<float>> nested(nHits, std::vector<float>{1.f, 2.f, 3.f, 4.f});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::flatten(nested));
+  }
+  setProcessed(state, nHits, nHits * 4 * sizeof(float));
+}
+BENCHMARK(BM_FlattenNested2D)->Apply(hitCounts);
+
+void BM_FlattenArrays2D(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const std::vector<std::array<float, 4>> arrays(nHits, std::array{1.f, 2.f, 3.f, 4.f});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::flatten(arrays));
+  }
+  setProcessed(state, nHits, nHits * 4 * sizeof(float));
+}
+BENCHMARK(BM_FlattenArrays2D)->Apply(hitCounts);
+
+void BM_GetDimensionsNested2D(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const std::vector<std::vector<float>> nested(nHits, std::vector<float>{1.f, 2.f, 3.f, 4.f});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::getDimensions(nested));
+  }
+}
+BENCHMARK(BM_GetDimensionsNested2D)->Arg(typicalHits);
+
+// flatten and getDimensions on [nEdges, 2, 4] inputs, i.e. the features of the
+// two hits of each edge
+
+void BM_FlattenNested3D(benchmark::State& state) {
+  const auto nEdges = static_cast<std::size_t>(state.range(0));
+  const std::vector<std::vector<std::vector<float>>> nested(
+      nEdges, std::vector<std::vector<float>>(2, std::vector<float>{1.f, 2.f, 3.f, 4.f}));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::flatten(nested));
+  }
+  setProcessed(state, nEdges, nEdges * 8 * sizeof(float));
+}
+BENCHMARK(BM_FlattenNested3D)->Apply(hitCounts);
+
+void BM_FlattenArrays3D(benchmark::State& state) {
+  const auto nEdges = static_cast<std::size_t>(state.range(0));
+  using EdgeFeatures = std::array<std::array<float, 4>, 2>;
+  const std::vector<EdgeFeatures> arrays(nEdges, EdgeFeatures{{{1.f, 2.f, 3.f, 4.f}, {5.f, 6.f, 7.f, 8.f}}});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::flatten(arrays));
+  }
+  setProcessed(state, nEdges, nEdges * 8 * sizeof(float));
+}
+BENCHMARK(BM_FlattenArrays3D)->Apply(hitCounts);
+
+void BM_GetDimensionsNested3D(benchmark::State& state) {
+  const auto nEdges = static_cast<std::size_t>(state.range(0));
+  const std::vector<std::vector<std::vector<float>>> nested(
+      nEdges, std::vector<std::vector<float>>(2, std::vector<float>{1.f, 2.f, 3.f, 4.f}));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mlutils::getDimensions(nested));
+  }
+}
+BENCHMARK(BM_GetDimensionsNested3D)->Arg(typicalHits);
+
+// Packing the hit information into the node features of the models
+
+/// The way the features used to be packed, i.e. one (heap allocated) row per
+/// hit that is flattened afterwards
+void BM_PackHitFeaturesNested(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const auto hits = randomHits(nHits);
+  for (auto _ : state) {
+    std::vector<std::vector<float>> nested{};
+    nested.reserve(nHits);
+    for (std::size_t i = 0; i < nHits; ++i) {
+      nested.push_back({std::hypot(hits.x[i], hits.y[i]), std::atan2(hits.y[i], hits.x[i]), hits.z[i], hits.time[i]});
+    }
+    benchmark::DoNotOptimize(mlutils::flatten(nested));
+  }
+  setProcessed(state, nHits, nHits * 4 * sizeof(float));
+}
+BENCHMARK(BM_PackHitFeaturesNested)->Apply(hitCounts);
+
+void BM_HitFeatureExtractor(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const auto hits = randomHits(nHits);
+  const mlutils::HitFeatureExtractor extractor{};
+  std::vector<float> features(nHits * extractor.numFeatures());
+  for (auto _ : state) {
+    extractor.extract(hits, features);
+    benchmark::DoNotOptimize(features.data());
+    benchmark::ClobberMemory();
+  }
+  setProcessed(state, nHits, features.size() * sizeof(float));
+}
+BENCHMARK(BM_HitFeatureExtractor)->Apply(hitCounts);
+
+/// The same features in an order without compiled layout, i.e. extracted
+/// column by column
+void BM_HitFeatureExtractorGeneric(benchmark::State& state) {
+  using mlutils::HitFeature;
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const auto hits = randomHits(nHits);
+  const mlutils::HitFeatureExtractor extractor{
+      {.features = {HitFeature::Phi, HitFeature::R, HitFeature::Z, HitFeature::Time}, .scales = {}}};
+  std::vector<float> features(nHits * extractor.numFeatures());
+  for (auto _ : state) {
+    extractor.extract(hits, features);
+    benchmark::DoNotOptimize(features.data());
+    benchmark::ClobberMemory();
+  }
+  setProcessed(state, nHits, features.size() * sizeof(float));
+}
+BENCHMARK(BM_HitFeatureExtractorGeneric)->Apply(hitCounts);
+
+void BM_ComputeRPhi(benchmark::State& state) {
+  const auto nHits = static_cast<std::size_t>(state.range(0));
+  const auto hits = randomHits(nHits);
+  std::vector<float> r(nHits);
+  std::vector<float> phi(nHits);
+  for (auto _ : state) {
+    mlutils::computeRPhi(hits.x, hits.y, r, phi);
+    benchmark::DoNotOptimize(r.data());
+    benchmark::DoNotOptimize(phi.data());
+    benchmark::ClobberMemory();
+  }
+  setProcessed(state, nHits, 2 * nHits * sizeof(float));
+}
+BENCHMARK(BM_ComputeRPhi)->Apply(hitCounts);
+
+} // namespace
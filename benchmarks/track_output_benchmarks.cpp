@@ -0,0 +1,97 @@
+#include "MultiCollectionView.h"
+#include "TrackOutput.h"
+
+#include <edm4hep/TrackCollection.h>
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+using HitView = mlutils::MultiCollectionView<edm4hep::TrackerHitPlaneCollection>;
+
+constexpr std::size_t minHitsPerTrack = 3;
+
+/// The hits of an event, split over a few collections as for the different
+/// sub-detectors
+struct Event {
+  std::vector<edm4hep::TrackerHitPlaneCollection> collections{};
+  std::vector<const edm4hep::TrackerHitPlaneCollection*> collectionPtrs{};
+  HitView hits{};
+  /// Candidates with 1 to 12 hits, i.e. many of them are rejected
+  std::vector<std::vector<int>> candidates{};
+};
+
+Event makeEvent(std::size_t nHits, unsigned seed = 42) {
+  constexpr std::size_t numCollections = 4;
+  Event event{};
+  event.collections.resize(numCollections);
+  for (std::size_t i = 0; i < nHits; ++i) {
+    auto hit = event.collections[i % numCollections].create();
+    hit.setCellID(i);
+  }
+  for (const auto& coll : event.collections) {
+    event.collectionPtrs.push_back(&coll);
+  }
+  event.hits.reset(event.collectionPtrs);
+
+  std::vector<int> hitIdcs(nHits);
+  std::iota(hitIdcs.begin(), hitIdcs.end(), 0);
+  std::mt19937 rng{seed};
+  std::shuffle(hitIdcs.begin(), hitIdcs.end(), rng);
+  std::uniform_int_distribution<std::size_t> candSize{1, 12};
+  for (std::size_t i = 0; i < nHits;) {
+    const auto size = std::min(candSize(rng), nHits - i);
+    event.candidates.emplace_back(hitIdcs.begin() + i, hitIdcs.begin() + i + size);
+    i += size;
+  }
+  return event;
+}
+
+edm4hep::TrackState firstHitState() {
+  auto trackState = edm4hep::TrackState{};
+  trackState.location = edm4hep::TrackState::AtFirstHit;
+  return trackState;
+}
+
+/// The way the output used to be filled, i.e. one candidate at a time
+void BM_FillTracksPerCandidate(benchmark::State& state) {
+  const auto event = makeEvent(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    edm4hep::TrackCollection tracks{};
+    for (const auto& candIdcs : event.candidates) {
+      if (candIdcs.size() < minHitsPerTrack) {
+        continue;
+      }
+      auto track = tracks.create();
+      for (const auto idx : candIdcs) {
+        track.addToTrackerHits(event.hits[idx]);
+      }
+      track.addToTrackStates(firstHitState());
+    }
+    benchmark::DoNotOptimize(tracks);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(event.candidates.size()));
+}
+BENCHMARK(BM_FillTracksPerCandidate)->Arg(1000)->Arg(20000)->Arg(100000);
+
+/// The shared output code, i.e. with one track state for all tracks and the
+/// collection reserved up front (if podio supports that)
+void BM_FillTracks(benchmark::State& state) {
+  const auto event = makeEvent(static_cast<std::size_t>(state.range(0)));
+  const auto trackState = firstHitState();
+  for (auto _ : state) {
+    edm4hep::TrackCollection tracks{};
+    mlutils::fillTracks(event.candidates, minHitsPerTrack, event.hits, trackState, tracks);
+    benchmark::DoNotOptimize(tracks);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(event.candidates.size()));
+}
+BENCHMARK(BM_FillTracks)->Arg(1000)->Arg(20000)->Arg(100000);
+
+} // namespace
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Create reduced precision variants of an (fp32) ONNX model
+
+The variants are written next to the original model (or into --output-dir) as
+<model>.int8.onnx and <model>.fp16.onnx, which is where ONNXInferenceModel
+looks for them when a reduced precision is configured.
+
+- int8: Dynamic quantization via ONNX Runtime. The weights of the MatMul and
+  Gemm operators are quantized ahead of time, the activations are quantized on
+  the fly. Inputs and outputs stay fp32.
+- fp16: The (larger) weights are stored as fp16 and cast back to fp32 in the
+  graph. This halves the size of the model, but ONNX Runtime folds the casts
+  when loading the model on the CPU, i.e. the computations remain fp32.
+
+Use validate_quantized_model.py to check the impact on the track finding.
+"""
+
+import argparse
+import tempfile
+from pathlib import Path
+
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+PRECISION_METADATA_KEY = "mltracking.precision"
+
+
+def variant_path(model_path, precision, output_dir=None):
+    """The path of the variant of a model, e.g. model.int8.onnx for model.onnx"""
+    model_path = Path(model_path)
+    output_dir = Path(output_dir) if output_dir else model_path.parent
+    return output_dir / f"{model_path.stem}.{precision}{model_path.suffix}"
+
+
+def set_precision_metadata(model, precision):
+    """Record the precision in the metadata of the model"""
+    for prop in model.metadata_props:
+        if prop.key == PRECISION_METADATA_KEY:
+            prop.value = precision
+            return
+    model.metadata_props.append(onnx.StringStringEntryProto(key=PRECISION_METADATA_KEY, value=precision))
+
+
+def quantize_int8(model_path, output_path, per_channel=False):
+    """Dynamically quantize the MatMul and Gemm operators of a model to int8"""
+    # Only imported here, such that the fp16 conversion also works without it
+    from onnxruntime.quantization import QuantType, quantize_dynamic
+    from onnxruntime.quantization.shape_inference import quant_pre_process
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        # Shape inference and graph optimizations before quantizing allow to
+        # quantize more of the model
+        preprocessed = Path(tmp_dir) / "preprocessed.onnx"
+        quant_pre_process(str(model_path), str(preprocessed), skip_symbolic_shape=True)
+        quantize_dynamic(
+            model_input=str(preprocessed),
+            model_output=str(output_path),
+            op_types_to_quantize=["MatMul", "Gemm"],
+            per_channel=per_channel,
+            weight_type=QuantType.QInt8,
+        )
+    model = onnx.load(str(output_path))
+    set_precision_metadata(model, "int8")
+    onnx.save(model, str(output_path))
+
+
+def convert_fp16_weights(model, min_elements=16):
+    """
+    Store all float initializers with at least min_elements elements as fp16
+    and insert Cast nodes that convert them back to fp32 at the start of the
+    graph. Smaller initializers (e.g. scalar constants) are kept as they are.
+    """
+    model = onnx.ModelProto.FromString(model.SerializeToString())
+    graph = model.graph
+    cast_nodes = []
+    for init in graph.initializer:
+        if init.data_type != TensorProto.FLOAT:
+            continue
+        values = numpy_helper.to_array(init)
+        if values.size < min_elements:
+            continue
+        name = init.name
+        init.CopyFrom(numpy_helper.from_array(values.astype(np.float16), f"{name}_fp16"))
+        cast_nodes.append(helper.make_node("Cast", [f"{name}_fp16"], [name], to=TensorProto.FLOAT))
+
+    # The casts have to come before their first use for the graph to stay
+    # topologically sorted
+    nodes = cast_nodes + list(graph.node)
+    del graph.node[:]
+    graph.node.extend(nodes)
+    set_precision_metadata(model, "fp16")
+    onnx.checker.check_model(model)
+    return model
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Create reduced precision variants of an ONNX model")
+    parser.add_argument("models", help="The fp32 ONNX model(s)", nargs="+", type=Path)
+    parser.add_argument(
+        "--precision",
+        help="The variants to create (default: %(default)s)",
+        choices=["int8", "fp16"],
+        nargs="+",
+        default=["int8"],
+    )
+    parser.add_argument("--output-dir", help="Directory for the variants (default: next to the model)", type=Path)
+    parser.add_argument(
+        "--per-channel", help="Quantize the int8 weights per output channel", action="store_true", default=False
+    )
+    args = parser.parse_args()
+
+    if args.output_dir:
+        args.output_dir.mkdir(parents=True, exist_ok=True)
+
+    for model_path in args.models:
+        for precision in args.precision:
+            output_path = variant_path(model_path, precision, args.output_dir)
+            if precision == "int8":
+                quantize_int8(model_path, output_path, args.per_channel)
+            else:
+                onnx.save(convert_fp16_weights(onnx.load(str(model_path))), str(output_path))
+
+            size_ratio = output_path.stat().st_size / model_path.stat().st_size
+            print(f"Wrote {output_path} ({size_ratio:.2f} x the size of {model_path.name})")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+"""Compare reduced precision variants of the models against the fp32 baseline
+
+Runs the node embedding, edge building, edge classification and a connected
+components track building (as the BoostTrackBuilding) with the fp32 models and
+with their reduced precision variants (see quantize_model.py) and reports
+- the deviation of the embedded hits (in units of the edge building radius)
+  and the fraction of fp32 edges that are also built with the variant
+- the deviation of the edge scores on the same (fp32) edges and the fraction
+  of edges for which the decision of the cut changes
+- the fraction of fp32 tracks that are still found with the variant models
+  (double majority matching) as a measure of the impact on the efficiency
+- the inference time of both model variants
+
+The hits are either read from an EDM4hep file (requires podio) or generated
+randomly.
+"""
+
+import argparse
+import time
+from pathlib import Path
+
+import numpy as np
+import onnxruntime as ort
+
+from quantize_model import variant_path
+
+DEFAULT_COLLECTIONS = [
+    "IBTrackerHits",
+    "IETrackerHits",
+    "OBTrackerHits",
+    "OETrackerHits",
+    "VBTrackerHits",
+    "VETrackerHits",
+]
+
+
+def read_hits(input_file, collections, max_events):
+    """Read the x, y, z and time of the hits of each event from an EDM4hep file"""
+    from podio.reading import get_reader
+
+    reader = get_reader(input_file)
+    for i, frame in enumerate(reader.get("events")):
+        if i >= max_events:
+            break
+        hits = [
+            [hit.getPosition().x, hit.getPosition().y, hit.getPosition().z, hit.getTime()]
+            for name in collections
+            for hit in frame.get(name)
+        ]
+        yield np.array(hits, dtype=np.float32).reshape(-1, 4)
+
+
+def synthetic_hits(n_hits, n_events, seed=42):
+    """Hits of straight tracks from the origin crossing a few barrel layers"""
+    layer_radii = np.array([39, 51, 74, 102, 127, 340, 554, 819, 1153, 1486], dtype=np.float32)
+    rng = np.random.default_rng(seed)
+    for _ in range(n_events):
+        n_tracks = n_hits // len(layer_radii) + 1
+        phi = rng.uniform(-np.pi, np.pi, size=(n_tracks, 1))
+        eta = rng.uniform(-1.5, 1.5, size=(n_tracks, 1))
+        r = np.broadcast_to(layer_radii, (n_tracks, len(layer_radii)))
+        x = r * np.cos(phi) + rng.normal(0, 0.05, size=r.shape)
+        y = r * np.sin(phi) + rng.normal(0, 0.05, size=r.shape)
+        z = r * np.sinh(eta)
+        t = r * np.cosh(eta) / 299.792458
+        yield np.stack([x, y, z, t], axis=-1).reshape(-1, 4)[:n_hits].astype(np.float32)
+
+
+def hit_features(hits, features, scales):
+    """The node features in the same way as the HitFeatureExtractor"""
+    columns = {
+        "x": hits[:, 0],
+        "y": hits[:, 1],
+        "z": hits[:, 2],
+        "r": np.hypot(hits[:, 0], hits[:, 1]),
+        "phi": np.arctan2(hits[:, 1], hits[:, 0]),
+        "time": hits[:, 3],
+    }
+    node_features = np.stack([columns[f] for f in features], axis=1).astype(np.float32)
+    if scales:
+        node_features /= np.array(scales, dtype=np.float32)
+    return node_features
+
+
+def build_edges(points, radius, knn, chunk_size=2048):
+    """
+    Connect all points within radius, keeping at most the knn closest
+    neighbours of each point. Returns the (sorted) unique undirected edges as
+    an [n_edges, 2] array with the smaller index first
+    """
+    n_points = len(points)
+    edges = []
+    sq_norms = (points**2).sum(axis=1)
+    for start in range(0, n_points, chunk_size):
+        chunk = points[start : start + chunk_size]
+        dist2 = sq_norms[start : start + chunk_size, None] + sq_norms[None, :] - 2 * chunk @ points.T
+        rows = np.arange(len(chunk))
+        dist2[rows, start + rows] = np.inf
+        if knn < n_points - 1:
+            idcs = np.argpartition(dist2, knn, axis=1)[:, :knn]
+            close = np.take_along_axis(dist2, idcs, axis=1) <= radius**2
+            src, col = np.nonzero(close)
+            dst = idcs[src, col]
+        else:
+            src, dst = np.nonzero(dist2 <= radius**2)
+        edges.append(np.stack([start + src, dst], axis=1))
+
+    edges = np.concatenate(edges) if edges else np.empty((0, 2), dtype=np.int64)
+    return np.unique(np.sort(edges, axis=1), axis=0).astype(np.int64)
+
+
+def build_tracks(n_hits, edges, min_hits):
+    """Connected components of the graph, as a list of sets of hit indices"""
+    parent = np.arange(n_hits)
+
+    def find(i):
+        while parent[i] != i:
+            parent[i] = parent[parent[i]]
+            i = parent[i]
+        return i
+
+    for src, dst in edges:
+        root_src, root_dst = find(src), find(dst)
+        if root_src != root_dst:
+            parent[root_src] = root_dst
+
+    roots = np.array([find(i) for i in range(n_hits)])
+    tracks = {}
+    for hit, root in enumerate(roots):
+        tracks.setdefault(root, set()).add(hit)
+    return [hits for hits in tracks.values() if len(hits) >= min_hits]
+
+
+def matched_fraction(reference_tracks, tracks):
+    """
+    Fraction of the reference tracks that have a match, i.e. a track that
+    shares more than half of its hits with the reference track and vice versa
+    """
+    if not reference_tracks:
+        return 1.0
+    track_of_hit = {hit: i for i, track in enumerate(tracks) for hit in track}
+    n_matched = 0
+    for ref in reference_tracks:
+        candidates, counts = np.unique([track_of_hit.get(hit, -1) for hit in ref], return_counts=True)
+        best = np.argmax(np.where(candidates >= 0, counts, 0))
+        if candidates[best] < 0:
+            continue
+        shared = counts[best]
+        if shared > len(ref) / 2 and shared > len(tracks[candidates[best]]) / 2:
+            n_matched += 1
+    return n_matched / len(reference_tracks)
+
+
+def sigmoid(x):
+    return 1 / (1 + np.exp(-x))
+
+
+class Models:
+    """The embedding and the edge classifier model of one precision"""
+
+    def __init__(self, embedding_path, classifier_path, n_threads):
+        options = ort.SessionOptions()
+        options.intra_op_num_threads = n_threads
+        options.inter_op_num_threads = 1
+        self.embedding = ort.InferenceSession(str(embedding_path), options, providers=["CPUExecutionProvider"])
+        self.classifier = ort.InferenceSession(str(classifier_path), options, providers=["CPUExecutionProvider"])
+        if len(self.classifier.get_inputs()) != 2:
+            raise ValueError(f"{classifier_path} has to have exactly two inputs (node features and edge index)")
+        self.embedding_time = 0.0
+        self.classifier_time = 0.0
+
+    def embed(self, node_features):
+        start = time.perf_counter()
+        result = self.embedding.run(None, {self.embedding.get_inputs()[0].name: node_features})[0]
+        self.embedding_time += time.perf_counter() - start
+        return result
+
+    def classify(self, node_features, edges, timed=True):
+        inputs = self.classifier.get_inputs()
+        start = time.perf_counter()
+        scores = self.classifier.run(
+            None, {inputs[0].name: node_features, inputs[1].name: np.ascontiguousarray(edges.T)}
+        )[0]
+        if timed:
+            self.classifier_time += time.perf_counter() - start
+        return sigmoid(scores.reshape(-1))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.split("\n")[0], formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument("input_file", help="EDM4hep input file (synthetic hits if not given)", nargs="?")
+    parser.add_argument("--embedding-model", help="The fp32 embedding model", required=True, type=Path)
+    parser.add_argument("--edge-classifier-model", help="The fp32 edge classifier model", required=True, type=Path)
+    parser.add_argument("--precision", help="The variant to validate", choices=["int8", "fp16"], default="int8")
+    parser.add_argument("--collections", help="The input hit collections", nargs="+", default=DEFAULT_COLLECTIONS)
+    parser.add_argument("--events", help="Number of events", type=int, default=10)
+    parser.add_argument("--synthetic-hits", help="Number of hits per synthetic event", type=int, default=10000)
+    parser.add_argument("--features", help="The hit features", nargs="+", default=["r", "phi", "z", "time"])
+    parser.add_argument("--feature-scales", help="Factors by which the features are divided", nargs="+", type=float)
+    parser.add_argument("--radius", help="Edge building radius", type=float, default=0.1)
+    parser.add_argument("--knn", help="Maximum number of neighbours per hit", type=int, default=100)
+    parser.add_argument("--cut", help="Edge classifier cut", type=float, default=0.5)
+    parser.add_argument("--min-hits", help="Minimum number of hits per track", type=int, default=3)
+    parser.add_argument("--threads", help="Intra-op threads of the models", type=int, default=1)
+    args = parser.parse_args()
+
+    baseline = Models(args.embedding_model, args.edge_classifier_model, args.threads)
+    variant = Models(
+        variant_path(args.embedding_model, args.precision),
+        variant_path(args.edge_classifier_model, args.precision),
+        args.threads,
+    )
+
+    if args.input_file:
+        events = read_hits(args.input_file, args.collections, args.events)
+    else:
+        events = synthetic_hits(args.synthetic_hits, args.events)
+
+    embedding_deviations = []
+    edge_recall, edge_excess = [], []
+    score_deviations, flipped = [], []
+    track_fractions, n_tracks = [], []
+    for hits in events:
+        node_features = hit_features(hits, args.features, args.feature_scales)
+
+        ref_embedding = baseline.embed(node_features)
+        var_embedding = variant.embed(node_features)
+        embedding_deviations.append(np.linalg.norm(var_embedding - ref_embedding, axis=1) / args.radius)
+
+        ref_edges = build_edges(ref_embedding, args.radius, args.knn)
+        var_edges = build_edges(var_embedding, args.radius, args.knn)
+        ref_set = set(map(tuple, ref_edges))
+        var_set = set(map(tuple, var_edges))
+        edge_recall.append(len(ref_set & var_set) / max(len(ref_set), 1))
+        edge_excess.append(len(var_set - ref_set) / max(len(ref_set), 1))
+
+        # Compare the classifiers on the same edges, to separate their
+        # deviations from the ones of the embedding
+        ref_scores = baseline.classify(node_features, ref_edges)
+        var_scores = variant.classify(node_features, ref_edges)
+        score_deviations.append(np.abs(var_scores - ref_scores))
+        flipped.append(np.mean((ref_scores > args.cut) != (var_scores > args.cut)) if len(ref_edges) else 0.0)
+
+        ref_tracks = build_tracks(len(hits), ref_edges[ref_scores > args.cut], args.min_hits)
+        var_chain_scores = variant.classify(node_features, var_edges, timed=False)
+        var_tracks = build_tracks(len(hits), var_edges[var_chain_scores > args.cut], args.min_hits)
+        track_fractions.append(matched_fraction(ref_tracks, var_tracks))
+        n_tracks.append((len(ref_tracks), len(var_tracks)))
+
+    if not embedding_deviations:
+        raise SystemExit("No events have been processed")
+    embedding_deviations = np.concatenate(embedding_deviations)
+    score_deviations = np.concatenate(score_deviations)
+    n_events = len(track_fractions)
+
+    print(f"Validated {args.precision} against fp32 on {n_events} events")
+    print("Embedding deviation / radius:")
+    print(
+        f"  mean {embedding_deviations.mean():.4f}, p99 {np.percentile(embedding_deviations, 99):.4f}, "
+        f"max {embedding_deviations.max():.4f}"
+    )
+    print(f"Edges: {100 * np.mean(edge_recall):.2f}% of the fp32 edges kept, {100 * np.mean(edge_excess):.2f}% extra")
+    if len(score_deviations):
+        print("Edge score deviation (on the fp32 edges):")
+        print(
+            f"  mean {score_deviations.mean():.5f}, p99 {np.percentile(score_deviations, 99):.5f}, "
+            f"max {score_deviations.max():.5f}"
+        )
+    print(f"  {100 * np.mean(flipped):.3f}% of the edges change their cut decision")
+    ref_total, var_total = np.sum(n_tracks, axis=0)
+    print(
+        f"Tracks: {100 * np.mean(track_fractions):.2f}% of the fp32 tracks are found "
+        f"({ref_total / n_events:.1f} fp32 vs {var_total / n_events:.1f} {args.precision} tracks per event)"
+    )
+    for name, ref_time, var_time in [
+        ("Embedding", baseline.embedding_time, variant.embedding_time),
+        ("Edge classifier", baseline.classifier_time, variant.classifier_time),
+    ]:
+        print(
+            f"{name} inference: {1000 * ref_time / n_events:.2f} ms (fp32) vs "
+            f"{1000 * var_time / n_events:.2f} ms ({args.precision}) per event, speedup {ref_time / var_time:.2f}"
+        )
+
+
+if __name__ == "__main__":
+    main()
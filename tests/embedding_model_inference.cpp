@@ -1,4 +1,4 @@
-#include "NodeEmbeddingModel.h"
+#include "ONNXInferenceModel.h"
 
 #include "edm4hep/TrackerHitPlaneCollection.h"
 #include "podio/Reader.h"
@@ -7,6 +7,8 @@
 #include "TTree.h"
 
 #include <iostream>
+#include <memory>
+#include <vector>
 
 int main(int argc, char* argv[]) {
   if (argc != 4) {
@@ -14,14 +16,22 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  auto embeddingModel = mlutils::NodeEmbeddingModel("embeddingModel");
+  auto embeddingModel = mlutils::ONNXInferenceModel("embeddingModel");
   embeddingModel.loadModel(argv[1]);
 
   auto reader = podio::makeReader(argv[2]);
   auto event = reader.readEvent(0);
 
   const auto& hits = event.get<edm4hep::TrackerHitPlaneCollection>("IBTrackerHits");
-  auto embeddingInputs = mlutils::NodeEmbeddingModel::extractInformation({&hits});
+  // Same inputs as in the python version, i.e. the raw x, y, z and time of
+  // the hits
+  std::vector<std::vector<float>> embeddingInputs;
+  embeddingInputs.reserve(hits.size());
+  for (const auto& hit : hits) {
+    const auto& position = hit.getPosition();
+    embeddingInputs.push_back({static_cast<float>(position.x), static_cast<float>(position.y),
+                               static_cast<float>(position.z), hit.getTime()});
+  }
 
   const auto embeddingOutput = embeddingModel.runInference(embeddingInputs);
 
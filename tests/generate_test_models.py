@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Generate small ONNX models with known outputs that are used in the unit tests"""
+
+import argparse
+import sys
+from pathlib import Path
+
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent / "scripts"))
+from quantize_model import convert_fp16_weights, quantize_int8, variant_path  # noqa: E402
+
+# Keep this compatible with the ONNX runtime versions in the Key4hep stack
+OPSET_VERSION = 17
+IR_VERSION = 8
+
+
+def make_affine_model(n_features=4):
+    """
+    Create a model that computes outputs = 2 * inputs + 1 for inputs of shape
+    (n_nodes, n_features), with a dynamic number of nodes. This mimics the
+    shape of the metric learning model but has trivially checkable outputs.
+    """
+    scale = numpy_helper.from_array(np.array(2.0, dtype=np.float32), "scale")
+    offset = numpy_helper.from_array(np.array(1.0, dtype=np.float32), "offset")
+
+    nodes = [
+        helper.make_node("Mul", ["inputs", "scale"], ["scaled"]),
+        helper.make_node("Add", ["scaled", "offset"], ["outputs"]),
+    ]
+
+    graph = helper.make_graph(
+        nodes,
+        "affine",
+        [helper.make_tensor_value_info("inputs", TensorProto.FLOAT, ["n_nodes", n_features])],
+        [helper.make_tensor_value_info("outputs", TensorProto.FLOAT, ["n_nodes", n_features])],
+        initializer=[scale, offset],
+    )
+
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET_VERSION)])
+    model.ir_version = IR_VERSION
+    onnx.checker.check_model(model)
+    return model
+
+
+def make_mlp_model(n_features=4, n_hidden=64, n_layers=3, n_outputs=8, seed=42):
+    """
+    Create a per node MLP with random weights that maps inputs of shape
+    (n_nodes, n_features) to outputs of shape (n_nodes, n_outputs). This is
+    closer to the metric learning model in terms of the work per node and is
+    used for benchmarks.
+    """
+    rng = np.random.default_rng(seed)
+    sizes = [n_features] + [n_hidden] * n_layers + [n_outputs]
+    initializers = []
+    nodes = []
+    current = "inputs"
+    for i, (n_in, n_out) in enumerate(zip(sizes[:-1], sizes[1:])):
+        weights = rng.normal(0, 1 / np.sqrt(n_in), size=(n_in, n_out)).astype(np.float32)
+        bias = np.zeros(n_out, dtype=np.float32)
+        initializers += [numpy_helper.from_array(weights, f"w{i}"), numpy_helper.from_array(bias, f"b{i}")]
+        is_last = i == len(sizes) - 2
+        output = "outputs" if is_last else f"hidden{i}"
+        gemm_output = output if is_last else f"linear{i}"
+        nodes.append(helper.make_node("MatMul", [current, f"w{i}"], [f"matmul{i}"]))
+        nodes.append(helper.make_node("Add", [f"matmul{i}", f"b{i}"], [gemm_output]))
+        if not is_last:
+            nodes.append(helper.make_node("Relu", [gemm_output], [output]))
+        current = output
+
+    graph = helper.make_graph(
+        nodes,
+        "mlp",
+        [helper.make_tensor_value_info("inputs", TensorProto.FLOAT, ["n_nodes", n_features])],
+        [helper.make_tensor_value_info("outputs", TensorProto.FLOAT, ["n_nodes", n_outputs])],
+        initializer=initializers,
+    )
+
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET_VERSION)])
+    model.ir_version = IR_VERSION
+    onnx.checker.check_model(model)
+    return model
+
+
+def make_multi_input_model(n_features=3):
+    """
+    Create a model with the inputs of an edge classifier, i.e. node features of
+    shape (n_nodes, n_features) and an edge index of shape (2, n_edges). There
+    are two outputs:
+    - edge_scores: the sum of all features of the two nodes of each edge
+    - node_outputs: 2 * node_features
+    """
+    src_idx = numpy_helper.from_array(np.array(0, dtype=np.int64), "src_idx")
+    dst_idx = numpy_helper.from_array(np.array(1, dtype=np.int64), "dst_idx")
+    reduce_axes = numpy_helper.from_array(np.array([1], dtype=np.int64), "reduce_axes")
+    scale = numpy_helper.from_array(np.array(2.0, dtype=np.float32), "scale")
+
+    nodes = [
+        helper.make_node("Gather", ["edge_index", "src_idx"], ["src"], axis=0),
+        helper.make_node("Gather", ["edge_index", "dst_idx"], ["dst"], axis=0),
+        helper.make_node("Gather", ["node_features", "src"], ["src_features"], axis=0),
+        helper.make_node("Gather", ["node_features", "dst"], ["dst_features"], axis=0),
+        helper.make_node("Add", ["src_features", "dst_features"], ["edge_features"]),
+        helper.make_node("ReduceSum", ["edge_features", "reduce_axes"], ["edge_scores"], keepdims=0),
+        helper.make_node("Mul", ["node_features", "scale"], ["node_outputs"]),
+    ]
+
+    graph = helper.make_graph(
+        nodes,
+        "multi_input",
+        [
+            helper.make_tensor_value_info("node_features", TensorProto.FLOAT, ["n_nodes", n_features]),
+            helper.make_tensor_value_info("edge_index", TensorProto.INT64, [2, "n_edges"]),
+        ],
+        [
+            helper.make_tensor_value_info("edge_scores", TensorProto.FLOAT, ["n_edges"]),
+            helper.make_tensor_value_info("node_outputs", TensorProto.FLOAT, ["n_nodes", n_features]),
+        ],
+        initializer=[src_idx, dst_idx, reduce_axes, scale],
+    )
+
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET_VERSION)])
+    model.ir_version = IR_VERSION
+    onnx.checker.check_model(model)
+    return model
+
+
+def make_edge_classifier_model(n_features=4, offset=2.0, scale=1.0):
+    """
+    Create a model with the interface of the edge classifier that is used by
+    the Acts OnnxEdgeClassifier, i.e. node features of shape
+    (n_nodes, n_features) and an edge index of shape (2, n_edges) as inputs and
+    edge scores (logits) of shape (n_edges, 1) as output. The score of an edge
+    is offset - scale * |f_src - f_dst|^2, i.e. edges between nodes with similar
+    features are kept. This allows to run the whole track finding chain with
+    local models.
+    """
+    src_idx = numpy_helper.from_array(np.array(0, dtype=np.int64), "src_idx")
+    dst_idx = numpy_helper.from_array(np.array(1, dtype=np.int64), "dst_idx")
+    reduce_axes = numpy_helper.from_array(np.array([1], dtype=np.int64), "reduce_axes")
+    neg_scale = numpy_helper.from_array(np.array(-scale, dtype=np.float32), "neg_scale")
+    offset_init = numpy_helper.from_array(np.array(offset, dtype=np.float32), "offset")
+
+    nodes = [
+        helper.make_node("Gather", ["edge_index", "src_idx"], ["src"], axis=0),
+        helper.make_node("Gather", ["edge_index", "dst_idx"], ["dst"], axis=0),
+        helper.make_node("Gather", ["node_features", "src"], ["src_features"], axis=0),
+        helper.make_node("Gather", ["node_features", "dst"], ["dst_features"], axis=0),
+        helper.make_node("Sub", ["src_features", "dst_features"], ["diff"]),
+        helper.make_node("Mul", ["diff", "diff"], ["diff2"]),
+        helper.make_node("ReduceSum", ["diff2", "reduce_axes"], ["dist2"], keepdims=1),
+        helper.make_node("Mul", ["dist2", "neg_scale"], ["scaled_dist2"]),
+        helper.make_node("Add", ["scaled_dist2", "offset"], ["edge_scores"]),
+    ]
+
+    graph = helper.make_graph(
+        nodes,
+        "edge_classifier",
+        [
+            helper.make_tensor_value_info("node_features", TensorProto.FLOAT, ["n_nodes", n_features]),
+            helper.make_tensor_value_info("edge_index", TensorProto.INT64, [2, "n_edges"]),
+        ],
+        [helper.make_tensor_value_info("edge_scores", TensorProto.FLOAT, ["n_edges", 1])],
+        initializer=[src_idx, dst_idx, reduce_axes, neg_scale, offset_init],
+    )
+
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET_VERSION)])
+    model.ir_version = IR_VERSION
+    onnx.checker.check_model(model)
+    return model
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the ONNX models for the unit tests")
+    parser.add_argument("output_dir", help="Directory into which the models are written", type=Path)
+    args = parser.parse_args()
+
+    args.output_dir.mkdir(parents=True, exist_ok=True)
+    onnx.save(make_affine_model(), args.output_dir / "affine.onnx")
+    onnx.save(make_affine_model(n_features=3), args.output_dir / "affine_3d.onnx")
+    onnx.save(make_multi_input_model(), args.output_dir / "multi_input.onnx")
+    onnx.save(make_mlp_model(), args.output_dir / "mlp.onnx")
+    # Reduced precision variants of the MLP
+    quantize_int8(args.output_dir / "mlp.onnx", variant_path(args.output_dir / "mlp.onnx", "int8"))
+    onnx.save(convert_fp16_weights(make_mlp_model()), variant_path(args.output_dir / "mlp.onnx", "fp16"))
+    onnx.save(make_edge_classifier_model(), args.output_dir / "edge_classifier.onnx")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,510 @@
+// Replay EDM4hep events through the complete GNN track finding chain outside
+// of a Gaudi job and report the latency of the individual stages
+
+#include "GNNTrackFindingChain.h"
+#include "HitFeatures.h"
+#include "HitFiltering.h"
+#include "StageMonitoring.h"
+#include "TrackBuilding.h"
+
+#include <Acts/Utilities/Logger.hpp>
+
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include <podio/Frame.h>
+#include <podio/Reader.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using TrackerHitCollection = edm4hep::TrackerHitPlaneCollection;
+using Chain = GNNTrackFindingChain;
+
+constexpr auto usage = R"(Usage: gnn_replay_benchmark [options] [input_file.edm4hep.root]
+
+Runs the complete GNN track finding chain (hit collection, feature extraction,
+embedding, edge building, edge classification, track building and EDM4hep
+output) over the events of the input file and reports the latency of each
+stage. Without an input file, synthetic events are generated instead. The
+chain is the same as in the ExaTrkGNNTrackFinder and its options correspond
+to the properties of the algorithm, with the same defaults.
+
+Options:
+  --embedding-model <path>        ONNX node embedding model (required)
+  --edge-classifier-model <path>  ONNX edge classifier model (required)
+  --collections <a,b,...>         Input hit collections (default: the IB, IE, OB, OE, VB and VE tracker hits)
+  --synthetic-hits <n>            Number of hits per synthetic event (default: 10000)
+  --events <n>                    Number of measured events (default: 100)
+  --warmup <n>                    Number of warm-up events that are not measured (default: 10)
+  --hit-time-window <min,max>     Only hits in this time window (in ns) enter the graph (default: all)
+  --hit-radius-range <min,max>    Only hits in this radial range (in mm) enter the graph (default: all)
+  --hit-merge-distance <d>        Merge hits of a collection within this distance (in mm) (default: 0, no merging)
+  --hit-merge-collections <i,...> Indices (in --collections) of the collections in which hits are merged (default: all)
+  --features <a,b,...>            Hit features for the models (default: r,phi,z,time)
+  --feature-scales <a,b,...>      Factors by which the hit features are divided (default: none)
+  --embedding-dim <n>             Dimension of the embedding space (default: 4)
+  --radius <r>                    Edge building radius in the embedding space (default: 0.1)
+  --knn <k>                       Maximum number of neighbours per hit (default: 100)
+  --edge-building-threads <n>     Threads for the edge building (default: 1)
+  --phi-sectors <n>               Number of phi sectors in which the edges are built independently (default: 1)
+  --phi-overlap <d>               Overlap (in phi) of the phi sectors (default: 0)
+  --eta-regions <n>               Number of eta regions in which the edges are built independently (default: 1)
+  --eta-overlap <d>               Overlap (in eta) of the eta regions (default: 0)
+  --onnx-threads <n>              Intra-op threads of the node embedding model (default: 1)
+  --precision <p>                 Precision of the models (fp32, fp16, int8; default: fp32)
+  --embedding-batch-events <0|1>  Run the node embedding through the batching of concurrent events (default: 0)
+  --embedding-batch-max-hits <n>  Maximum number of hits in a batch of events (default: 500000)
+  --embedding-batch-max-events <n>
+                                  A batch is run as soon as it contains this many events (default: 0, no limit)
+  --embedding-batch-max-wait <us> Maximum time that an event waits for others to join its batch (default: 1000)
+  --cut <c>                       Edge classifier cut (default: 0.5)
+  --edge-memory-budget <MB>       Classify the edges in chunks of at most this estimated memory (default: 0, no chunks)
+  --halo-hops <n>                 Hops by which the edge classification chunks are extended (default: 1)
+  --track-building <a>            Track building algorithm (unionfind, boost; default: unionfind)
+  --track-building-score-cut <c>  Minimum edge score for the union-find track building (default: 0)
+  --split-junctions <0|1>         Split junctions in the union-find track building (default: 0)
+  --track-building-threads <n>    Threads for the union-find track building (default: 1)
+  --min-hits <n>                  Minimum number of hits per track (default: 3)
+  --record-graphs <file>          Write the classified edges of the measured events to a file, e.g. for the track
+                                  building benchmark in unittests_gnn_stages
+  --trace <file>                  Write the per event stage trace to a file (*.json: JSON lines, otherwise CSV)
+  --pipeline-threads <n>          Run the stages as tasks on n threads, overlapping those of different events
+                                  (default: 0, one event after the other on the main thread)
+  --pipeline-events <n>           Maximum number of events in the pipelined stages (default: 4)
+  --pipeline-stage-concurrency <n>
+                                  Maximum number of events in each pipelined stage at the same time (default: 1)
+  -h, --help                      Print this message
+)";
+
+struct Options {
+  std::string inputFile{};
+  std::vector<std::string> collections{"IBTrackerHits", "IETrackerHits", "OBTrackerHits",
+                                       "OETrackerHits", "VBTrackerHits", "VETrackerHits"};
+  std::size_t syntheticHits{10000};
+  std::size_t numEvents{100};
+  std::size_t warmupEvents{10};
+
+  Chain::Config chain{};
+
+  std::string traceFile{};
+  std::string recordGraphsFile{};
+};
+
+std::vector<std::string> splitList(std::string_view list) {
+  std::vector<std::string> items{};
+  while (!list.empty()) {
+    const auto pos = list.find(',');
+    items.emplace_back(list.substr(0, pos));
+    list = pos == std::string_view::npos ? std::string_view{} : list.substr(pos + 1);
+  }
+  return items;
+}
+
+/// Parse a "min,max" range into the bounds of a cut
+/// @throws std::invalid_argument if the range does not have two values
+void parseRange(const std::string& value, float& min, float& max) {
+  const auto items = splitList(value);
+  if (items.size() != 2) {
+    throw std::invalid_argument(fmt::format("Expected a min,max range, but got '{}'", value));
+  }
+  min = std::stof(items[0]);
+  max = std::stof(items[1]);
+}
+
+/// Parse the command line. Returns an empty optional if only the help has been
+/// requested
+/// @throws std::invalid_argument for invalid arguments
+std::optional<Options> parseArguments(std::span<char*> args) {
+  Options options{};
+  for (std::size_t i = 1; i < args.size(); ++i) {
+    const std::string_view arg = args[i];
+    if (arg == "-h" || arg == "--help") {
+      return std::nullopt;
+    }
+    if (!arg.starts_with("--")) {
+      if (!options.inputFile.empty()) {
+        throw std::invalid_argument("Only one input file can be replayed");
+      }
+      options.inputFile = arg;
+      continue;
+    }
+    if (i + 1 >= args.size()) {
+      throw std::invalid_argument(fmt::format("Missing value for {}", arg));
+    }
+    const std::string value = args[++i];
+
+    auto& chain = options.chain;
+    auto& graph = chain.graphConstruction;
+    if (arg == "--embedding-model") {
+      graph.modelPath = value;
+    } else if (arg == "--edge-classifier-model") {
+      chain.edgeClassifierModelPath = value;
+    } else if (arg == "--collections") {
+      options.collections = splitList(value);
+    } else if (arg == "--synthetic-hits") {
+      options.syntheticHits = std::stoul(value);
+    } else if (arg == "--events") {
+      options.numEvents = std::stoul(value);
+    } else if (arg == "--warmup") {
+      options.warmupEvents = std::stoul(value);
+    } else if (arg == "--hit-time-window") {
+      parseRange(value, chain.hitFilter.cuts.timeMin, chain.hitFilter.cuts.timeMax);
+    } else if (arg == "--hit-radius-range") {
+      parseRange(value, chain.hitFilter.cuts.rMin, chain.hitFilter.cuts.rMax);
+    } else if (arg == "--hit-merge-distance") {
+      chain.hitFilter.mergeDistance = std::stof(value);
+    } else if (arg == "--hit-merge-collections") {
+      chain.hitFilter.mergeCollections.clear();
+      for (const auto& index : splitList(value)) {
+        chain.hitFilter.mergeCollections.push_back(std::stoul(index));
+      }
+    } else if (arg == "--features") {
+      chain.features.features.clear();
+      for (const auto& feature : splitList(value)) {
+        chain.features.features.push_back(mlutils::toHitFeature(feature));
+      }
+    } else if (arg == "--feature-scales") {
+      chain.features.scales.clear();
+      for (const auto& scale : splitList(value)) {
+        chain.features.scales.push_back(std::stof(scale));
+      }
+    } else if (arg == "--embedding-dim") {
+      graph.embeddingDim = std::stoi(value);
+    } else if (arg == "--radius") {
+      graph.rVal = std::stof(value);
+    } else if (arg == "--knn") {
+      graph.knnVal = std::stof(value);
+    } else if (arg == "--edge-building-threads") {
+      graph.edgeBuildingThreads = std::stoul(value);
+    } else if (arg == "--phi-sectors") {
+      chain.sectors.phiSectors = std::stoul(value);
+    } else if (arg == "--phi-overlap") {
+      chain.sectors.phiOverlap = std::stof(value);
+    } else if (arg == "--eta-regions") {
+      chain.sectors.etaRegions = std::stoul(value);
+    } else if (arg == "--eta-overlap") {
+      chain.sectors.etaOverlap = std::stof(value);
+    } else if (arg == "--onnx-threads") {
+      graph.sessionConfig.intraOpNumThreads = std::stoi(value);
+    } else if (arg == "--precision") {
+      graph.sessionConfig.precision = mlutils::toModelPrecision(value);
+    } else if (arg == "--embedding-batch-events") {
+      graph.batchEvents = std::stoi(value) != 0;
+    } else if (arg == "--embedding-batch-max-hits") {
+      graph.batchingConfig.maxBatchRows = std::stoul(value);
+    } else if (arg == "--embedding-batch-max-events") {
+      graph.batchingConfig.maxBatchRequests = std::stoul(value);
+    } else if (arg == "--embedding-batch-max-wait") {
+      graph.batchingConfig.maxWaitTime = std::chrono::microseconds(std::stoi(value));
+    } else if (arg == "--cut") {
+      chain.edgeClassifierCut = std::stof(value);
+    } else if (arg == "--edge-memory-budget") {
+      chain.edgeChunking.memoryBudgetBytes = static_cast<std::size_t>(std::stod(value) * 1024 * 1024);
+    } else if (arg == "--halo-hops") {
+      chain.edgeChunking.haloHops = std::stoul(value);
+    } else if (arg == "--track-building") {
+      chain.trackBuilding = value;
+    } else if (arg == "--track-building-score-cut") {
+      chain.unionFind.scoreCut = std::stof(value);
+    } else if (arg == "--split-junctions") {
+      chain.unionFind.splitJunctions = std::stoi(value) != 0;
+    } else if (arg == "--track-building-threads") {
+      chain.unionFind.numThreads = std::stoul(value);
+    } else if (arg == "--min-hits") {
+      chain.minHitsPerTrack = std::stoul(value);
+    } else if (arg == "--pipeline-threads") {
+      chain.pipelineThreads = std::stoul(value);
+    } else if (arg == "--pipeline-events") {
+      chain.pipelineMaxEvents = std::stoul(value);
+    } else if (arg == "--pipeline-stage-concurrency") {
+      chain.pipelineStageConcurrency = std::stoul(value);
+    } else if (arg == "--trace") {
+      options.traceFile = value;
+    } else if (arg == "--record-graphs") {
+      options.recordGraphsFile = value;
+    } else {
+      throw std::invalid_argument(fmt::format("Unknown option {}", arg));
+    }
+  }
+
+  if (options.chain.graphConstruction.modelPath.empty() || options.chain.edgeClassifierModelPath.empty()) {
+    throw std::invalid_argument("Both, the embedding and the edge classifier model are required");
+  }
+  options.chain.hitFilter.validate(options.collections.size());
+  if (options.numEvents == 0) {
+    throw std::invalid_argument("At least one event has to be measured");
+  }
+  return options;
+}
+
+/// An event with the synthetic hits of mlutils::generateSyntheticHits
+podio::Frame generateSyntheticEvent(std::size_t numHits, unsigned seed) {
+  const auto hitArrays = mlutils::generateSyntheticHits(numHits, seed);
+  TrackerHitCollection hits{};
+  for (std::size_t i = 0; i < hitArrays.size(); ++i) {
+    auto hit = hits.create();
+    hit.setPosition({hitArrays.x[i], hitArrays.y[i], hitArrays.z[i]});
+    hit.setTime(hitArrays.time[i]);
+  }
+
+  podio::Frame frame{};
+  frame.put(std::move(hits), "SyntheticHits");
+  return frame;
+}
+
+/// Write the classified graph of each event to a file, e.g. for the track
+/// building benchmark in unittests_gnn_stages
+class GraphRecorder {
+public:
+  /// @throws std::runtime_error if the file cannot be opened
+  explicit GraphRecorder(const std::string& fileName) : m_file(fileName, std::ios::binary) {
+    if (!m_file) {
+      throw std::runtime_error(fmt::format("Cannot open graph record file {}", fileName));
+    }
+  }
+
+  /// Can be called concurrently, e.g. for the pipelined stages
+  void operator()(const ActsPlugins::PipelineTensors& tensors) {
+    mlutils::RecordedGraph graph{.numNodes = tensors.nodeFeatures.shape()[0]};
+    graph.edgeIndex.assign(tensors.edgeIndex.data(), tensors.edgeIndex.data() + tensors.edgeIndex.size());
+    if (tensors.edgeScores) {
+      graph.scores.assign(tensors.edgeScores->data(), tensors.edgeScores->data() + tensors.edgeScores->size());
+    }
+    std::lock_guard lock{m_mutex};
+    mlutils::writeGraph(m_file, graph);
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::ofstream m_file;
+};
+
+/// The hit collections of an event, together with the frame that holds them
+/// if the event has been read from a file
+struct ReplayEvent {
+  podio::Frame frame{};
+  std::vector<const TrackerHitCollection*> collections{};
+};
+
+/// Provides the events that are replayed, either from a file or synthetic
+/// ones. Events are replayed cyclically if more are requested than available
+class EventSource {
+public:
+  explicit EventSource(const Options& options) {
+    if (options.inputFile.empty()) {
+      // A few different events are enough to not always process the same one
+      constexpr std::size_t numSynthetic = 10;
+      for (std::size_t i = 0; i < numSynthetic; ++i) {
+        m_syntheticEvents.push_back(generateSyntheticEvent(options.syntheticHits, static_cast<unsigned>(i)));
+      }
+      m_collectionNames = {"SyntheticHits"};
+      m_numEvents = numSynthetic;
+    } else {
+      m_reader = std::make_unique<podio::Reader>(podio::makeReader(options.inputFile));
+      m_collectionNames = options.collections;
+      m_numEvents = m_reader->getEvents();
+      if (m_numEvents == 0) {
+        throw std::runtime_error(fmt::format("{} does not contain any events", options.inputFile));
+      }
+    }
+  }
+
+  std::size_t numEvents() const { return m_numEvents; }
+
+  /// Read an event. The collections stay valid as long as event is not read
+  /// into again
+  /// @throws std::runtime_error if a collection is missing
+  void read(std::size_t iEvent, ReplayEvent& event) {
+    const podio::Frame* frame = nullptr;
+    if (m_reader) {
+      event.frame = m_reader->readEvent(iEvent % m_numEvents);
+      frame = &event.frame;
+    } else {
+      frame = &m_syntheticEvents[iEvent % m_numEvents];
+    }
+
+    event.collections.clear();
+    for (const auto& name : m_collectionNames) {
+      const auto* coll = dynamic_cast<const TrackerHitCollection*>(frame->get(name));
+      if (!coll) {
+        throw std::runtime_error(fmt::format("Event {} has no TrackerHitPlaneCollection '{}'", iEvent, name));
+      }
+      event.collections.push_back(coll);
+    }
+  }
+
+private:
+  std::unique_ptr<podio::Reader> m_reader{nullptr};
+  std::vector<podio::Frame> m_syntheticEvents{};
+  std::vector<std::string> m_collectionNames{};
+  std::size_t m_numEvents{0};
+};
+
+/// Submits the replayed events to the chain. Without the pipelined stages
+/// every event is processed right away, otherwise up to the maximum number of
+/// events in the pipeline are in flight, each with its own input
+class EventSubmitter {
+public:
+  EventSubmitter(const Chain& chain, EventSource& events)
+      : m_chain(chain), m_events(events),
+        m_inFlight(chain.pipelined() ? chain.config().pipelineMaxEvents : std::size_t{1}) {}
+
+  /// The record and the observers have to stay valid until wait returns
+  /// @throws std::exception from the track finding of an earlier event
+  void submit(std::size_t iEvent, mlutils::StageRecord& record, const Chain::Observers& observers) {
+    auto& event = m_inFlight[iEvent % m_inFlight.size()];
+    if (event.tracks.valid()) {
+      event.tracks.get();
+    }
+    m_events.read(iEvent, event.input);
+    event.tracks = m_chain.submit(event.input.collections, record, observers);
+  }
+
+  /// Wait until all submitted events have been processed
+  /// @throws std::exception from the track finding
+  void wait() {
+    for (auto& event : m_inFlight) {
+      if (event.tracks.valid()) {
+        event.tracks.get();
+      }
+    }
+  }
+
+private:
+  struct InFlightEvent {
+    ReplayEvent input{};
+    std::future<edm4hep::TrackCollection> tracks{};
+  };
+
+  const Chain& m_chain;
+  EventSource& m_events;
+  std::vector<InFlightEvent> m_inFlight;
+};
+
+void printReport(const std::vector<mlutils::StageRecord>& records, double wallTimeMs, long warmupPeakRssKb,
+                 bool pipelined) {
+  const auto numEvents = records.size();
+  std::vector<double> values(numEvents);
+  const auto printRow = [&values](std::string_view name) {
+    const auto summary = mlutils::summarizeLatencies(values);
+    std::cout << fmt::format("{:<20}{:>11.3f}{:>11.3f}{:>11.3f}{:>11.3f}{:>11.3f}\n", name, summary.mean, summary.p50,
+                             summary.p90, summary.p99, summary.max);
+  };
+
+  std::cout << fmt::format("{:<20}{:>11}{:>11}{:>11}{:>11}{:>11}\n", "Stage [ms]", "mean", "p50", "p90", "p99",
+                           "max");
+  for (std::size_t stage = 0; stage < Chain::NumStages; ++stage) {
+    std::ranges::transform(records, values.begin(), [stage](const auto& record) { return record.timesMs[stage]; });
+    printRow(Chain::StageNames[stage]);
+  }
+  std::ranges::transform(records, values.begin(), [](const auto& record) {
+    return std::accumulate(record.timesMs.begin(), record.timesMs.end(), 0.);
+  });
+  printRow("Total");
+  const auto processingMs = std::accumulate(values.begin(), values.end(), 0.);
+
+  std::cout << '\n';
+  for (std::size_t counter = 0; counter < Chain::NumCounters; ++counter) {
+    const auto sum = std::accumulate(records.begin(), records.end(), 0., [counter](double acc, const auto& record) {
+      return acc + static_cast<double>(record.counters[counter]);
+    });
+    std::cout << fmt::format("{:<20}{:>11.1f} per event\n", Chain::CounterNames[counter], sum / numEvents);
+  }
+
+  std::cout << '\n';
+  if (pipelined) {
+    // The stages of several events overlap, i.e. only the wall time gives the
+    // throughput
+    std::cout << fmt::format("Throughput: {:.2f} events/s ({:.2f} events/s for the summed stage latencies)\n",
+                             1000. * numEvents / wallTimeMs, 1000. * numEvents / processingMs);
+  } else {
+    std::cout << fmt::format("Throughput: {:.2f} events/s ({:.2f} events/s including reading the events)\n",
+                             1000. * numEvents / processingMs, 1000. * numEvents / wallTimeMs);
+  }
+  std::cout << fmt::format("Peak RSS: {:.1f} MB ({:.1f} MB after the warm-up)\n", mlutils::peakRssKb() / 1024.,
+                           warmupPeakRssKb / 1024.);
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::optional<Options> options{};
+  try {
+    options = parseArguments(std::span(argv, static_cast<std::size_t>(argc)));
+  } catch (const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << "\n\n" << usage;
+    return 1;
+  }
+  if (!options) {
+    std::cout << usage;
+    return 0;
+  }
+
+  try {
+    EventSource events{*options};
+    const Chain chain{options->chain, Acts::getDefaultLogger("GNNTrackFinding", Acts::Logging::WARNING)};
+    std::unique_ptr<mlutils::StageTraceWriter> traceWriter{nullptr};
+    if (!options->traceFile.empty()) {
+      traceWriter = std::make_unique<mlutils::StageTraceWriter>(
+          options->traceFile, std::vector<std::string>(Chain::StageNames.begin(), Chain::StageNames.end()),
+          std::vector<std::string>(Chain::CounterNames.begin(), Chain::CounterNames.end()));
+    }
+    // Only the measured events are recorded
+    Chain::Observers observers{};
+    std::unique_ptr<GraphRecorder> graphRecorder{nullptr};
+    if (!options->recordGraphsFile.empty()) {
+      graphRecorder = std::make_unique<GraphRecorder>(options->recordGraphsFile);
+      observers.classifiedGraph = [&graphRecorder](const auto& tensors) { (*graphRecorder)(tensors); };
+    }
+
+    EventSubmitter submitter{chain, events};
+    const Chain::Observers warmupObservers{};
+    std::vector<mlutils::StageRecord> warmupRecords(options->warmupEvents);
+    for (std::size_t i = 0; i < options->warmupEvents; ++i) {
+      submitter.submit(i, warmupRecords[i], warmupObservers);
+    }
+    submitter.wait();
+    const auto warmupPeakRssKb = mlutils::peakRssKb();
+
+    std::vector<mlutils::StageRecord> records(options->numEvents);
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < options->numEvents; ++i) {
+      submitter.submit(options->warmupEvents + i, records[i], observers);
+    }
+    submitter.wait();
+    const auto wallTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (traceWriter) {
+      for (std::size_t i = 0; i < options->numEvents; ++i) {
+        traceWriter->write(options->warmupEvents + i, records[i]);
+      }
+    }
+
+    std::cout << fmt::format("Replayed {} events ({} distinct, {} warm-up events) from {}\n\n", options->numEvents,
+                             events.numEvents(), options->warmupEvents,
+                             options->inputFile.empty() ? "synthetic events" : options->inputFile);
+    printReport(records, wallTimeMs, warmupPeakRssKb, chain.pipelined());
+  } catch (const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
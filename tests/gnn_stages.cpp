@@ -0,0 +1,447 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "ChunkedEdgeClassifier.h"
+#include "EdgeBuilding.h"
+#include "OnnxMetricLearning.h"
+#include "TrackBuilding.h"
+#include "UnionFindTrackBuilding.h"
+
+#include <Acts/Utilities/Logger.hpp>
+#if __has_include("ActsPlugins/Gnn/BoostTrackBuilding.hpp")
+#include <ActsPlugins/Gnn/BoostTrackBuilding.hpp>
+#else
+#include <Acts/Plugins/Gnn/BoostTrackBuilding.hpp>
+namespace ActsPlugins {
+using BoostTrackBuilding = Acts::BoostTrackBuilding;
+}
+#endif
+#if __has_include("ActsPlugins/Gnn/detail/buildEdges.hpp")
+#include <ActsPlugins/Gnn/detail/buildEdges.hpp>
+#else
+#include <Acts/Plugins/Gnn/detail/buildEdges.hpp>
+namespace ActsPlugins::detail {
+using Acts::detail::buildEdges;
+}
+#endif
+
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+const std::string testModelDir = MLTRACKING_TEST_MODEL_DIR;
+constexpr std::int64_t embeddingDim = 4;
+constexpr float radius = 0.1f;
+
+/// Points distributed similarly to the output of the embedding model
+std::vector<float> randomPoints(std::size_t nPoints, unsigned seed = 42) {
+  std::mt19937 rng{seed};
+  std::normal_distribution<float> dist{0.f, 0.5f};
+  std::vector<float> points(nPoints * embeddingDim);
+  std::ranges::generate(points, [&]() { return dist(rng); });
+  return points;
+}
+
+at::Tensor torchEdges(std::vector<float>& points, float rVal, int kVal = 1000, bool shuffleDirections = false) {
+  auto tensor = torch::from_blob(points.data(), {static_cast<std::int64_t>(points.size()) / embeddingDim, embeddingDim},
+                                 torch::kFloat32);
+  return ActsPlugins::detail::buildEdges(tensor, rVal, kVal, shuffleDirections);
+}
+
+/// Undirected and sorted edges from a [2, nEdges] torch edge index
+std::vector<std::pair<std::int64_t, std::int64_t>> toSortedEdges(const at::Tensor& edgeIndex) {
+  const auto edges = edgeIndex.to(torch::kInt64).contiguous();
+  const auto nEdges = edges.size(1);
+  const auto* data = edges.data_ptr<std::int64_t>();
+  std::vector<std::pair<std::int64_t, std::int64_t>> result(nEdges);
+  for (std::int64_t i = 0; i < nEdges; ++i) {
+    result[i] = std::minmax(data[i], data[nEdges + i]);
+  }
+  std::ranges::sort(result);
+  return result;
+}
+
+std::vector<std::pair<std::int64_t, std::int64_t>> toSortedEdges(const std::vector<std::int64_t>& edgeIndex) {
+  const auto nEdges = static_cast<std::int64_t>(edgeIndex.size() / 2);
+  return toSortedEdges(torch::from_blob(const_cast<std::int64_t*>(edgeIndex.data()), {2, nEdges}, torch::kInt64));
+}
+
+ActsPlugins::ExecutionContext cpuContext() {
+  ActsPlugins::ExecutionContext execContext{};
+  execContext.device = ActsPlugins::Device{ActsPlugins::Device::Type::eCPU, 0};
+  return execContext;
+}
+
+/// Graph construction with the affine test model, which embeds x as 2 * x + 1
+OnnxMetricLearning affineMetricLearning() {
+  return OnnxMetricLearning({.modelPath = testModelDir + "/affine.onnx", .embeddingDim = embeddingDim, .rVal = radius},
+                            Acts::getDefaultLogger("MetricLearning", Acts::Logging::WARNING));
+}
+
+ActsPlugins::Tensor<float> toTensor(const std::vector<float>& points, const ActsPlugins::ExecutionContext& ctx) {
+  auto tensor = ActsPlugins::Tensor<float>::Create({points.size() / embeddingDim, embeddingDim}, ctx);
+  std::ranges::copy(points, tensor.data());
+  return tensor;
+}
+
+template <typename T>
+std::vector<T> toVector(const ActsPlugins::Tensor<T>& tensor) {
+  return {tensor.data(), tensor.data() + tensor.size()};
+}
+
+/// Edge classifier with a single message passing step. The state of a node is
+/// the sum of its first feature and the ones of its neighbours and the score
+/// of an edge is the product of the states of its nodes
+class MessagePassingClassifier final : public ActsPlugins::EdgeClassificationBase {
+public:
+  explicit MessagePassingClassifier(float cut) : m_cut(cut) {}
+
+  ActsPlugins::PipelineTensors operator()(ActsPlugins::PipelineTensors tensors,
+                                          const ActsPlugins::ExecutionContext& execContext = {}) override {
+    const auto numFeatures = tensors.nodeFeatures.shape()[1];
+    const auto numEdges = tensors.edgeIndex.shape()[1];
+    const auto* features = tensors.nodeFeatures.data();
+    const auto* edges = tensors.edgeIndex.data();
+    std::vector<float> state(tensors.nodeFeatures.shape()[0]);
+    for (std::size_t i = 0; i < state.size(); ++i) {
+      state[i] = features[i * numFeatures];
+    }
+    for (std::size_t e = 0; e < numEdges; ++e) {
+      state[edges[e]] += features[edges[numEdges + e] * numFeatures];
+      state[edges[numEdges + e]] += features[edges[e] * numFeatures];
+    }
+
+    std::vector<std::int64_t> kept{};
+    std::vector<float> scores{};
+    for (std::size_t e = 0; e < numEdges; ++e) {
+      const auto score = state[edges[e]] * state[edges[numEdges + e]];
+      if (score > m_cut) {
+        kept.push_back(e);
+        scores.push_back(score);
+      }
+    }
+    auto edgeIndex = ActsPlugins::Tensor<std::int64_t>::Create({2, kept.size()}, execContext);
+    auto edgeScores = ActsPlugins::Tensor<float>::Create({kept.size(), 1}, execContext);
+    for (std::size_t i = 0; i < kept.size(); ++i) {
+      edgeIndex.data()[i] = edges[kept[i]];
+      edgeIndex.data()[kept.size() + i] = edges[numEdges + kept[i]];
+      edgeScores.data()[i] = scores[i];
+    }
+    return {std::move(tensors.nodeFeatures), std::move(edgeIndex), std::nullopt, std::move(edgeScores)};
+  }
+
+private:
+  float m_cut;
+};
+
+using ClassifiedEdge = std::tuple<std::int64_t, std::int64_t, float>;
+
+/// The (source, target, score) of the classified edges, sorted
+std::vector<ClassifiedEdge> classifiedEdges(const ActsPlugins::PipelineTensors& tensors) {
+  const auto numEdges = tensors.edgeIndex.shape()[1];
+  std::vector<ClassifiedEdge> result(numEdges);
+  for (std::size_t e = 0; e < numEdges; ++e) {
+    result[e] = {tensors.edgeIndex.data()[e], tensors.edgeIndex.data()[numEdges + e], tensors.edgeScores->data()[e]};
+  }
+  std::ranges::sort(result);
+  return result;
+}
+
+using TrackCandidates = std::vector<std::vector<int>>;
+
+/// Track candidates with sorted hits in sorted order, to compare candidates
+/// independent of the order in which they have been found
+TrackCandidates sortedCandidates(TrackCandidates candidates) {
+  for (auto& candidate : candidates) {
+    std::ranges::sort(candidate);
+  }
+  std::ranges::sort(candidates);
+  return candidates;
+}
+
+/// The pipeline tensors of a classified graph
+ActsPlugins::PipelineTensors toTensors(const mlutils::RecordedGraph& graph,
+                                       const ActsPlugins::ExecutionContext& execContext) {
+  auto nodeFeatures = ActsPlugins::Tensor<float>::Create({graph.numNodes, 1}, execContext);
+  auto edgeIndex = ActsPlugins::Tensor<std::int64_t>::Create({2, graph.numEdges()}, execContext);
+  std::ranges::copy(graph.edgeIndex, edgeIndex.data());
+  auto edgeScores = ActsPlugins::Tensor<float>::Create({graph.scores.size(), 1}, execContext);
+  std::ranges::copy(graph.scores, edgeScores.data());
+  return {std::move(nodeFeatures), std::move(edgeIndex), std::nullopt, std::move(edgeScores)};
+}
+
+/// A graph with random scores from the edge building on random points
+mlutils::RecordedGraph randomGraph(std::size_t nPoints, unsigned seed) {
+  mlutils::RecordedGraph graph{.numNodes = nPoints};
+  graph.edgeIndex = mlutils::RadiusEdgeBuilder{{.radius = radius, .knn = 0}}.build(randomPoints(nPoints, seed),
+                                                                                   embeddingDim);
+  std::mt19937 rng{seed};
+  std::uniform_real_distribution<float> dist{0.f, 1.f};
+  graph.scores.resize(graph.numEdges());
+  std::ranges::generate(graph.scores, [&]() { return dist(rng); });
+  return graph;
+}
+} // namespace
+
+TEST_CASE("RadiusEdgeBuilder is equivalent to the torch edge building", "[edges][torch]") {
+  for (const std::size_t nPoints : {100, 5000}) {
+    auto points = randomPoints(nPoints);
+    const mlutils::RadiusEdgeBuilder builder{{.radius = radius, .knn = 0}};
+    const auto edges = builder.build(points, embeddingDim);
+    const auto expected = toSortedEdges(torchEdges(points, radius));
+
+    REQUIRE(!expected.empty());
+    REQUIRE(toSortedEdges(edges) == expected);
+
+    // Shuffling the directions does not change the undirected edges
+    const mlutils::RadiusEdgeBuilder shuffling{{.radius = radius, .knn = 0, .shuffleDirections = true}};
+    REQUIRE(toSortedEdges(shuffling.build(points, embeddingDim)) == expected);
+  }
+}
+
+TEST_CASE("RadiusEdgeBuilder with a knn limit compared to the torch edge building", "[edges][torch]") {
+  // Dense enough that most points have more than knn neighbours
+  constexpr float denseRadius = 0.3f;
+  constexpr std::size_t knn = 5;
+  auto points = randomPoints(2000);
+  const auto torchRadiusEdges = toSortedEdges(torchEdges(points, denseRadius, knn));
+
+  // The CPU path of the Acts plugin ignores kVal and keeps all edges within
+  // the radius, i.e. it corresponds to knn = 0
+  const auto allEdges = mlutils::RadiusEdgeBuilder{{.radius = denseRadius, .knn = 0}}.build(points, embeddingDim);
+  REQUIRE(toSortedEdges(allEdges) == torchRadiusEdges);
+
+  // With a limit, each point keeps the edges to its knn closest neighbours of
+  // the torch graph, and an edge is kept if either of its points keeps it (as
+  // the FRNN based CUDA path does after removing the duplicates)
+  std::vector<std::vector<std::pair<float, std::int64_t>>> neighbours(points.size() / embeddingDim);
+  for (const auto& [a, b] : torchRadiusEdges) {
+    float dist2 = 0.f;
+    for (std::int64_t d = 0; d < embeddingDim; ++d) {
+      const auto diff = points[a * embeddingDim + d] - points[b * embeddingDim + d];
+      dist2 += diff * diff;
+    }
+    neighbours[a].emplace_back(dist2, b);
+    neighbours[b].emplace_back(dist2, a);
+  }
+  std::vector<std::pair<std::int64_t, std::int64_t>> expected{};
+  std::size_t numLimited = 0;
+  for (std::size_t i = 0; i < neighbours.size(); ++i) {
+    auto& closest = neighbours[i];
+    std::ranges::sort(closest);
+    numLimited += closest.size() > knn;
+    closest.resize(std::min(closest.size(), knn));
+    for (const auto& [dist2, j] : closest) {
+      expected.push_back(std::minmax(static_cast<std::int64_t>(i), j));
+    }
+  }
+  std::ranges::sort(expected);
+  expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+  REQUIRE(numLimited > neighbours.size() / 4);
+  REQUIRE(expected.size() < torchRadiusEdges.size());
+
+  const mlutils::RadiusEdgeBuilder limited{{.radius = denseRadius, .knn = static_cast<int>(knn)}};
+  REQUIRE(toSortedEdges(limited.build(points, embeddingDim)) == expected);
+}
+
+TEST_CASE("OnnxMetricLearning hands on the node features without copying", "[onnx][torch]") {
+  const auto execContext = cpuContext();
+  auto graphConstruction = affineMetricLearning();
+  auto points = randomPoints(1000);
+
+  auto nodeFeatures = toTensor(points, execContext);
+  const auto* featureData = nodeFeatures.data();
+  const auto tensors = graphConstruction(std::move(nodeFeatures), execContext);
+  REQUIRE(tensors.nodeFeatures.data() == featureData);
+  REQUIRE(toVector(tensors.nodeFeatures) == points);
+
+  // The edges are built from the embedded points
+  std::vector<float> embedded(points.size());
+  std::ranges::transform(points, embedded.begin(), [](const float x) { return 2 * x + 1; });
+  const mlutils::RadiusEdgeBuilder builder{{.radius = radius, .knn = 500}};
+  REQUIRE(tensors.edgeIndex.shape()[0] == 2);
+  REQUIRE(toVector(tensors.edgeIndex) == builder.build(embedded, embeddingDim));
+
+  // The std::vector interface gives the same results
+  const auto fromVector = graphConstruction(points, points.size() / embeddingDim, {}, execContext);
+  REQUIRE(toVector(fromVector.nodeFeatures) == points);
+  REQUIRE(toVector(fromVector.edgeIndex) == toVector(tensors.edgeIndex));
+}
+
+TEST_CASE("ChunkedEdgeClassifier", "[edges]") {
+  const auto execContext = cpuContext();
+  constexpr std::size_t nPoints = 2000;
+  const auto points = randomPoints(nPoints);
+  // A larger radius than usual for a well connected graph
+  const auto edges = mlutils::RadiusEdgeBuilder{{.radius = 0.3f, .knn = 0}}.build(points, embeddingDim);
+  const auto nEdges = edges.size() / 2;
+  REQUIRE(nEdges > 0);
+  // Small integers as node features, such that the sums of the message passing
+  // do not depend on the order of the edges
+  std::vector<float> features(points.size());
+  for (std::size_t i = 0; i < features.size(); ++i) {
+    features[i] = static_cast<float>(i % 7) - 3.f;
+  }
+  auto makeTensors = [&]() {
+    auto edgeIndex = ActsPlugins::Tensor<std::int64_t>::Create({2, nEdges}, execContext);
+    std::ranges::copy(edges, edgeIndex.data());
+    return ActsPlugins::PipelineTensors{toTensor(features, execContext), std::move(edgeIndex), std::nullopt,
+                                        std::nullopt};
+  };
+
+  const float cut = 2.f;
+  auto classifier = std::make_shared<MessagePassingClassifier>(cut);
+  const auto expected = classifiedEdges((*classifier)(makeTensors(), execContext));
+  REQUIRE(!expected.empty());
+
+  // Budget for about a quarter of the graph, counting nodes and edges equally
+  const mlutils::EdgeChunkingConfig chunking{
+      .memoryBudgetBytes = (nPoints + nEdges) / 4, .bytesPerNode = 1, .bytesPerEdge = 1, .haloHops = 2};
+  auto logger = []() { return Acts::getDefaultLogger("ChunkedEdgeClassifier", Acts::Logging::WARNING); };
+
+  SECTION("Identical results with a halo beyond the message passing") {
+    ChunkedEdgeClassifier chunked{classifier, chunking, logger()};
+    ChunkedEdgeClassifier::Stats stats{};
+    const auto result = chunked(makeTensors(), execContext, &stats);
+    REQUIRE(stats.numChunks > 1);
+    REQUIRE(stats.numClassifiedEdges > nEdges);
+    REQUIRE(classifiedEdges(result) == expected);
+    REQUIRE(toVector(result.nodeFeatures) == features);
+  }
+
+  SECTION("Every edge is classified once with a smaller halo") {
+    auto keepAll = std::make_shared<MessagePassingClassifier>(std::numeric_limits<float>::lowest());
+    ChunkedEdgeClassifier chunked{keepAll, {chunking.memoryBudgetBytes, 1, 1, 1}, logger()};
+    const auto result = chunked(makeTensors(), execContext);
+    REQUIRE(result.edgeIndex.shape()[1] == nEdges);
+    REQUIRE(toSortedEdges(toVector(result.edgeIndex)) == toSortedEdges(edges));
+  }
+
+  SECTION("Graphs within the budget are passed on as they are") {
+    ChunkedEdgeClassifier chunked{classifier, {}, logger()};
+    ChunkedEdgeClassifier::Stats stats{};
+    REQUIRE(classifiedEdges(chunked(makeTensors(), execContext, &stats)) == expected);
+    REQUIRE(stats.numChunks == 1);
+  }
+}
+
+TEST_CASE("UnionFindTrackBuilding is equivalent to the BoostTrackBuilding", "[tracks]") {
+  const auto execContext = cpuContext();
+  auto logger = []() { return Acts::getDefaultLogger("TrackBuilding", Acts::Logging::WARNING); };
+  ActsPlugins::BoostTrackBuilding boost{{}, logger()};
+
+  SECTION("Same candidates") {
+    for (const unsigned seed : {1u, 2u}) {
+      const auto graph = randomGraph(5000, seed);
+      REQUIRE(graph.numEdges() > 0);
+      std::vector<int> spacePointIDs(graph.numNodes);
+      std::iota(spacePointIDs.begin(), spacePointIDs.end(), 1000);
+
+      const auto expected = sortedCandidates(boost(toTensors(graph, execContext), spacePointIDs, execContext));
+      for (const unsigned numThreads : {1u, 4u}) {
+        UnionFindTrackBuilding unionFind{{.numThreads = numThreads, .minEdgesPerThread = 100}, logger()};
+        REQUIRE(sortedCandidates(unionFind(toTensors(graph, execContext), spacePointIDs, execContext)) == expected);
+      }
+    }
+  }
+
+  SECTION("Invalid input") {
+    UnionFindTrackBuilding unionFind{{}, logger()};
+    std::vector<int> tooFew(10);
+    REQUIRE_THROWS_AS(unionFind(toTensors(randomGraph(100, 3), execContext), tooFew, execContext),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("OnnxMetricLearning node feature hand-off benchmarks", "[.][benchmark]") {
+  const auto execContext = cpuContext();
+  auto graphConstruction = affineMetricLearning();
+  constexpr std::size_t nPoints = 20000;
+  auto points = randomPoints(nPoints);
+
+  // Previously the node features were copied twice (into a torch tensor and
+  // from that into the Acts tensor), the std::vector interface copies them
+  // once and handing on a tensor does not copy them at all
+  std::cout << "Node feature bytes per event: " << points.size() * sizeof(float) << " (" << nPoints << " hits)\n";
+
+  BENCHMARK("std::vector input (one copy)") { return graphConstruction(points, nPoints, {}, execContext); };
+  BENCHMARK_ADVANCED("Tensor input (no copy)")(Catch::Benchmark::Chronometer meter) {
+    // The input tensors are created outside of the measurement, as they would
+    // be filled directly by the feature extraction
+    std::vector<ActsPlugins::Tensor<float>> inputs{};
+    for (int i = 0; i < meter.runs(); ++i) {
+      inputs.push_back(toTensor(points, execContext));
+    }
+    meter.measure([&](int i) { return graphConstruction(std::move(inputs[i]), execContext); });
+  };
+}
+
+TEST_CASE("Edge building benchmarks", "[.][benchmark]") {
+  for (const std::size_t nPoints : {5000, 20000, 50000}) {
+    auto points = randomPoints(nPoints);
+    const auto label = std::to_string(nPoints) + " points";
+
+    BENCHMARK("torch buildEdges, " + label) { return torchEdges(points, radius); };
+
+    const mlutils::RadiusEdgeBuilder builder{{.radius = radius, .knn = 0}};
+    BENCHMARK("RadiusEdgeBuilder, " + label) { return builder.build(points, embeddingDim); };
+
+    const mlutils::RadiusEdgeBuilder multiThreaded{{.radius = radius, .knn = 0, .numThreads = 4}};
+    BENCHMARK("RadiusEdgeBuilder (4 threads), " + label) { return multiThreaded.build(points, embeddingDim); };
+  }
+}
+
+TEST_CASE("Track building benchmarks", "[.][benchmark]") {
+  // Graphs recorded by gnn_replay_benchmark --record-graphs, or random ones
+  std::vector<mlutils::RecordedGraph> graphs{};
+  if (const auto* recorded = std::getenv("MLTRACKING_RECORDED_GRAPHS")) {
+    std::ifstream file{recorded, std::ios::binary};
+    REQUIRE(file);
+    graphs = mlutils::readGraphs(file);
+  } else {
+    for (unsigned seed = 0; seed < 5; ++seed) {
+      graphs.push_back(randomGraph(50000, seed));
+    }
+  }
+  REQUIRE(!graphs.empty());
+  std::size_t numEdges = 0;
+  for (const auto& graph : graphs) {
+    numEdges += graph.numEdges();
+  }
+  std::cout << "Track building on " << graphs.size() << " graphs with " << numEdges << " edges\n";
+
+  const auto execContext = cpuContext();
+  auto logger = []() { return Acts::getDefaultLogger("TrackBuilding", Acts::Logging::WARNING); };
+  auto run = [&](ActsPlugins::TrackBuildingBase& trackBuilding) {
+    std::size_t numCandidates = 0;
+    for (const auto& graph : graphs) {
+      std::vector<int> spacePointIDs(graph.numNodes);
+      std::iota(spacePointIDs.begin(), spacePointIDs.end(), 0);
+      numCandidates += trackBuilding(toTensors(graph, execContext), spacePointIDs, execContext).size();
+    }
+    return numCandidates;
+  };
+
+  ActsPlugins::BoostTrackBuilding boost{{}, logger()};
+  BENCHMARK("BoostTrackBuilding") { return run(boost); };
+  for (const unsigned numThreads : {1u, 4u}) {
+    UnionFindTrackBuilding unionFind{{.numThreads = numThreads}, logger()};
+    BENCHMARK("UnionFindTrackBuilding (" + std::to_string(numThreads) + " threads)") { return run(unionFind); };
+  }
+  UnionFindTrackBuilding splitJunctions{{.splitJunctions = true}, logger()};
+  BENCHMARK("UnionFindTrackBuilding (split junctions)") { return run(splitJunctions); };
+}
@@ -1,10 +1,116 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
 #include "catch2/catch_test_macros.hpp"
+#include "catch2/matchers/catch_matchers_floating_point.hpp"
 #include "catch2/matchers/catch_matchers_vector.hpp"
 
+#include "EdgeBuilding.h"
+#include "EdgeChunking.h"
+#include "HitFeatures.h"
+#include "HitFiltering.h"
+#include "HitPartitioning.h"
+#include "InferenceBatcher.h"
+#include "MultiCollectionView.h"
 #include "ONNXInferenceModel.h"
+#include "ObjectPool.h"
+#include "ProfileSummary.h"
+#include "StageMonitoring.h"
+#include "StagePipeline.h"
+#include "TrackBuilding.h"
+#include "TrackOutput.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <numbers>
+#include <numeric>
+#include <ranges>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+namespace {
+const std::string testModelDir = MLTRACKING_TEST_MODEL_DIR;
+
+// Count all heap allocations in order to check that certain code paths do not
+// allocate memory
+std::atomic<size_t> allocationCount{0};
+
+std::vector<float> randomPoints(size_t nPoints, size_t dim, unsigned seed = 42) {
+  std::mt19937 rng{seed};
+  std::normal_distribution<float> dist{0.f, 0.5f};
+  std::vector<float> points(nPoints * dim);
+  std::ranges::generate(points, [&]() { return dist(rng); });
+  return points;
+}
+
+using Edge = std::pair<int64_t, int64_t>;
+
+/// Convert a [2, nEdges] edge index into a list of edges
+std::vector<Edge> toEdges(const std::vector<int64_t>& edgeIndex) {
+  const auto nEdges = edgeIndex.size() / 2;
+  std::vector<Edge> edges(nEdges);
+  for (size_t i = 0; i < nEdges; ++i) {
+    edges[i] = {edgeIndex[i], edgeIndex[nEdges + i]};
+  }
+  return edges;
+}
+
+/// Brute force edge building, keeping the knn closest neighbours of each point
+std::vector<Edge> bruteForceEdges(const std::vector<float>& points, size_t dim, float radius, size_t knn) {
+  const auto nPoints = points.size() / dim;
+  std::vector<Edge> edges{};
+  for (size_t i = 0; i < nPoints; ++i) {
+    std::vector<std::pair<float, int64_t>> neighbours{};
+    for (size_t j = 0; j < nPoints; ++j) {
+      float dist2 = 0;
+      for (size_t d = 0; d < dim; ++d) {
+        const auto diff = points[j * dim + d] - points[i * dim + d];
+        dist2 += diff * diff;
+      }
+      if (j != i && dist2 <= radius * radius) {
+        neighbours.emplace_back(dist2, j);
+      }
+    }
+    std::ranges::sort(neighbours);
+    neighbours.resize(std::min(knn, neighbours.size()));
+    for (const auto& [dist2, j] : neighbours) {
+      edges.emplace_back(std::min<int64_t>(i, j), std::max<int64_t>(i, j));
+    }
+  }
+  std::ranges::sort(edges);
+  const auto [first, last] = std::ranges::unique(edges);
+  edges.erase(first, last);
+  return edges;
+}
+} // namespace
+
+void* operator new(std::size_t size) {
+  ++allocationCount;
+  if (auto* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
 TEST_CASE("totalSize") {
   REQUIRE(mlutils::totalSize(42) == 1);
   REQUIRE(mlutils::totalSize(std::vector{1.23f, 2.34f}) == 2);
@@ -82,3 +188,1590 @@ TEST_CASE("getDimensions") {
     REQUIRE_THAT(dims, Catch::Matchers::Equals(std::vector<int64_t>{2, 2, 2}));
   }
 }
+
+TEST_CASE("Fixed size and contiguous containers") {
+  using Points = std::vector<std::array<float, 4>>;
+  static_assert(mlutils::detail::static_shape<std::array<std::array<int, 2>, 3>>::value ==
+                std::array<int64_t, 2>{3, 2});
+  static_assert(mlutils::detail::ContiguousData<Points>);
+  static_assert(mlutils::detail::ContiguousData<std::span<const float>>);
+  static_assert(!mlutils::detail::ContiguousData<std::vector<std::vector<float>>>);
+
+  const Points points{{1.f, 2.f, 3.f, 4.f}, {5.f, 6.f, 7.f, 8.f}, {9.f, 10.f, 11.f, 12.f}};
+  const auto expectedFlat = std::vector<float>{1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f};
+
+  SECTION("totalSize") {
+    REQUIRE(mlutils::totalSize(points) == 12);
+    REQUIRE(mlutils::totalSize(Points{}) == 0);
+    REQUIRE(mlutils::totalSize(std::array<std::array<int, 2>, 3>{}) == 6);
+    REQUIRE(mlutils::totalSize(std::span(expectedFlat)) == 12);
+    REQUIRE(mlutils::totalSize(std::vector<std::array<std::vector<int>, 2>>{{std::vector{1, 2}, std::vector{3}}}) == 3);
+  }
+
+  SECTION("flatten") {
+    REQUIRE_THAT(mlutils::flatten(points), Catch::Matchers::Equals(expectedFlat));
+    REQUIRE_THAT(mlutils::flatten(std::span(expectedFlat)), Catch::Matchers::Equals(expectedFlat));
+    REQUIRE_THAT(mlutils::flatten(std::array<std::array<int, 2>, 2>{{{1, 2}, {3, 4}}}),
+                 Catch::Matchers::Equals(std::vector<int>{1, 2, 3, 4}));
+  }
+
+  SECTION("flatView does not copy") {
+    const auto view = mlutils::flatView(points);
+    REQUIRE(view.size() == 12);
+    REQUIRE(static_cast<const void*>(view.data()) == static_cast<const void*>(points.data()));
+    REQUIRE_THAT(std::vector<float>(view.begin(), view.end()), Catch::Matchers::Equals(expectedFlat));
+  }
+
+  SECTION("getDimensions") {
+    REQUIRE_THAT(mlutils::getDimensions(points), Catch::Matchers::Equals(std::vector<int64_t>{3, 4}));
+    // The inner dimension is known at compile time
+    REQUIRE_THAT(mlutils::getDimensions(Points{}), Catch::Matchers::Equals(std::vector<int64_t>{0, 4}));
+    REQUIRE_THAT(mlutils::getDimensions(std::array<std::array<int, 2>, 3>{}),
+                 Catch::Matchers::Equals(std::vector<int64_t>{3, 2}));
+    REQUIRE_THAT(mlutils::getDimensions(std::span(points)), Catch::Matchers::Equals(std::vector<int64_t>{3, 4}));
+  }
+
+  SECTION("hasShape") {
+    REQUIRE(mlutils::hasShape(points, std::vector<int64_t>{3, 4}));
+    REQUIRE_FALSE(mlutils::hasShape(points, std::vector<int64_t>{4, 3}));
+    REQUIRE(mlutils::hasShape(std::vector<std::vector<int>>{{1, 2}, {3, 4}}, std::vector<int64_t>{2, 2}));
+    // Jagged containers are detected, contrary to getDimensions
+    REQUIRE_FALSE(mlutils::hasShape(std::vector<std::vector<int>>{{1, 2}, {3, 4, 5}}, std::vector<int64_t>{2, 2}));
+    REQUIRE(mlutils::hasShape(42, std::vector<int64_t>{}));
+  }
+
+#ifdef __cpp_lib_mdspan
+  SECTION("mdspan") {
+    const auto mds = std::mdspan(expectedFlat.data(), 3, 4);
+    static_assert(mlutils::detail::ContiguousData<decltype(mds)>);
+    REQUIRE(mlutils::totalSize(mds) == 12);
+    REQUIRE_THAT(mlutils::getDimensions(mds), Catch::Matchers::Equals(std::vector<int64_t>{3, 4}));
+    REQUIRE(mlutils::flatView(mds).data() == expectedFlat.data());
+  }
+#endif
+}
+
+TEST_CASE("flatten benchmarks", "[.][benchmark]") {
+  // Typical number of hits with 4 features each
+  constexpr size_t nHits = 20000;
+  std::vector<std::vector<float>> nested(nHits, std::vector<float>{1.f, 2.f, 3.f, 4.f});
+  std::vector<std::array<float, 4>> arrays(nHits, std::array{1.f, 2.f, 3.f, 4.f});
+
+  BENCHMARK("flatten vector<vector<float>>") { return mlutils::flatten(nested); };
+  BENCHMARK("flatten vector<array<float, 4>>") { return mlutils::flatten(arrays); };
+  BENCHMARK("flatView vector<array<float, 4>>") { return mlutils::flatView(arrays); };
+  BENCHMARK("getDimensions vector<vector<float>>") { return mlutils::getDimensions(nested); };
+  BENCHMARK("getDimensions vector<array<float, 4>>") { return mlutils::getDimensions(arrays); };
+}
+
+TEST_CASE("computeRPhi", "[features]") {
+  using Catch::Matchers::WithinAbs;
+  std::vector<float> x = {1.f, 0.f, -1.f, 0.f, 0.f, -0.f, -2.f, 3.f, 1e-3f};
+  std::vector<float> y = {0.f, 1.f, 0.f, -1.f, 0.f, 0.f, -0.f, -3.f, 1e-3f};
+
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> dist{-1500.f, 1500.f};
+  for (int i = 0; i < 10000; ++i) {
+    x.push_back(dist(rng));
+    y.push_back(dist(rng));
+  }
+
+  std::vector<float> r(x.size());
+  std::vector<float> phi(x.size());
+  mlutils::computeRPhi(x, y, r, phi);
+  for (size_t i = 0; i < x.size(); ++i) {
+    REQUIRE_THAT(r[i], WithinAbs(std::hypot(x[i], y[i]), 1e-6 * std::hypot(x[i], y[i])));
+    REQUIRE_THAT(phi[i], WithinAbs(std::atan2(y[i], x[i]), 5e-7));
+  }
+  // Signed zero conventions are the same as for std::atan2
+  REQUIRE(phi[5] == std::atan2(0.f, -0.f));
+  REQUIRE(phi[6] == std::atan2(-0.f, -2.f));
+}
+
+TEST_CASE("HitFeatureExtractor", "[features]") {
+  using Catch::Matchers::WithinAbs;
+  using Feature = mlutils::HitFeature;
+  mlutils::HitArrays hits{};
+  // More hits than fit into one block to check the blocking
+  for (int i = 0; i < 1000; ++i) {
+    hits.push_back(0.5f * i, -0.25f * i, 2.f * i, 0.1f * i);
+  }
+
+  SECTION("Default features") {
+    const mlutils::HitFeatureExtractor extractor{};
+    REQUIRE(extractor.numFeatures() == 4);
+    REQUIRE(extractor.usesCompiledLayout());
+    const auto features = extractor.extract(hits);
+    REQUIRE(features.size() == hits.size() * 4);
+    for (size_t i = 0; i < hits.size(); ++i) {
+      REQUIRE_THAT(features[i * 4 + 0], WithinAbs(std::hypot(hits.x[i], hits.y[i]), 1e-3));
+      REQUIRE_THAT(features[i * 4 + 1], WithinAbs(std::atan2(hits.y[i], hits.x[i]), 5e-7));
+      REQUIRE(features[i * 4 + 2] == hits.z[i]);
+      REQUIRE(features[i * 4 + 3] == hits.time[i]);
+    }
+  }
+
+  SECTION("Configurable features and scales") {
+    const mlutils::HitFeatureExtractor extractor{{.features = {Feature::Z, Feature::X, Feature::Phi},
+                                                  .scales = {1000.f, 100.f, 3.14159265f}}};
+    REQUIRE(extractor.numFeatures() == 3);
+    REQUIRE_FALSE(extractor.usesCompiledLayout());
+    std::vector<float> features(hits.size() * 3);
+    extractor.extract(hits, features);
+    for (size_t i = 0; i < hits.size(); ++i) {
+      REQUIRE_THAT(features[i * 3 + 0], WithinAbs(hits.z[i] / 1000.f, 1e-6));
+      REQUIRE_THAT(features[i * 3 + 1], WithinAbs(hits.x[i] / 100.f, 1e-6));
+      REQUIRE_THAT(features[i * 3 + 2], WithinAbs(std::atan2(hits.y[i], hits.x[i]) / 3.14159265f, 5e-7));
+    }
+  }
+
+  SECTION("Compiled layouts give the same features as the generic extraction") {
+    using Catch::Matchers::WithinULP;
+    auto checkLayout = [&]<typename Layout>(std::type_identity<Layout>) {
+      const std::vector<Feature> layoutFeatures(Layout::features.begin(), Layout::features.end());
+      std::vector<float> scales{};
+      for (size_t i = 0; i < Layout::numFeatures; ++i) {
+        scales.push_back(0.5f + i);
+      }
+      const mlutils::HitFeatureExtractor extractor{{.features = layoutFeatures, .scales = scales}};
+      REQUIRE(extractor.usesCompiledLayout());
+      const auto features = extractor.extract(hits);
+
+      // Single features have no compiled layout, i.e. these are extracted
+      // column by column
+      for (size_t iFeat = 0; iFeat < Layout::numFeatures; ++iFeat) {
+        const mlutils::HitFeatureExtractor single{{.features = {layoutFeatures[iFeat]}, .scales = {scales[iFeat]}}};
+        REQUIRE_FALSE(single.usesCompiledLayout());
+        const auto column = single.extract(hits);
+        for (size_t i = 0; i < hits.size(); ++i) {
+          REQUIRE_THAT(features[i * Layout::numFeatures + iFeat], WithinULP(column[i], 1));
+        }
+      }
+    };
+    [&]<typename... Layouts>(std::type_identity<std::tuple<Layouts...>>) {
+      (checkLayout(std::type_identity<Layouts>{}), ...);
+    }(std::type_identity<mlutils::CompiledHitFeatureLayouts>{});
+  }
+
+  SECTION("Invalid configurations") {
+    REQUIRE_THROWS_AS(mlutils::HitFeatureExtractor({.features = {}, .scales = {}}), std::invalid_argument);
+    REQUIRE_THROWS_AS(mlutils::HitFeatureExtractor({.features = {Feature::R}, .scales = {1.f, 2.f}}),
+                      std::invalid_argument);
+    REQUIRE(mlutils::toHitFeature("phi") == Feature::Phi);
+    REQUIRE_THROWS_AS(mlutils::toHitFeature("eta"), std::invalid_argument);
+  }
+}
+
+TEST_CASE("generateSyntheticHits", "[features]") {
+  const auto hits = mlutils::generateSyntheticHits(1234, 1);
+  REQUIRE(hits.size() == 1234);
+  REQUIRE(hits.time.size() == 1234);
+  // Reproducible for the same seed only
+  REQUIRE(mlutils::generateSyntheticHits(1234, 1).x == hits.x);
+  REQUIRE(mlutils::generateSyntheticHits(1234, 2).x != hits.x);
+  for (size_t i = 0; i < hits.size(); ++i) {
+    REQUIRE(std::hypot(hits.x[i], hits.y[i]) < 1500.f);
+    REQUIRE(hits.time[i] > 0.f);
+  }
+}
+
+TEST_CASE("selectHits", "[features]") {
+  // Two collections: (r = 10, 20, 30, 40 at times 0, 1, 2, 3) and a second
+  // one with a hit pair that is 1 mm apart and a single hit
+  mlutils::HitArrays hits{};
+  for (int i = 0; i < 4; ++i) {
+    hits.push_back(10.f * (i + 1), 0.f, 0.f, static_cast<float>(i));
+  }
+  hits.push_back(0.f, 50.f, 0.f, 0.f);
+  hits.push_back(0.f, 51.f, 0.f, 0.f);
+  hits.push_back(0.f, 50.f, 100.f, 0.f);
+  const std::vector<size_t> collectionSizes = {4, 3};
+  mlutils::HitSelection selection{};
+  auto select = [&](const mlutils::HitFilterConfig& config) {
+    mlutils::selectHits(hits, collectionSizes, config, selection);
+    return selection.hits;
+  };
+  using Indices = std::vector<uint32_t>;
+
+  SECTION("Without cuts all hits are selected") {
+    REQUIRE_FALSE(mlutils::HitFilterConfig{}.enabled());
+    REQUIRE(select({}) == Indices{0, 1, 2, 3, 4, 5, 6});
+    REQUIRE(selection.hitArrays.x == hits.x);
+    REQUIRE(selection.merged.empty());
+  }
+
+  SECTION("Time and radius cuts") {
+    REQUIRE(select({.cuts = {.timeMin = 0.5f, .timeMax = 2.5f}}) == Indices{1, 2});
+    REQUIRE(selection.hitArrays.x == std::vector{20.f, 30.f});
+    REQUIRE(selection.hitArrays.time == std::vector{1.f, 2.f});
+    REQUIRE(select({.cuts = {.rMin = 15.f, .rMax = 45.f}}) == Indices{1, 2, 3});
+    // The per collection cuts come on top of the global ones
+    const mlutils::HitFilterConfig config{.cuts = {.rMin = 15.f}, .collectionCuts = {{.timeMax = 1.5f}, {}}};
+    REQUIRE(config.enabled());
+    REQUIRE(select(config) == Indices{1, 4, 5, 6});
+  }
+
+  SECTION("Merging close hits") {
+    mlutils::HitFilterConfig config{.mergeDistance = 2.f};
+    REQUIRE(select(config) == Indices{0, 1, 2, 3, 4, 6});
+    REQUIRE(selection.merged == std::vector<std::pair<uint32_t, uint32_t>>{{5, 4}});
+    // Only in the given collections
+    config.mergeCollections = {0};
+    REQUIRE(select(config) == Indices{0, 1, 2, 3, 4, 5, 6});
+    config.mergeCollections = {1};
+    REQUIRE(select(config).size() == 6);
+
+    // The merged hits are added to the candidates of the hits they have been
+    // merged into
+    std::vector<std::vector<int>> candidates = {{0, 1}, {2, 4}, {3, 6}};
+    mlutils::addMergedHits(selection, candidates);
+    REQUIRE(candidates == std::vector<std::vector<int>>{{0, 1}, {2, 4, 5}, {3, 6}});
+  }
+
+  SECTION("Invalid input") {
+    REQUIRE_THROWS_AS((mlutils::HitCuts{.timeMin = 1.f, .timeMax = 0.f}.validate()), std::invalid_argument);
+    REQUIRE_THROWS_AS(mlutils::HitFilterConfig{.mergeDistance = -1.f}.validate(), std::invalid_argument);
+    const std::vector<size_t> wrongSizes = {4, 4};
+    REQUIRE_THROWS_AS(mlutils::selectHits(hits, wrongSizes, {}, selection), std::invalid_argument);
+    REQUIRE_THROWS_AS(select({.collectionCuts = {{}}}), std::invalid_argument);
+
+    const mlutils::HitFilterConfig config{.collectionCuts = {{}, {}}, .mergeDistance = 1.f, .mergeCollections = {1}};
+    REQUIRE_NOTHROW(config.validate(2));
+    REQUIRE_THROWS_AS(config.validate(3), std::invalid_argument);
+    REQUIRE_THROWS_AS((mlutils::HitFilterConfig{.mergeDistance = 1.f, .mergeCollections = {2}}.validate(2)),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("Hit feature extraction benchmarks", "[.][benchmark]") {
+  constexpr size_t nHits = 20000;
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> dist{-1500.f, 1500.f};
+  mlutils::HitArrays hits{};
+  for (size_t i = 0; i < nHits; ++i) {
+    hits.push_back(dist(rng), dist(rng), dist(rng), dist(rng));
+  }
+  const mlutils::HitFeatureExtractor extractor{};
+  std::vector<float> features(nHits * extractor.numFeatures());
+
+  BENCHMARK("scalar r/phi into nested vectors") {
+    std::vector<std::vector<float>> nested{};
+    nested.reserve(nHits);
+    for (size_t i = 0; i < nHits; ++i) {
+      nested.push_back({std::hypot(hits.x[i], hits.y[i]), std::atan2(hits.y[i], hits.x[i]), hits.z[i], hits.time[i]});
+    }
+    return mlutils::flatten(nested);
+  };
+  BENCHMARK("HitFeatureExtractor") {
+    extractor.extract(hits, features);
+    return features.data();
+  };
+}
+
+TEST_CASE("RadiusEdgeBuilder", "[edges]") {
+  using Config = mlutils::RadiusEdgeBuilder::Config;
+  constexpr float radius = 0.2f;
+
+  SECTION("Same edges as brute force for different dimensions") {
+    for (const size_t dim : {1, 2, 3, 4, 8}) {
+      const auto points = randomPoints(1000, dim);
+      // Scale the radius to get a reasonable number of edges also in higher dimensions
+      const auto dimRadius = 0.1f * dim;
+      const mlutils::RadiusEdgeBuilder builder{Config{.radius = dimRadius, .knn = 0}};
+      const auto edges = toEdges(builder.build(points, dim));
+      REQUIRE(!edges.empty());
+      // Sorted, unique and without self loops
+      REQUIRE(edges == bruteForceEdges(points, dim, dimRadius, points.size()));
+    }
+  }
+
+  SECTION("Limiting the number of neighbours") {
+    const auto points = randomPoints(1000, 3);
+    const mlutils::RadiusEdgeBuilder builder{Config{.radius = radius, .knn = 3}};
+    const auto edges = toEdges(builder.build(points, 3));
+    REQUIRE(edges == bruteForceEdges(points, 3, radius, 3));
+    REQUIRE(edges.size() < bruteForceEdges(points, 3, radius, points.size()).size());
+  }
+
+  SECTION("Multithreaded queries give identical results") {
+    const auto points = randomPoints(2000, 4);
+    for (const int knn : {0, 5}) {
+      const mlutils::RadiusEdgeBuilder single{Config{.radius = radius, .knn = knn, .numThreads = 1}};
+      const mlutils::RadiusEdgeBuilder multi{Config{.radius = radius, .knn = knn, .numThreads = 3}};
+      REQUIRE(single.build(points, 4) == multi.build(points, 4));
+    }
+  }
+
+  SECTION("Shuffling directions") {
+    const auto points = randomPoints(1000, 4);
+    const mlutils::RadiusEdgeBuilder builder{Config{.radius = radius, .knn = 0, .shuffleDirections = true}};
+    auto edges = toEdges(builder.build(points, 4));
+    const auto nFlipped = std::ranges::count_if(edges, [](const auto& e) { return e.first > e.second; });
+    REQUIRE(nFlipped > 0);
+    REQUIRE(nFlipped < static_cast<long>(edges.size()));
+
+    for (auto& [src, dst] : edges) {
+      if (src > dst) {
+        std::swap(src, dst);
+      }
+    }
+    REQUIRE(edges == bruteForceEdges(points, 4, radius, points.size()));
+  }
+
+  SECTION("Edge cases") {
+    const mlutils::RadiusEdgeBuilder builder{Config{.radius = radius, .numThreads = 4}};
+    REQUIRE(builder.build(std::vector<float>{}, 4).empty());
+    REQUIRE(builder.build(std::vector<float>{1.f, 2.f, 3.f, 4.f}, 4).empty());
+    // All points in the same place
+    const std::vector<float> points(3 * 4, 1.f);
+    REQUIRE(toEdges(builder.build(points, 4)) == std::vector<Edge>{{0, 1}, {0, 2}, {1, 2}});
+  }
+
+  SECTION("Output is written directly into the allocated buffer") {
+    const auto points = randomPoints(500, 4);
+    const mlutils::RadiusEdgeBuilder builder{Config{.radius = radius}};
+    std::vector<int64_t> buffer{};
+    size_t nAllocations = 0;
+    const auto nEdges = builder.build(points, 4, [&](size_t n) {
+      ++nAllocations;
+      buffer.resize(2 * n);
+      return buffer.data();
+    });
+    REQUIRE(nAllocations == 1);
+    REQUIRE(buffer.size() == 2 * nEdges);
+    REQUIRE(buffer == builder.build(points, 4));
+  }
+}
+
+TEST_CASE("partitionHits", "[edges]") {
+  constexpr auto pi = std::numbers::pi_v<float>;
+  mlutils::HitPartition partition{};
+  auto sectorHits = [&partition](size_t iSector) {
+    const auto hits = partition.sector(iSector);
+    return std::vector<uint32_t>(hits.begin(), hits.end());
+  };
+
+  SECTION("Overlapping phi sectors") {
+    // 4 sectors: [-pi, -pi/2), [-pi/2, 0), [0, pi/2), [pi/2, pi)
+    const std::vector<float> phi{-pi / 4, 0.01f, pi - 0.01f, -pi / 2 + 0.2f};
+    const std::vector<float> eta(phi.size(), 0.f);
+    mlutils::partitionHits(eta, phi, {.phiSectors = 4, .phiOverlap = 0.1f}, partition);
+
+    REQUIRE(partition.numSectors() == 4);
+    // The last hit is not close enough to the boundary to be in sector 0.
+    // The third one wraps around into sector 0
+    REQUIRE_THAT(sectorHits(0), Catch::Matchers::Equals(std::vector<uint32_t>{2}));
+    REQUIRE_THAT(sectorHits(1), Catch::Matchers::Equals(std::vector<uint32_t>{0, 1, 3}));
+    REQUIRE_THAT(sectorHits(2), Catch::Matchers::Equals(std::vector<uint32_t>{1}));
+    REQUIRE_THAT(sectorHits(3), Catch::Matchers::Equals(std::vector<uint32_t>{2}));
+  }
+
+  SECTION("Eta regions") {
+    mlutils::HitArrays hits{};
+    // eta of 0, ~0.88 and ~-0.88
+    hits.push_back(1.f, 0.f, 0.f, 0.f);
+    hits.push_back(1.f, 0.f, 1.f, 0.f);
+    hits.push_back(0.f, 1.f, -1.f, 0.f);
+    std::vector<float> eta{};
+    std::vector<float> phi{};
+    mlutils::computeEtaPhi(hits, eta, phi);
+    REQUIRE_THAT(eta[1], Catch::Matchers::WithinAbs(std::asinh(1.f), 1e-6));
+    REQUIRE_THAT(phi[2], Catch::Matchers::WithinAbs(pi / 2, 1e-6));
+
+    mlutils::partitionHits(eta, phi, {.etaRegions = 2}, partition);
+    REQUIRE(partition.numSectors() == 2);
+    REQUIRE(partition.hits.size() == 3);
+    REQUIRE(partition.sector(0).size() == 1);
+    REQUIRE(partition.sector(0)[0] == 2);
+
+    // With enough overlap the central hit is in both regions
+    mlutils::partitionHits(eta, phi, {.etaRegions = 2, .etaOverlap = 0.1f}, partition);
+    REQUIRE_THAT(sectorHits(0), Catch::Matchers::Equals(std::vector<uint32_t>{0, 2}));
+    REQUIRE_THAT(sectorHits(1), Catch::Matchers::Equals(std::vector<uint32_t>{0, 1}));
+  }
+
+  SECTION("Every hit is in at least one sector") {
+    const auto points = randomPoints(1000, 2);
+    std::vector<float> eta{};
+    std::vector<float> phi{};
+    for (size_t i = 0; i < 1000; ++i) {
+      eta.push_back(points[2 * i]);
+      phi.push_back(std::clamp(points[2 * i + 1] * pi, -pi, pi));
+    }
+    mlutils::partitionHits(eta, phi, {.phiSectors = 8, .phiOverlap = 0.05f, .etaRegions = 3, .etaOverlap = 0.1f},
+                           partition);
+    REQUIRE(partition.numSectors() == 24);
+    REQUIRE(partition.hits.size() > 1000);
+    std::vector<int> counts(1000, 0);
+    for (size_t s = 0; s < partition.numSectors(); ++s) {
+      REQUIRE(std::ranges::is_sorted(partition.sector(s)));
+      for (const auto hit : partition.sector(s)) {
+        ++counts[hit];
+      }
+    }
+    REQUIRE(std::ranges::all_of(counts, [](const auto c) { return c >= 1; }));
+  }
+
+  SECTION("Invalid configuration") {
+    REQUIRE_THROWS_AS(mlutils::SectorConfig{.phiSectors = 0}.validate(), std::invalid_argument);
+    REQUIRE_THROWS_AS(mlutils::SectorConfig{.etaOverlap = -1.f}.validate(), std::invalid_argument);
+    REQUIRE_NOTHROW(mlutils::SectorConfig{}.validate());
+    REQUIRE(!mlutils::SectorConfig{}.enabled());
+  }
+}
+
+TEST_CASE("RadiusEdgeBuilder with partitioned hits", "[edges]") {
+  using Config = mlutils::RadiusEdgeBuilder::Config;
+  constexpr float radius = 0.2f;
+
+  // An embedding in which nearby points are also nearby in eta and phi, such
+  // that sufficiently overlapping sectors contain all edges
+  const size_t nPoints = 3000;
+  std::mt19937 rng{123};
+  std::uniform_real_distribution<float> phiDist{-std::numbers::pi_v<float>, std::numbers::pi_v<float>};
+  std::uniform_real_distribution<float> etaDist{-2.f, 2.f};
+  std::vector<float> eta(nPoints);
+  std::vector<float> phi(nPoints);
+  std::vector<float> points{};
+  for (size_t i = 0; i < nPoints; ++i) {
+    eta[i] = etaDist(rng);
+    phi[i] = phiDist(rng);
+    points.insert(points.end(), {std::cos(phi[i]), std::sin(phi[i]), eta[i]});
+  }
+
+  auto buildPartitioned = [&](const mlutils::RadiusEdgeBuilder& builder, const mlutils::HitPartition& partition) {
+    std::vector<int64_t> edgeIndex{};
+    builder.build(points, 3, partition, [&edgeIndex](size_t n) {
+      edgeIndex.resize(2 * n);
+      return edgeIndex.data();
+    });
+    return edgeIndex;
+  };
+
+  const mlutils::RadiusEdgeBuilder builder{Config{.radius = radius, .knn = 0, .numThreads = 3}};
+  const auto allEdges = builder.build(points, 3);
+  REQUIRE(!allEdges.empty());
+
+  mlutils::HitPartition partition{};
+  SECTION("Same edges with sufficient overlap") {
+    // The chord length in (cos phi, sin phi) is smaller than the phi difference
+    mlutils::partitionHits(eta, phi, {.phiSectors = 6, .phiOverlap = 0.25f, .etaRegions = 4, .etaOverlap = 0.25f},
+                           partition);
+    REQUIRE(buildPartitioned(builder, partition) == allEdges);
+
+    const mlutils::RadiusEdgeBuilder single{Config{.radius = radius, .knn = 0, .numThreads = 1}};
+    REQUIRE(buildPartitioned(single, partition) == allEdges);
+  }
+
+  SECTION("Edges across sector boundaries are lost without overlap") {
+    mlutils::partitionHits(eta, phi, {.phiSectors = 6, .etaRegions = 4}, partition);
+    REQUIRE(partition.hits.size() == nPoints);
+    const auto partEdges = toEdges(buildPartitioned(builder, partition));
+    const auto edges = toEdges(allEdges);
+    REQUIRE(partEdges.size() < edges.size());
+    REQUIRE(std::ranges::includes(edges, partEdges));
+  }
+
+  SECTION("A single sector gives the same edges") {
+    mlutils::partitionHits(eta, phi, {}, partition);
+    REQUIRE(buildPartitioned(builder, partition) == allEdges);
+  }
+}
+
+TEST_CASE("EdgeChunker", "[edges]") {
+  constexpr size_t nPoints = 1000;
+  const auto points = randomPoints(nPoints, 3);
+  const auto edgeIndex = mlutils::RadiusEdgeBuilder{{.radius = 0.25f, .knn = 0}}.build(points, 3);
+  const auto edges = toEdges(edgeIndex);
+  REQUIRE(!edges.empty());
+
+  // Collect all chunks and check that every node is a core node and every edge
+  // belongs to a chunk exactly once
+  auto checkChunks = [&](const mlutils::EdgeChunkingConfig& config) {
+    mlutils::EdgeChunker chunker{nPoints, edgeIndex, config};
+    std::vector<int> coreCount(nPoints, 0);
+    std::vector<int> edgeCount(edges.size(), 0);
+    mlutils::EdgeChunk chunk{};
+    size_t numChunks = 0;
+    while (chunker.next(chunk)) {
+      ++numChunks;
+      REQUIRE(chunk.numCoreNodes > 0);
+      REQUIRE(chunk.edgeIndex.size() == 2 * chunk.numEdges());
+      REQUIRE((config.fits(chunk.estimatedBytes) || chunk.numCoreNodes == 1));
+      for (size_t i = 0; i < chunk.numCoreNodes; ++i) {
+        ++coreCount[chunk.nodes[i]];
+      }
+      for (size_t i = 0; i < chunk.numEdges(); ++i) {
+        const auto source = chunk.edgeIndex[i];
+        const auto target = chunk.edgeIndex[chunk.numEdges() + i];
+        // The local indices refer to the nodes of the original edge
+        REQUIRE(Edge{chunk.nodes[source], chunk.nodes[target]} == edges[chunk.edges[i]]);
+        if (chunk.isCoreNode(source)) {
+          ++edgeCount[chunk.edges[i]];
+        }
+      }
+    }
+    REQUIRE(std::ranges::all_of(coreCount, [](int count) { return count == 1; }));
+    REQUIRE(std::ranges::all_of(edgeCount, [](int count) { return count == 1; }));
+    return numChunks;
+  };
+
+  SECTION("Without a budget the whole graph is a single chunk") { REQUIRE(checkChunks({}) == 1); }
+
+  SECTION("The chunks fit into the budget") {
+    const auto fullGraphBytes = mlutils::EdgeChunkingConfig{}.estimateBytes(nPoints, edges.size());
+    for (const unsigned haloHops : {1u, 2u}) {
+      const mlutils::EdgeChunkingConfig config{.memoryBudgetBytes = fullGraphBytes / 5, .haloHops = haloHops};
+      REQUIRE(checkChunks(config) > 5);
+    }
+    // A tiny budget leaves single node chunks
+    REQUIRE(checkChunks({.memoryBudgetBytes = 1}) == nPoints);
+  }
+
+  SECTION("Invalid input") {
+    REQUIRE_THROWS_AS(mlutils::EdgeChunkingConfig{.haloHops = 0}.validate(), std::invalid_argument);
+    REQUIRE_THROWS_AS(mlutils::EdgeChunker(10, std::vector<int64_t>{0, 10}, {}), std::invalid_argument);
+  }
+}
+
+TEST_CASE("UnionFindTrackBuilder", "[edges]") {
+  constexpr size_t nPoints = 2000;
+  const auto points = randomPoints(nPoints, 3);
+  const auto edgeIndex = mlutils::RadiusEdgeBuilder{{.radius = 0.1f, .knn = 0}}.build(points, 3);
+  const auto nEdges = edgeIndex.size() / 2;
+  REQUIRE(nEdges > 0);
+  std::vector<float> scores(nEdges);
+  std::mt19937 rng{42};
+  std::ranges::generate(scores, [&]() { return std::uniform_real_distribution<float>{0.f, 1.f}(rng); });
+  std::vector<int> nodeIds(nPoints);
+  std::iota(nodeIds.begin(), nodeIds.end(), 0);
+
+  // Connected components via a breadth first search from the lowest unvisited
+  // node, using the edges that pass the cut
+  auto bfsComponents = [&](float cut) {
+    std::vector<std::vector<int>> neighbours(nPoints);
+    for (size_t e = 0; e < nEdges; ++e) {
+      if (scores[e] >= cut) {
+        neighbours[edgeIndex[e]].push_back(edgeIndex[nEdges + e]);
+        neighbours[edgeIndex[nEdges + e]].push_back(edgeIndex[e]);
+      }
+    }
+    std::vector<std::vector<int>> components{};
+    std::vector<bool> visited(nPoints, false);
+    for (size_t start = 0; start < nPoints; ++start) {
+      if (visited[start]) {
+        continue;
+      }
+      visited[start] = true;
+      auto& component = components.emplace_back(1, static_cast<int>(start));
+      for (size_t head = 0; head < component.size(); ++head) {
+        for (const auto neighbour : neighbours[component[head]]) {
+          if (!visited[neighbour]) {
+            visited[neighbour] = true;
+            component.push_back(neighbour);
+          }
+        }
+      }
+      std::ranges::sort(component);
+    }
+    return components;
+  };
+  auto build = [&](const mlutils::UnionFindTrackBuilder::Config& config) {
+    return mlutils::UnionFindTrackBuilder{config}.build<int>(edgeIndex, scores, nodeIds);
+  };
+
+  SECTION("Same candidates as a breadth first search") {
+    for (const float cut : {0.f, 0.5f, 0.9f}) {
+      const auto expected = bfsComponents(cut);
+      REQUIRE(expected.size() > 1);
+      REQUIRE(build({.scoreCut = cut}) == expected);
+      // Enough threads to give each only a few edges
+      REQUIRE(build({.scoreCut = cut, .numThreads = 4, .minEdgesPerThread = 10}) == expected);
+    }
+  }
+
+  SECTION("Split junctions leave only chains") {
+    const auto candidates = build({.splitJunctions = true});
+    REQUIRE(candidates.size() > bfsComponents(0.f).size());
+    size_t numNodes = 0;
+    for (const auto& candidate : candidates) {
+      numNodes += candidate.size();
+    }
+    REQUIRE(numNodes == nPoints);
+
+    mlutils::UnionFindTrackBuilder builder{{.splitJunctions = true}};
+    // A node with three edges keeps the two with the highest scores
+    const std::vector<int64_t> star = {0, 0, 0, 1, 2, 3};
+    const std::vector<float> starScores = {0.9f, 0.2f, 0.8f};
+    const std::vector<int> starIds = {10, 11, 12, 13};
+    const auto starCands = builder.build<int>(star, starScores, starIds);
+    REQUIRE(starCands == std::vector<std::vector<int>>{{10, 11, 13}, {12}});
+  }
+
+  SECTION("Invalid input") {
+    const mlutils::UnionFindTrackBuilder builder{};
+    const std::vector<int> ids = {0, 1};
+    REQUIRE_THROWS_AS(builder.build<int>(std::vector<int64_t>{0, 2}, {}, ids), std::invalid_argument);
+    REQUIRE_THROWS_AS(builder.build<int>(std::vector<int64_t>{0, 1}, std::vector<float>{0.f, 1.f}, ids),
+                      std::invalid_argument);
+  }
+
+  SECTION("Recorded graphs") {
+    std::stringstream stream{};
+    const mlutils::RecordedGraph graph{.numNodes = nPoints, .edgeIndex = edgeIndex, .scores = scores};
+    mlutils::writeGraph(stream, graph);
+    mlutils::writeGraph(stream, {.numNodes = 3});
+    const auto graphs = mlutils::readGraphs(stream);
+    REQUIRE(graphs.size() == 2);
+    REQUIRE(graphs[0].numNodes == nPoints);
+    REQUIRE(graphs[0].edgeIndex == edgeIndex);
+    REQUIRE(graphs[0].scores == scores);
+    REQUIRE(graphs[1].numEdges() == 0);
+
+    std::stringstream truncated{stream.str().substr(0, 40)};
+    REQUIRE_THROWS_AS(mlutils::readGraphs(truncated), std::runtime_error);
+  }
+}
+
+TEST_CASE("ONNXInferenceModel concurrent inference", "[onnx]") {
+  mlutils::ONNXInferenceModel model("ConcurrencyTest");
+  // Running a model that has not been loaded (yet) is an error
+  REQUIRE_THROWS_AS(model.runInference(std::vector<std::vector<float>>{{1.f, 2.f}}), std::runtime_error);
+  REQUIRE(model.loadModel(testModelDir + "/affine.onnx"));
+
+  constexpr int nThreads = 8;
+  constexpr int nIterations = 200;
+  // Collect the number of failures per thread and check them on the main
+  // thread, since the Catch2 assertion macros are not thread-safe
+  std::vector<int> failures(nThreads, 0);
+
+  std::vector<std::thread> threads{};
+  for (int iThread = 0; iThread < nThreads; ++iThread) {
+    threads.emplace_back([&model, &failures, iThread]() {
+      for (int iter = 0; iter < nIterations; ++iter) {
+        // Use different sizes and values in every thread to make it likely
+        // to spot mixed up inputs and outputs
+        const auto nNodes = static_cast<int64_t>(10 + iThread + iter % 7);
+        std::vector<float> inputs(nNodes * 4);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+          inputs[i] = static_cast<float>(iThread * 1000 + i);
+        }
+
+        const auto outputs = model.runInference(inputs, {nNodes, 4});
+        const auto shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+        if (shape != std::vector<int64_t>{nNodes, 4}) {
+          ++failures[iThread];
+          continue;
+        }
+        const auto* data = outputs[0].GetTensorData<float>();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+          if (data[i] != 2 * inputs[i] + 1) {
+            ++failures[iThread];
+            break;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE_THAT(failures, Catch::Matchers::Equals(std::vector<int>(nThreads, 0)));
+}
+
+TEST_CASE("SessionConfig string conversions", "[onnx]") {
+  REQUIRE(mlutils::toGraphOptimizationLevel("disable") == ORT_DISABLE_ALL);
+  REQUIRE(mlutils::toGraphOptimizationLevel("basic") == ORT_ENABLE_BASIC);
+  REQUIRE(mlutils::toGraphOptimizationLevel("extended") == ORT_ENABLE_EXTENDED);
+  REQUIRE(mlutils::toGraphOptimizationLevel("all") == ORT_ENABLE_ALL);
+  REQUIRE_THROWS_AS(mlutils::toGraphOptimizationLevel("everything"), std::invalid_argument);
+
+  REQUIRE(mlutils::toExecutionMode("sequential") == ORT_SEQUENTIAL);
+  REQUIRE(mlutils::toExecutionMode("parallel") == ORT_PARALLEL);
+  REQUIRE_THROWS_AS(mlutils::toExecutionMode("Parallel"), std::invalid_argument);
+}
+
+TEST_CASE("ONNXInferenceModel with non-default SessionConfig", "[onnx]") {
+  const auto config = mlutils::SessionConfig{.intraOpNumThreads = 2,
+                                             .interOpNumThreads = 2,
+                                             .executionMode = ORT_PARALLEL,
+                                             .graphOptimizationLevel = ORT_ENABLE_ALL,
+                                             .allowSpinning = false,
+                                             .enableCpuMemArena = false,
+                                             .enableMemPattern = false};
+  mlutils::ONNXInferenceModel model("SessionConfigTest", ORT_LOGGING_LEVEL_WARNING, config);
+  REQUIRE(model.loadModel(testModelDir + "/affine.onnx"));
+
+  const std::vector<float> inputs{1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f};
+  const auto outputs = model.runInference(inputs, {2, 4});
+  const auto* data = outputs[0].GetTensorData<float>();
+  REQUIRE_THAT(std::vector<float>(data, data + inputs.size()),
+               Catch::Matchers::Equals(std::vector<float>{3.f, 5.f, 7.f, 9.f, 11.f, 13.f, 15.f, 17.f}));
+}
+
+TEST_CASE("ONNXInferenceModel session sharing", "[onnx]") {
+  const auto modelPath = testModelDir + "/affine.onnx";
+
+  mlutils::ONNXInferenceModel model1("SharingTest1");
+  mlutils::ONNXInferenceModel model2("SharingTest2");
+  REQUIRE_FALSE(model1.sharesSessionWith(model2));
+
+  REQUIRE(model1.loadModel(modelPath));
+  REQUIRE(model2.loadModel(modelPath));
+  REQUIRE(model1.sharesSessionWith(model2));
+
+  SECTION("Different configurations do not share a session") {
+    mlutils::ONNXInferenceModel model3("SharingTest3", ORT_LOGGING_LEVEL_WARNING,
+                                       mlutils::SessionConfig{.graphOptimizationLevel = ORT_ENABLE_BASIC});
+    REQUIRE(model3.loadModel(modelPath));
+    REQUIRE_FALSE(model3.sharesSessionWith(model1));
+  }
+
+  SECTION("Shared sessions stay usable if one of the models is gone") {
+    auto model3 = std::make_unique<mlutils::ONNXInferenceModel>("SharingTest3");
+    REQUIRE(model3->loadModel(modelPath));
+    REQUIRE(model3->sharesSessionWith(model1));
+    model3.reset();
+
+    const auto outputs = model1.runInference(std::vector<float>{1.f, 2.f, 3.f, 4.f}, {1, 4});
+    REQUIRE(outputs[0].GetTensorData<float>()[3] == 9.f);
+  }
+}
+
+TEST_CASE("ONNX Runtime profile summary", "[utils]") {
+  // Shortened version of what ONNX Runtime writes
+  constexpr std::string_view profile = R"([
+{"cat" : "Session","dur" :120,"ts" :1,"ph" : "X","name" :"model_run","args" : {}},
+{"cat" : "Node","dur" :10,"ts" :2,"ph" : "X","name" :"mul_fence_before","args" : {"op_name" : "Mul"}},
+{"cat" : "Node","dur" :30,"ts" :3,"ph" : "X","name" :"mul_kernel_time","args" : {"op_name" : "Mul"}},
+{"cat" : "Node","dur" :50,"ts" :4,"ph" : "X","name" :"gemm_kernel_time","args" : {"op_name" : "Gemm"}},
+{"cat" : "Node","dur" :10,"ts" :5,"ph" : "X","name" :"mul2_kernel_time","args" : {"op_name" : "Mul"}},
+{"cat" : "Node","dur" :10,"ts" :6,"ph" : "X","name" :"add_kernel_time","args" : {"op_name" : "Add"}}
+])";
+
+  const auto ops = mlutils::summarizeProfile(profile);
+  REQUIRE(ops.size() == 3);
+  REQUIRE(ops[0].opType == "Gemm");
+  REQUIRE(ops[0].numCalls == 1);
+  REQUIRE(ops[1].opType == "Mul");
+  REQUIRE(ops[1].numCalls == 2);
+  REQUIRE(ops[1].totalUs == 40.);
+  REQUIRE_THAT(ops[1].fraction, Catch::Matchers::WithinAbs(0.4, 1e-6));
+  REQUIRE(ops[2].opType == "Add");
+
+  const auto top = mlutils::summarizeProfile(profile, 1);
+  REQUIRE(top.size() == 1);
+  REQUIRE(top[0].opType == "Gemm");
+
+  std::ostringstream table{};
+  mlutils::printProfileSummary(table, ops);
+  REQUIRE(table.str().find("Gemm") != std::string::npos);
+  REQUIRE(table.str().find("40.0") != std::string::npos);
+
+  REQUIRE(mlutils::summarizeProfile("[]").empty());
+  REQUIRE_THROWS_AS(mlutils::summarizeProfileFile("/non/existent/profile.json"), std::runtime_error);
+}
+
+TEST_CASE("ONNXInferenceModel profiling", "[onnx]") {
+  namespace fs = std::filesystem;
+  const auto profileDir = fs::temp_directory_path() / "mltracking_unittest_profiles";
+  fs::remove_all(profileDir);
+  fs::create_directories(profileDir);
+
+  const auto config =
+      mlutils::SessionConfig{.profilingFilePrefix = (profileDir / "affine").string(), .profilingMaxRuns = 3};
+  mlutils::ONNXInferenceModel model("ProfilingTest", ORT_LOGGING_LEVEL_WARNING, config);
+  REQUIRE(model.loadModel(testModelDir + "/affine.onnx"));
+  mlutils::ONNXInferenceModel sharing("ProfilingTest2", ORT_LOGGING_LEVEL_WARNING, config);
+  REQUIRE(sharing.loadModel(testModelDir + "/affine.onnx"));
+  REQUIRE(model.sharesSessionWith(sharing));
+
+  const std::vector<float> inputs = {1.f, 2.f, 3.f, 4.f};
+  for (int i = 0; i < 5; ++i) {
+    const auto outputs = (i % 2 ? model : sharing).runInference(inputs, {1, 4});
+    REQUIRE(outputs[0].GetTensorData<float>()[0] == 3.f);
+  }
+
+  // Profiling has ended after the third run already
+  const auto profileFile = model.endProfiling();
+  REQUIRE(fs::exists(profileFile));
+  REQUIRE(sharing.endProfiling() == profileFile);
+  const auto ops = mlutils::summarizeProfileFile(profileFile);
+  REQUIRE(ops.size() == 2);
+  for (const auto& op : ops) {
+    REQUIRE((op.opType == "Mul" || op.opType == "Add"));
+    REQUIRE(op.numCalls == 3);
+  }
+
+  std::ostringstream dump{};
+  model.dumpProfile(dump);
+  REQUIRE(dump.str().find("Mul") != std::string::npos);
+
+  mlutils::ONNXInferenceModel unprofiled("NoProfilingTest");
+  REQUIRE(unprofiled.loadModel(testModelDir + "/affine.onnx"));
+  REQUIRE(unprofiled.endProfiling().empty());
+
+  fs::remove_all(profileDir);
+}
+
+TEST_CASE("ONNXInferenceModel reduced precision", "[onnx]") {
+  using Precision = mlutils::ModelPrecision;
+  REQUIRE(mlutils::toModelPrecision("int8") == Precision::Int8);
+  REQUIRE(mlutils::toModelPrecision("fp16") == Precision::FP16Weights);
+  REQUIRE_THROWS_AS(mlutils::toModelPrecision("bf16"), std::invalid_argument);
+  REQUIRE(mlutils::modelVariantPath("/models/mlp.onnx", Precision::FP32) == "/models/mlp.onnx");
+  REQUIRE(mlutils::modelVariantPath("/models/mlp.onnx", Precision::Int8) == "/models/mlp.int8.onnx");
+  REQUIRE(mlutils::modelVariantPath("/models/mlp.onnx", Precision::FP16Weights) == "/models/mlp.fp16.onnx");
+
+  std::vector<float> inputs(1000 * 4);
+  std::ranges::generate(inputs, [rng = std::mt19937{42}, dist = std::normal_distribution<float>{}]() mutable {
+    return dist(rng);
+  });
+  const std::vector<int64_t> shape = {1000, 4};
+
+  mlutils::ONNXInferenceModel reference("fp32");
+  REQUIRE(reference.loadModel(testModelDir + "/mlp.onnx"));
+  const auto referenceOutputs = reference.runInference(inputs, shape);
+  const auto* expected = referenceOutputs[0].GetTensorData<float>();
+
+  const std::array variants = {std::pair{Precision::FP16Weights, 0.01f}, std::pair{Precision::Int8, 0.1f}};
+  for (const auto& [precision, tolerance] : variants) {
+    mlutils::ONNXInferenceModel model("reduced", ORT_LOGGING_LEVEL_WARNING, {.precision = precision});
+    REQUIRE(model.loadModel(testModelDir + "/mlp.onnx"));
+    REQUIRE(model.loadInfo().modelPath == mlutils::modelVariantPath(testModelDir + "/mlp.onnx", precision));
+    REQUIRE_FALSE(model.sharesSessionWith(reference));
+
+    const auto outputs = model.runInference(inputs, shape);
+    const auto* values = outputs[0].GetTensorData<float>();
+    for (size_t i = 0; i < 1000 * 8; ++i) {
+      REQUIRE_THAT(values[i], Catch::Matchers::WithinAbs(expected[i], tolerance));
+    }
+  }
+
+  // There are no reduced precision variants of the affine model
+  mlutils::ONNXInferenceModel missing("missing", ORT_LOGGING_LEVEL_WARNING, {.precision = Precision::Int8});
+  REQUIRE_FALSE(missing.loadModel(testModelDir + "/affine.onnx"));
+}
+
+TEST_CASE("ONNXInferenceModel optimized model cache", "[onnx]") {
+  namespace fs = std::filesystem;
+  using Source = mlutils::ModelLoadInfo::Source;
+
+  const auto cacheDir = fs::temp_directory_path() / "mltracking_unittest_model_cache";
+  fs::remove_all(cacheDir);
+  // Work on a copy of the model, such that it can be changed
+  const auto modelPath = (cacheDir / "model.onnx").string();
+  fs::create_directories(cacheDir);
+  fs::copy_file(testModelDir + "/affine.onnx", modelPath);
+
+  const auto config = mlutils::SessionConfig{.optimizedModelCacheDir = (cacheDir / "cache").string()};
+  const auto loadModel = [&]() {
+    auto model = std::make_unique<mlutils::ONNXInferenceModel>("CacheTest", ORT_LOGGING_LEVEL_WARNING, config);
+    REQUIRE(model->loadModel(modelPath));
+    return model;
+  };
+
+  std::string cachePath{};
+  {
+    const auto model = loadModel();
+    REQUIRE(model->loadInfo().source == Source::File);
+    cachePath = model->loadInfo().optimizedModelPath;
+    REQUIRE(fs::exists(cachePath));
+
+    // Sessions are still shared while the first model is alive
+    const auto model2 = loadModel();
+    REQUIRE(model2->loadInfo().source == Source::SharedSession);
+  }
+
+  {
+    const auto model = loadModel();
+    REQUIRE(model->loadInfo().source == Source::OptimizedCache);
+    REQUIRE(model->loadInfo().optimizedModelPath == cachePath);
+    const auto outputs = model->runInference(std::vector<float>{1.f, 2.f, 3.f, 4.f}, {1, 4});
+    REQUIRE(outputs[0].GetTensorData<float>()[0] == 3.f);
+  }
+
+  // Changing the model contents invalidates the cache
+  fs::copy_file(testModelDir + "/affine_3d.onnx", modelPath, fs::copy_options::overwrite_existing);
+  {
+    const auto model = loadModel();
+    REQUIRE(model->loadInfo().source == Source::File);
+    REQUIRE(model->loadInfo().optimizedModelPath != cachePath);
+    REQUIRE(fs::exists(model->loadInfo().optimizedModelPath));
+    REQUIRE_FALSE(fs::exists(cachePath));
+  }
+
+  fs::remove_all(cacheDir);
+}
+
+TEST_CASE("ObjectPool", "[utils]") {
+  int nCreated = 0;
+  mlutils::ObjectPool<std::vector<float>> pool([&nCreated]() {
+    ++nCreated;
+    return std::make_unique<std::vector<float>>();
+  });
+
+  const std::vector<float>* first = nullptr;
+  {
+    auto obj1 = pool.acquire();
+    auto obj2 = pool.acquire();
+    REQUIRE(nCreated == 2);
+    REQUIRE(pool.numIdle() == 0);
+    obj1->resize(100);
+    first = &*obj1;
+  }
+  REQUIRE(pool.numIdle() == 2);
+
+  // Objects are re-used, including their state
+  auto obj = pool.acquire();
+  auto obj2 = pool.acquire();
+  REQUIRE(nCreated == 2);
+  REQUIRE((&*obj == first || &*obj2 == first));
+}
+
+TEST_CASE("MultiCollectionView", "[utils]") {
+  const std::vector<int> coll1 = {0, 1, 2};
+  const std::vector<int> empty{};
+  const std::vector<int> coll2 = {3, 4};
+  const std::vector<const std::vector<int>*> collections = {&empty, &coll1, &empty, &coll2, &empty};
+
+  mlutils::MultiCollectionView<std::vector<int>> view{collections};
+  REQUIRE(view.size() == 5);
+  REQUIRE(view.numCollections() == 5);
+  REQUIRE(view.offset(3) == 3);
+  for (size_t i = 0; i < view.size(); ++i) {
+    REQUIRE(view[i] == static_cast<int>(i));
+  }
+  REQUIRE(view.locate(0).collection == 1);
+  REQUIRE(view.locate(2).index == 2);
+  REQUIRE(view.locate(3).collection == 3);
+  REQUIRE(view.locate(4).index == 1);
+  // Elements are not copied
+  REQUIRE(&view[4] == &coll2[1]);
+
+  std::vector<size_t> visited{};
+  view.forEach([&visited](size_t globalIdx, int elem) {
+    REQUIRE(static_cast<int>(globalIdx) == elem);
+    visited.push_back(globalIdx);
+  });
+  REQUIRE(visited.size() == 5);
+
+  // Resetting re-uses the view
+  const std::vector<const std::vector<int>*> onlyEmpty = {&empty};
+  view.reset(onlyEmpty);
+  REQUIRE(view.empty());
+  view.forEach([](size_t, int) { FAIL("No elements expected"); });
+}
+
+TEST_CASE("Track output", "[utils]") {
+  const std::vector<std::vector<int>> candidates = {{0, 1, 2}, {3}, {7, 5, 6, 4}, {}, {8, 9}};
+  REQUIRE(mlutils::countAcceptedCandidates(candidates, 3) == 2);
+  REQUIRE(mlutils::countAcceptedCandidates(candidates, 1) == 4);
+  REQUIRE(mlutils::countAcceptedCandidates(candidates, 5) == 0);
+
+  // A minimal stand-in for the EDM4hep tracks
+  struct Track {
+    std::vector<int> hits{};
+    std::vector<int> states{};
+  };
+  struct TrackHandle {
+    Track* track;
+    void addToTrackerHits(int hit) { track->hits.push_back(hit); }
+    void addToTrackStates(int state) { track->states.push_back(state); }
+  };
+  struct TrackCollection {
+    std::vector<Track> tracks{};
+    size_t size() const { return tracks.size(); }
+    void reserve(size_t n) { tracks.reserve(n); }
+    TrackHandle create() { return {&tracks.emplace_back()}; }
+  };
+  const std::vector<int> hits = {100, 101, 102, 103, 104, 105, 106, 107, 108, 109};
+
+  TrackCollection tracks{};
+  std::vector<std::pair<size_t, size_t>> monitored{};
+  const auto numTracks = mlutils::fillTracks(candidates, 3, hits, 42, tracks,
+                                             [&monitored](size_t iTrack, const std::vector<int>& candidate) {
+                                               monitored.emplace_back(iTrack, candidate.size());
+                                             });
+  REQUIRE(numTracks == 2);
+  REQUIRE(tracks.tracks.capacity() >= 2);
+  REQUIRE(tracks.size() == 2);
+  REQUIRE(tracks.tracks[0].hits == std::vector<int>{100, 101, 102});
+  REQUIRE(tracks.tracks[1].hits == std::vector<int>{107, 105, 106, 104});
+  REQUIRE(tracks.tracks[0].states == std::vector<int>{42});
+  // Only the accepted candidates are passed on
+  REQUIRE(monitored == std::vector<std::pair<size_t, size_t>>{{0, 3}, {1, 4}});
+
+  // Tracks are appended to an existing collection
+  REQUIRE(mlutils::fillTracks(candidates, 2, hits, 42, tracks) == 3);
+  REQUIRE(tracks.size() == 5);
+  REQUIRE(tracks.tracks[4].hits == std::vector<int>{108, 109});
+  REQUIRE(mlutils::fillTracks(candidates, 5, hits, 42, tracks) == 0);
+}
+
+TEST_CASE("InferenceBatcher", "[utils]") {
+  using namespace std::chrono_literals;
+
+  // A row-wise "model" that doubles the first column of each row and counts
+  // how often it has been called
+  std::atomic<int> nCalls{0};
+  auto model = [&nCalls](std::span<const float> input, size_t numRows, std::span<float> output) {
+    ++nCalls;
+    const auto inWidth = input.size() / numRows;
+    for (size_t i = 0; i < numRows; ++i) {
+      output[i] = 2 * input[i * inWidth];
+    }
+  };
+
+  // Run one request per thread with distinct values and count the wrong
+  // results on the main thread, since the Catch2 assertion macros are not
+  // thread-safe
+  auto runConcurrently = [](mlutils::InferenceBatcher& batcher, int nThreads, int nIterations) {
+    std::vector<int> failures(nThreads, 0);
+    std::vector<std::thread> threads{};
+    for (int iThread = 0; iThread < nThreads; ++iThread) {
+      threads.emplace_back([&, iThread]() {
+        for (int iter = 0; iter < nIterations; ++iter) {
+          const size_t nRows = 10 + iThread + iter % 7;
+          std::vector<float> input(nRows * 2);
+          for (size_t i = 0; i < nRows; ++i) {
+            input[2 * i] = static_cast<float>(iThread * 1000 + i);
+          }
+          std::vector<float> output(nRows);
+          batcher.run(input, nRows, output);
+          for (size_t i = 0; i < nRows; ++i) {
+            failures[iThread] += output[i] != 2 * input[2 * i];
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    return failures;
+  };
+
+  SECTION("Concurrent requests get their own results") {
+    mlutils::InferenceBatcher batcher{model, {.maxWaitTime = 200us}};
+    const auto failures = runConcurrently(batcher, 16, 50);
+    REQUIRE_THAT(failures, Catch::Matchers::Equals(std::vector<int>(16, 0)));
+
+    const auto stats = batcher.stats();
+    REQUIRE(stats.numRequests == 16 * 50);
+    REQUIRE(stats.numBatches == static_cast<size_t>(nCalls));
+    REQUIRE(stats.numBatches <= stats.numRequests);
+  }
+
+  SECTION("A full batch does not wait") {
+    // All four requests end up in one batch, which is run as soon as the last
+    // one has joined, long before the maximum wait time
+    mlutils::InferenceBatcher batcher{model, {.maxBatchRequests = 4, .maxWaitTime = 60s}};
+    const auto start = std::chrono::steady_clock::now();
+    const auto failures = runConcurrently(batcher, 4, 1);
+    REQUIRE(std::chrono::steady_clock::now() - start < 30s);
+    REQUIRE_THAT(failures, Catch::Matchers::Equals(std::vector<int>(4, 0)));
+    REQUIRE(nCalls == 1);
+    REQUIRE(batcher.stats().numRows == 10 + 11 + 12 + 13);
+  }
+
+  SECTION("Large requests and single requests are run directly") {
+    mlutils::InferenceBatcher batcher{model, {.maxBatchRows = 10, .maxWaitTime = 60s}};
+    REQUIRE_THAT(runConcurrently(batcher, 4, 5), Catch::Matchers::Equals(std::vector<int>(4, 0)));
+    REQUIRE(nCalls == 20);
+
+    mlutils::InferenceBatcher unbatched{model, {.maxBatchRequests = 1, .maxWaitTime = 60s}};
+    const std::vector<float> input = {1.f, 2.f, 3.f};
+    std::vector<float> output(3);
+    unbatched.run(input, 3, output);
+    REQUIRE_THAT(output, Catch::Matchers::Equals(std::vector<float>{2.f, 4.f, 6.f}));
+    REQUIRE(unbatched.stats().numBatches == 1);
+  }
+
+  SECTION("Exceptions are propagated to all requests of a batch") {
+    mlutils::InferenceBatcher batcher{[](std::span<const float>, size_t, std::span<float>) {
+                                        throw std::runtime_error("Inference failed");
+                                      },
+                                      {.maxBatchRequests = 3, .maxWaitTime = 60s}};
+    std::atomic<int> nThrown{0};
+    std::vector<std::thread> threads{};
+    for (int i = 0; i < 3; ++i) {
+      threads.emplace_back([&]() {
+        const std::vector<float> input(4, 1.f);
+        std::vector<float> output(4);
+        try {
+          batcher.run(input, 4, output);
+        } catch (const std::runtime_error&) {
+          ++nThrown;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(nThrown == 3);
+  }
+}
+
+TEST_CASE("StagePipeline", "[utils]") {
+  // Every event records the stages it has passed. The limits are tracked with
+  // atomics and only checked on the main thread, since the Catch2 assertion
+  // macros are not thread-safe
+  struct Event {
+    size_t id{0};
+    std::vector<size_t> stages{};
+  };
+  constexpr size_t numStages = 3;
+  constexpr size_t maxInFlight = 3;
+  constexpr size_t numEvents = 200;
+  constexpr size_t failingEvent = 1000;
+  const std::array<unsigned, numStages> concurrency = {1, 2, 1};
+  mlutils::TaskPool pool{4};
+
+  std::atomic<int> inFlight{0};
+  std::atomic<int> maxSeenInFlight{0};
+  std::array<std::atomic<unsigned>, numStages> running{};
+  std::array<std::atomic<unsigned>, numStages> maxRunning{};
+  std::vector<size_t> firstStageOrder{};
+  std::atomic<bool> stageOrderOk{true};
+  auto updateMax = [](auto& max, auto value) {
+    auto current = max.load();
+    while (value > current && !max.compare_exchange_weak(current, value)) {
+    }
+  };
+
+  using Pipeline = mlutils::StagePipeline<Event, size_t>;
+  std::vector<Pipeline::Stage> stages{};
+  for (size_t stage = 0; stage < numStages; ++stage) {
+    stages.push_back({.run =
+                          [&, stage](Event& event) {
+                            updateMax(maxRunning[stage], ++running[stage]);
+                            stageOrderOk = stageOrderOk && event.stages.size() == stage;
+                            event.stages.push_back(stage);
+                            if (stage == 0) {
+                              firstStageOrder.push_back(event.id);
+                            }
+                            if (event.id % 7 == 0) {
+                              std::this_thread::sleep_for(std::chrono::microseconds(200));
+                            }
+                            --running[stage];
+                            if (stage == 1 && event.id == failingEvent) {
+                              --inFlight;
+                              throw std::runtime_error("Stage failed");
+                            }
+                          },
+                      .maxConcurrency = concurrency[stage]});
+  }
+  // The result of an event is its id, if it has passed all stages
+  const auto finish = [&](Event& event) {
+    --inFlight;
+    return event.stages.size() == numStages ? event.id : numEvents;
+  };
+  Pipeline pipeline{pool, stages, finish, maxInFlight};
+  auto push = [&](size_t id) {
+    return pipeline.push([&, id](Event& event) {
+      updateMax(maxSeenInFlight, ++inFlight);
+      event.id = id;
+      event.stages.clear();
+    });
+  };
+
+  SECTION("All events pass all stages within the limits") {
+    std::vector<std::future<size_t>> results{};
+    for (size_t i = 0; i < numEvents; ++i) {
+      results.push_back(push(i));
+    }
+    std::vector<size_t> finished{};
+    for (auto& result : results) {
+      finished.push_back(result.get());
+    }
+
+    REQUIRE(stageOrderOk);
+    REQUIRE(inFlight == 0);
+    REQUIRE(maxSeenInFlight <= static_cast<int>(maxInFlight));
+    for (size_t stage = 0; stage < numStages; ++stage) {
+      REQUIRE(maxRunning[stage] <= concurrency[stage]);
+    }
+    std::vector<size_t> expected(numEvents);
+    std::iota(expected.begin(), expected.end(), 0);
+    // Every event gets its own result
+    REQUIRE(finished == expected);
+    // A stage that runs one event at a time keeps the order
+    REQUIRE(firstStageOrder == expected);
+  }
+
+  SECTION("Events can be pushed from several threads") {
+    constexpr size_t numThreads = 4;
+    std::vector<std::vector<size_t>> finished(numThreads);
+    {
+      std::vector<std::jthread> threads{};
+      for (size_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+          for (size_t i = t; i < numEvents; i += numThreads) {
+            finished[t].push_back(push(i).get());
+          }
+        });
+      }
+    }
+    REQUIRE(stageOrderOk);
+    REQUIRE(maxSeenInFlight <= static_cast<int>(maxInFlight));
+    for (size_t t = 0; t < numThreads; ++t) {
+      REQUIRE(finished[t].size() == numEvents / numThreads);
+      for (size_t i = 0; i < finished[t].size(); ++i) {
+        REQUIRE(finished[t][i] == t + i * numThreads);
+      }
+    }
+  }
+
+  SECTION("Exceptions only affect their own event") {
+    std::vector<std::future<size_t>> results{};
+    for (size_t i = failingEvent - 2; i < failingEvent + 3; ++i) {
+      results.push_back(push(i));
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+      if (i == 2) {
+        REQUIRE_THROWS_AS(results[i].get(), std::runtime_error);
+      } else {
+        REQUIRE(results[i].get() == failingEvent - 2 + i);
+      }
+    }
+    REQUIRE(inFlight == 0);
+
+    // An exception of the setup is thrown by push and the slot stays usable
+    REQUIRE_THROWS_AS(pipeline.push([](Event&) { throw std::invalid_argument("Setup failed"); }),
+                      std::invalid_argument);
+    for (size_t i = 0; i < maxInFlight; ++i) {
+      REQUIRE(push(i).get() == i);
+    }
+  }
+
+  SECTION("Invalid configurations") {
+    REQUIRE_THROWS_AS(Pipeline(pool, {}, finish, 1), std::invalid_argument);
+    REQUIRE_THROWS_AS(Pipeline(pool, stages, finish, 0), std::invalid_argument);
+  }
+}
+
+TEST_CASE("TaskPool", "[utils]") {
+  // Tasks that submit further tasks, all of which have to be run before the
+  // pool is destroyed
+  std::atomic<int> nRun{0};
+  {
+    mlutils::TaskPool pool{3};
+    REQUIRE(pool.numThreads() == 3);
+    for (int i = 0; i < 100; ++i) {
+      pool.submit([&]() {
+        ++nRun;
+        for (int j = 0; j < 10; ++j) {
+          pool.submit([&]() { ++nRun; });
+        }
+      });
+    }
+  }
+  REQUIRE(nRun == 100 * 11);
+}
+
+TEST_CASE("Stage monitoring", "[utils]") {
+  namespace fs = std::filesystem;
+  using namespace std::chrono_literals;
+
+  SECTION("ScopedTimer") {
+    double timeMs = 1.;
+    {
+      mlutils::ScopedTimer timer{timeMs};
+      std::this_thread::sleep_for(2ms);
+    }
+    REQUIRE(timeMs >= 3.);
+
+    // Stopping more than once only records the time once
+    double stoppedMs = 0.;
+    mlutils::ScopedTimer timer{stoppedMs};
+    timer.stop();
+    const auto recorded = stoppedMs;
+    std::this_thread::sleep_for(1ms);
+    timer.stop();
+    REQUIRE(stoppedMs == recorded);
+
+    // Disabled timers are no-ops
+    mlutils::ScopedTimer disabled{nullptr};
+    disabled.stop();
+  }
+
+  SECTION("StageRecord") {
+    mlutils::StageRecord record{};
+    record.reset(3, 2);
+    REQUIRE(record.timesMs.size() == 3);
+    REQUIRE(record.counters.size() == 2);
+    REQUIRE(record.rssKb > 0);
+
+    // The memory that is touched during a stage is attributed to it
+    const auto startRssKb = record.rssKb;
+    mlutils::ScopedTimer timer{record.timesMs[0]};
+    auto memory = std::make_unique<std::vector<char>>(64 << 20, 1);
+    record.finishStage(0, timer);
+    REQUIRE(record.rssChangeKb[0] >= 32 * 1024);
+    REQUIRE(record.rssKb == startRssKb + record.rssChangeKb[0]);
+    REQUIRE(record.timesMs[0] > 0.);
+
+    mlutils::ScopedTimer releaseTimer{record.timesMs[1]};
+    memory.reset();
+    record.finishStage(1, releaseTimer);
+    // Whether the memory is returned to the system depends on the allocator,
+    // but the changes always add up to the current RSS
+    REQUIRE(record.rssKb == startRssKb + record.rssChangeKb[0] + record.rssChangeKb[1]);
+    REQUIRE(record.rssChangeKb[2] == 0);
+  }
+
+  SECTION("Latency summary") {
+    std::vector<double> latencies(101);
+    std::iota(latencies.begin(), latencies.end(), 0.);
+    std::ranges::shuffle(latencies, std::mt19937{42});
+    const auto summary = mlutils::summarizeLatencies(latencies);
+    REQUIRE(summary.count == 101);
+    REQUIRE(summary.mean == 50.);
+    REQUIRE(summary.min == 0.);
+    REQUIRE(summary.p50 == 50.);
+    REQUIRE(summary.p90 == 90.);
+    REQUIRE_THAT(summary.p99, Catch::Matchers::WithinAbs(99., 1e-9));
+    REQUIRE(summary.max == 100.);
+
+    // Interpolation between the closest ranks
+    const std::vector<double> sorted = {1., 2., 3., 4.};
+    REQUIRE(mlutils::percentile(sorted, 0.5) == 2.5);
+    REQUIRE(mlutils::percentile(sorted, 1.) == 4.);
+    REQUIRE(mlutils::percentile(std::vector<double>{7.}, 0.9) == 7.);
+    REQUIRE(mlutils::summarizeLatencies({}).count == 0);
+  }
+
+  mlutils::StageRecord record{};
+  record.reset(2, 1);
+  record.timesMs = {1.5, 2.};
+  record.rssChangeKb = {100, -200};
+  record.counters = {42};
+  const std::vector<std::string> stages = {"embedding", "edges"};
+  const std::vector<std::string> counters = {"hits"};
+  const auto readLines = [](const fs::path& path) {
+    std::ifstream file(path);
+    std::vector<std::string> lines{};
+    for (std::string line; std::getline(file, line);) {
+      lines.push_back(line);
+    }
+    return lines;
+  };
+
+  SECTION("CSV trace") {
+    const auto path = fs::temp_directory_path() / "mltracking_unittest_trace.csv";
+    {
+      mlutils::StageTraceWriter writer{path.string(), stages, counters};
+      REQUIRE(writer.format() == mlutils::StageTraceWriter::Format::CSV);
+      writer.write(0, record);
+      writer.write(1, record);
+    }
+    REQUIRE_THAT(readLines(path),
+                 Catch::Matchers::Equals(std::vector<std::string>{
+                     "event,embedding_ms,edges_ms,embedding_rss_change_kb,edges_rss_change_kb,hits",
+                     "0,1.5,2,100,-200,42", "1,1.5,2,100,-200,42"}));
+    fs::remove(path);
+  }
+
+  SECTION("JSON trace") {
+    const auto path = fs::temp_directory_path() / "mltracking_unittest_trace.json";
+    {
+      mlutils::StageTraceWriter writer{path.string(), stages, counters};
+      REQUIRE(writer.format() == mlutils::StageTraceWriter::Format::JSON);
+      writer.write(3, record);
+    }
+    REQUIRE_THAT(readLines(path), Catch::Matchers::Equals(std::vector<std::string>{
+                                      "{\"event\": 3, \"time_ms\": {\"embedding\": 1.5, \"edges\": 2}, "
+                                      "\"rss_change_kb\": {\"embedding\": 100, \"edges\": -200}, \"counters\": "
+                                      "{\"hits\": 42}}"}));
+    fs::remove(path);
+  }
+
+  SECTION("Invalid trace file") {
+    REQUIRE_THROWS_AS(mlutils::StageTraceWriter("/non/existent/dir/trace.csv", stages, counters), std::runtime_error);
+  }
+}
+
+TEST_CASE("InferenceBuffers", "[onnx]") {
+  mlutils::ONNXInferenceModel model("InferenceBuffersTest");
+  REQUIRE(model.loadModel(testModelDir + "/affine.onnx"));
+  mlutils::InferenceBuffers buffers(model);
+
+  const auto runWithNodes = [&](std::vector<float>& inputs, int64_t nNodes) {
+    const std::array shape = {nNodes, int64_t{4}};
+    buffers.bindInput({inputs.data(), static_cast<size_t>(nNodes * 4)}, shape);
+    buffers.bindOutput(0, shape);
+    model.runInference(buffers);
+  };
+
+  std::vector<float> inputs(1000 * 4);
+  std::iota(inputs.begin(), inputs.end(), 0.f);
+
+  runWithNodes(inputs, 1000);
+  REQUIRE(buffers.numReallocations() == 1);
+  REQUIRE(std::ranges::equal(buffers.outputShape(0), std::array<int64_t, 2>{1000, 4}));
+  REQUIRE(buffers.output(0).size() == 4000);
+  REQUIRE(buffers.output(0)[3999] == 2 * 3999.f + 1);
+  const auto* outputData = buffers.output(0).data();
+
+  SECTION("Output buffers only grow") {
+    runWithNodes(inputs, 500);
+    REQUIRE(buffers.output(0).size() == 2000);
+    REQUIRE(buffers.output(0)[1999] == 2 * 1999.f + 1);
+
+    runWithNodes(inputs, 1000);
+    REQUIRE(buffers.numReallocations() == 1);
+    REQUIRE(buffers.output(0).data() == outputData);
+
+    std::vector<float> moreInputs(2000 * 4, 1.f);
+    runWithNodes(moreInputs, 2000);
+    REQUIRE(buffers.numReallocations() == 2);
+    REQUIRE(buffers.output(0)[7999] == 3.f);
+  }
+
+  SECTION("No allocations for unchanged bindings") {
+    const auto countAllocations = [&](auto&& func) {
+      const auto before = allocationCount.load();
+      func();
+      return allocationCount.load() - before;
+    };
+
+    // Re-binding the same data does not allocate at all
+    const std::array<int64_t, 2> shape = {1000, 4};
+    REQUIRE(countAllocations([&]() {
+              buffers.bindInput(inputs, shape);
+              buffers.bindOutput(0, shape);
+              REQUIRE(buffers.output(0).data() == outputData);
+            }) == 0);
+
+    // ONNX Runtime allocates a few small objects in every run, which cannot be
+    // avoided. Their number must neither grow from event to event nor with the
+    // number of nodes, and must stay below the allocating overload
+    const auto steadyEvent = [&](int64_t nNodes) {
+      return countAllocations([&]() { runWithNodes(inputs, nNodes); });
+    };
+    const auto ortAllocations = steadyEvent(1000);
+    for (int i = 0; i < 5; ++i) {
+      REQUIRE(steadyEvent(1000) == ortAllocations);
+    }
+    // Warm up ONNX Runtime for the new shape, which binds new tensors once
+    runWithNodes(inputs, 10);
+    REQUIRE(steadyEvent(10) == ortAllocations);
+    REQUIRE(buffers.numReallocations() == 1);
+    REQUIRE(buffers.output(0).data() == outputData);
+    REQUIRE(buffers.output(0)[39] == 2 * 39.f + 1);
+
+    const std::vector<int64_t> plainShape = {1000, 4};
+    const auto plainAllocations = countAllocations([&]() { (void)model.runInference(inputs, plainShape); });
+    REQUIRE(ortAllocations < plainAllocations);
+  }
+}
+
+TEST_CASE("ONNXInferenceModel multiple typed inputs", "[onnx]") {
+  mlutils::ONNXInferenceModel model("MultiInputTest");
+  REQUIRE(model.loadModel(testModelDir + "/multi_input.onnx"));
+
+  std::vector<float> nodeFeatures(4 * 3);
+  std::iota(nodeFeatures.begin(), nodeFeatures.end(), 0.f);
+  const std::array<int64_t, 2> nodeShape = {4, 3};
+  const std::vector<int64_t> edgeIndex = {0, 1, 2, 1, 2, 3};
+  const std::array<int64_t, 2> edgeShape = {2, 3};
+
+  // Order of the inputs does not matter, only their names
+  const std::array inputs = {mlutils::InputTensor{"edge_index", edgeIndex, edgeShape},
+                             mlutils::InputTensor{"node_features", nodeFeatures, nodeShape}};
+  const auto expectedScores = std::vector<float>{15.f, 33.f, 51.f};
+
+  SECTION("All outputs") {
+    const auto outputs = model.runInference(inputs);
+    REQUIRE(outputs.size() == 2);
+    const auto* scores = outputs[0].GetTensorData<float>();
+    REQUIRE_THAT(std::vector<float>(scores, scores + 3), Catch::Matchers::Equals(expectedScores));
+    REQUIRE(outputs[1].GetTensorData<float>()[11] == 22.f);
+  }
+
+  SECTION("Subset of outputs") {
+    const std::array<std::string_view, 1> outputNames = {"node_outputs"};
+    const auto outputs = model.runInference(inputs, outputNames);
+    REQUIRE(outputs.size() == 1);
+    REQUIRE(outputs[0].GetTensorTypeAndShapeInfo().GetShape() == std::vector<int64_t>{4, 3});
+  }
+
+  SECTION("Invalid inputs") {
+    const std::array wrongName = {mlutils::InputTensor{"edge_indices", edgeIndex, edgeShape},
+                                  mlutils::InputTensor{"node_features", nodeFeatures, nodeShape}};
+    REQUIRE_THROWS_AS(model.runInference(wrongName), std::invalid_argument);
+
+    const std::vector<float> floatEdgeIndex(edgeIndex.begin(), edgeIndex.end());
+    const std::array wrongType = {mlutils::InputTensor{"edge_index", floatEdgeIndex, edgeShape},
+                                  mlutils::InputTensor{"node_features", nodeFeatures, nodeShape}};
+    REQUIRE_THROWS_AS(model.runInference(wrongType), std::invalid_argument);
+
+    const std::array<std::string_view, 1> outputNames = {"scores"};
+    REQUIRE_THROWS_AS(model.runInference(inputs, outputNames), std::invalid_argument);
+  }
+
+  SECTION("Via InferenceBuffers with only one output bound") {
+    mlutils::InferenceBuffers buffers(model);
+    for (const auto& input : inputs) {
+      buffers.bindInput(input);
+    }
+    const std::array<int64_t, 1> scoreShape = {3};
+    buffers.bindOutput(model.outputIndex("edge_scores"), scoreShape);
+    model.runInference(buffers);
+
+    const auto scores = buffers.output(0);
+    REQUIRE_THAT(std::vector<float>(scores.begin(), scores.end()), Catch::Matchers::Equals(expectedScores));
+    REQUIRE(buffers.output(1).empty());
+  }
+}
+
+TEST_CASE("Batched inference benchmarks", "[.][benchmark][onnx]") {
+  using namespace std::chrono_literals;
+  mlutils::ONNXInferenceModel model("BatchingBenchmark");
+  REQUIRE(model.loadModel(testModelDir + "/mlp.onnx"));
+  mlutils::ObjectPool<mlutils::InferenceBuffers> bufferPool(
+      [&model]() { return std::make_unique<mlutils::InferenceBuffers>(model); });
+
+  constexpr int64_t nFeatures = 4;
+  constexpr int64_t nOutputs = 8;
+  auto embed = [&](std::span<const float> input, size_t numRows, std::span<float> output) {
+    auto buffers = bufferPool.acquire();
+    const std::array<int64_t, 2> inputShape = {static_cast<int64_t>(numRows), nFeatures};
+    const std::array<int64_t, 2> outputShape = {static_cast<int64_t>(numRows), nOutputs};
+    buffers->bindInput(input, inputShape);
+    buffers->bindOutput(0, outputShape);
+    model.runInference(*buffers);
+    std::ranges::copy(buffers->output(0), output.begin());
+  };
+
+  // Small events, for which running the model once per event is least
+  // efficient
+  constexpr size_t nHits = 2000;
+  constexpr int nEventsPerThread = 8;
+  const auto input = randomPoints(nHits, nFeatures);
+
+  for (const int nConcurrent : {1, 4, 16}) {
+    const mlutils::BatchingConfig config{.maxBatchRequests = static_cast<size_t>(nConcurrent), .maxWaitTime = 1ms};
+    mlutils::InferenceBatcher batcher{embed, config};
+    auto processEvents = [&](bool batched) {
+      std::vector<std::jthread> threads{};
+      for (int iThread = 0; iThread < nConcurrent; ++iThread) {
+        threads.emplace_back([&]() {
+          std::vector<float> output(nHits * nOutputs);
+          for (int iEvent = 0; iEvent < nEventsPerThread; ++iEvent) {
+            if (batched) {
+              batcher.run(input, nHits, output);
+            } else {
+              embed(input, nHits, output);
+            }
+          }
+        });
+      }
+    };
+
+    const auto suffix = std::to_string(nConcurrent) + " concurrent events";
+    BENCHMARK("unbatched, " + suffix) { return processEvents(false); };
+    BENCHMARK("batched, " + suffix) { return processEvents(true); };
+  }
+}